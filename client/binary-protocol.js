@@ -0,0 +1,196 @@
+// Decoder for the binary state protocol (see include/BinaryProtocol.h).
+// Produces the same object shapes as the JSON state and terrain messages so
+// the rest of the client does not care which format the server is sending.
+const BinaryProtocol = (() => {
+    const SCHEMA_VERSION = 3;
+    const MSG_STATE = 1;
+    const MSG_TERRAIN = 2;
+    const MSG_PROJECTILES = 3;
+
+    const FLAG_QUANTIZED = 1 << 0;
+    const FLAG_TERRAIN = 1 << 1;
+    const FLAG_PARTIAL = 1 << 2;
+
+    // Must match the EntityField bits in include/EntityState.h
+    const FIELD = {
+        ENEMY_TYPE: 1 << 0,
+        TOWER_TYPE: 1 << 1,
+        HEALTH: 1 << 2,
+        MAX_HEALTH: 1 << 3,
+        HAS_PATH: 1 << 4,
+        PATH_LENGTH: 1 << 5,
+        IS_SLOWED: 1 << 6,
+        SLOW_FACTOR: 1 << 7,
+        IS_BOSS: 1 << 8,
+        RANGE: 1 << 9,
+        DAMAGE: 1 << 10,
+        FIRE_RATE: 1 << 11,
+        UPGRADE_LEVEL: 1 << 12,
+        UPGRADE_COST: 1 << 13,
+        SPLASH_RADIUS: 1 << 14,
+        GRAVITY_STRENGTH: 1 << 15,
+        RADIUS: 1 << 16,
+        OWNER: 1 << 17,
+        SPEED: 1 << 18
+    };
+
+    const GAME_STATES = ['playing', 'victory', 'gameOver'];
+
+    // Decodes any message type; terrain messages come back as
+    // { type: 'terrain', tick, terrain } and projectile events in the same
+    // shape as their JSON form
+    function decode(buffer) {
+        const view = new DataView(buffer);
+        const messageType = view.getUint8(0);
+        if (messageType === MSG_TERRAIN || messageType === MSG_PROJECTILES) {
+            const version = view.getUint8(1);
+            if (version !== SCHEMA_VERSION) {
+                throw new Error(`Unsupported schema version ${version}`);
+            }
+            const tick = view.getUint32(2, true);
+            if (messageType === MSG_PROJECTILES) {
+                return decodeProjectiles(view, tick, 6);
+            }
+            return { type: 'terrain', tick, terrain: decodeTerrain(view, 6) };
+        }
+        return decodeState(buffer);
+    }
+
+    function decodeProjectiles(view, tick, offset) {
+        const spawned = new Array(view.getUint32(offset, true));
+        offset += 4;
+        for (let i = 0; i < spawned.length; i++) {
+            spawned[i] = [
+                view.getUint32(offset, true),
+                view.getUint32(offset + 4, true),
+                view.getFloat64(offset + 8, true),
+                view.getFloat64(offset + 16, true),
+                view.getFloat64(offset + 24, true),
+                view.getFloat64(offset + 32, true)
+            ];
+            offset += 40;
+        }
+        const removed = new Array(view.getUint32(offset, true));
+        offset += 4;
+        for (let i = 0; i < removed.length; i++) {
+            removed[i] = [
+                view.getUint32(offset, true),
+                view.getUint32(offset + 4, true),
+                view.getUint8(offset + 8) !== 0
+            ];
+            offset += 9;
+        }
+        return { type: 'projectiles', tick, spawned, removed };
+    }
+
+    function decodeTerrain(view, offset) {
+        const width = view.getUint16(offset, true);
+        const height = view.getUint16(offset + 2, true);
+        const cellSize = view.getFloat32(offset + 4, true);
+        offset += 8;
+        const cells = [];
+        let index = 0;
+        for (let y = 0; y < height; y++) {
+            const row = new Array(width);
+            for (let x = 0; x < width; x++, index++) {
+                const byte = view.getUint8(offset + (index >> 2));
+                row[x] = (byte >> ((index & 3) * 2)) & 0x3;
+            }
+            cells.push(row);
+        }
+        return { width, height, cellSize, cells };
+    }
+
+    function decodeState(buffer) {
+        const view = new DataView(buffer);
+        let offset = 0;
+
+        const u8 = () => view.getUint8(offset++);
+        const i8 = () => view.getInt8(offset++);
+        const u16 = () => { const v = view.getUint16(offset, true); offset += 2; return v; };
+        const i16 = () => { const v = view.getInt16(offset, true); offset += 2; return v; };
+        const u32 = () => { const v = view.getUint32(offset, true); offset += 4; return v; };
+        const i32 = () => { const v = view.getInt32(offset, true); offset += 4; return v; };
+        const f32 = () => { const v = view.getFloat32(offset, true); offset += 4; return v; };
+
+        if (u8() !== MSG_STATE) {
+            throw new Error('Not a state message');
+        }
+        const version = u8();
+        if (version !== SCHEMA_VERSION) {
+            throw new Error(`Unsupported schema version ${version}`);
+        }
+
+        const flags = u8();
+        const state = {
+            gameState: GAME_STATES[u8()] || 'playing',
+            playerHealth: i32(),
+            playerResources: i32(),
+            currentWave: u16(),
+            maxWaves: u16(),
+            tick: u32(),
+            time: u32(),
+            objects: []
+        };
+
+        let quant = null;
+        if (flags & FLAG_QUANTIZED) {
+            quant = { minX: f32(), minY: f32(), maxX: f32(), maxY: f32(), maxSpeed: f32() };
+        }
+
+        const count = u32();
+        for (let i = 0; i < count; i++) {
+            const obj = { id: u32(), type: u8() };
+            const mask = u32();
+
+            if (quant) {
+                obj.position = {
+                    x: quant.minX + (u16() / 65535) * (quant.maxX - quant.minX),
+                    y: quant.minY + (u16() / 65535) * (quant.maxY - quant.minY)
+                };
+                obj.velocity = {
+                    x: (i16() / 32767) * quant.maxSpeed,
+                    y: (i16() / 32767) * quant.maxSpeed
+                };
+            } else {
+                obj.position = { x: f32(), y: f32() };
+                obj.velocity = { x: f32(), y: f32() };
+            }
+
+            // Payloads follow in field bit order
+            if (mask & FIELD.ENEMY_TYPE) obj.enemyType = u8();
+            if (mask & FIELD.TOWER_TYPE) obj.towerType = u8();
+            if (mask & FIELD.HEALTH) obj.health = f32();
+            if (mask & FIELD.MAX_HEALTH) obj.maxHealth = f32();
+            if (mask & FIELD.HAS_PATH) obj.hasPath = true;
+            if (mask & FIELD.PATH_LENGTH) obj.pathLength = u16();
+            if (mask & FIELD.IS_SLOWED) obj.isSlowed = true;
+            if (mask & FIELD.SLOW_FACTOR) obj.slowFactor = f32();
+            if (mask & FIELD.IS_BOSS) obj.isBoss = true;
+            if (mask & FIELD.RANGE) obj.range = f32();
+            if (mask & FIELD.DAMAGE) obj.damage = f32();
+            if (mask & FIELD.FIRE_RATE) obj.fireRate = f32();
+            if (mask & FIELD.UPGRADE_LEVEL) obj.upgradeLevel = u8();
+            if (mask & FIELD.UPGRADE_COST) obj.upgradeCost = i32();
+            if (mask & FIELD.SPLASH_RADIUS) obj.splashRadius = f32();
+            if (mask & FIELD.GRAVITY_STRENGTH) obj.gravityStrength = f32();
+            if (mask & FIELD.RADIUS) obj.radius = f32();
+            if (mask & FIELD.OWNER) obj.owner = i8();
+            if (mask & FIELD.SPEED) obj.speed = f32();
+
+            state.objects.push(obj);
+        }
+
+        if (flags & FLAG_PARTIAL) {
+            state.partial = true;
+        }
+
+        if (flags & FLAG_TERRAIN) {
+            state.terrain = decodeTerrain(view, offset);
+        }
+
+        return state;
+    }
+
+    return { SCHEMA_VERSION, decode, decodeState };
+})();
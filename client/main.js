@@ -23,6 +23,42 @@ const particleSystem = new ParticleSystem();
 let ws = null;
 let isConnected = false;
 
+// State encoding requested from the server (see binary-protocol.js).
+// The server answers with a 'protocol' message and falls back to JSON.
+const WIRE_PROTOCOL = {
+    binary: true,
+    quantize: true
+};
+
+// Channel rates requested from the server, in Hz. Terrain is only sent when
+// it changes. The server rounds rates to whole simulation ticks.
+const SUBSCRIPTIONS = {
+    objects: 20,
+    terrain: true,
+    stats: 1,
+    budget: 16384   // Max bytes per object snapshot, 0 for no limit
+};
+
+// Objects are drawn this far behind the newest snapshot, so there is
+// nearly always a snapshot on either side to interpolate between
+const INTERPOLATION_DELAY_MS = 100;
+
+// Recent tick-stamped snapshots, oldest first
+let snapshots = [];
+// Estimate of server time minus performance.now(), in ms
+let serverClockOffset = null;
+// Terrain from the last terrain message; state snapshots don't carry it
+let terrainState = null;
+// Latest message on the stats channel
+let serverStats = null;
+// Ids that left our viewport since the last snapshot; their disappearance
+// is not a death
+let leftInterest = new Set();
+// Commands sent but not yet reflected in a snapshot, by sequence number.
+// Tower placements are drawn as ghosts until then.
+let nextCommandSeq = 1;
+const pendingCommands = new Map();
+
 // Tower selection state
 let selectedTower = null;
 let buildMode = true; // true = placing towers, false = selecting towers
@@ -171,13 +207,12 @@ canvas.addEventListener('click', (event) => {
         buildMode = false;
         showTowerInfo(clickedTower);
     } else if (buildMode) {
-        // Build new tower
-        const message = {
+        // Build new tower, shown as a ghost until the server answers
+        sendCommand({
             action: 'build_tower',
             position: { x: x, y: y },
             towerType: selectedTowerType
-        };
-        ws.send(JSON.stringify(message));
+        }, { position: { x: x, y: y }, towerType: selectedTowerType });
     }
 });
 
@@ -227,11 +262,10 @@ function showTowerInfo(tower) {
 // Upgrade button handler
 upgradeBtn.addEventListener('click', () => {
     if (selectedTower && ws) {
-        const message = {
+        sendCommand({
             action: 'upgrade_tower',
             towerId: selectedTower.id
-        };
-        ws.send(JSON.stringify(message));
+        });
     }
 });
 
@@ -301,11 +335,31 @@ canvas.addEventListener('mousemove', (event) => {
 
 function connectToServer() {
     try {
-        ws = new WebSocket('ws://localhost:9002');
+        // ?match=N on the page joins match N of a multi-match server
+        const match = new URLSearchParams(window.location.search).get('match');
+        ws = new WebSocket(match !== null ? `ws://localhost:9002/match/${match}` : 'ws://localhost:9002');
+        ws.binaryType = 'arraybuffer';
 
         ws.onopen = () => {
             resetClientState();
+            if (WIRE_PROTOCOL.binary) {
+                ws.send(JSON.stringify({
+                    action: 'negotiate',
+                    protocol: 'binary',
+                    version: BinaryProtocol.SCHEMA_VERSION,
+                    quantize: WIRE_PROTOCOL.quantize
+                }));
+            }
+            ws.send(JSON.stringify({
+                action: 'subscribe',
+                objects: SUBSCRIPTIONS.objects,
+                terrain: SUBSCRIPTIONS.terrain,
+                stats: SUBSCRIPTIONS.stats,
+                budget: SUBSCRIPTIONS.budget
+            }));
             isConnected = true;
+            // Only objects on the canvas (plus a server-side margin) are sent
+            sendViewport(0, 0, canvas.width, canvas.height);
             statusSpan.textContent = 'Connected';
             statusSpan.className = 'connected';
             connectBtn.textContent = 'Disconnect';
@@ -314,13 +368,33 @@ function connectToServer() {
         
         ws.onmessage = (event) => {
             try {
-                const data = JSON.parse(event.data);
+                // Binary frames are state or terrain updates
+                const data = (event.data instanceof ArrayBuffer)
+                    ? BinaryProtocol.decode(event.data)
+                    : JSON.parse(event.data);
                 
                 // Handle different message types
                 if (data.type === 'welcome') {
-                    console.log('Server:', data.message);
+                    console.log('Server:', data.message, 'match', data.match);
+                } else if (data.type === 'protocol') {
+                    console.log('Server state protocol:', data.protocol);
+                } else if (data.type === 'subscribed') {
+                    console.log('Server channel rates:', data);
                 } else if (data.type === 'ack') {
-                    console.log('Action acknowledged:', data.original);
+                    handleAck(data);
+                } else if (data.type === 'terrain') {
+                    terrainState = data.terrain;
+                    gameState.terrain = terrainState;
+                } else if (data.type === 'stats') {
+                    serverStats = data;
+                } else if (data.type === 'interest') {
+                    data.left.forEach(id => leftInterest.add(id));
+                } else if (data.type === 'removed') {
+                    applyRemoved(data);
+                } else if (data.type === 'field') {
+                    Projectiles.applyField(data);
+                } else if (data.type === 'projectiles') {
+                    Projectiles.applyEvents(data);
                 } else {
                     // Assume it's a game state update
                     updateGameState(data);
@@ -347,6 +421,47 @@ function connectToServer() {
     }
 }
 
+// Game commands carry a sequence number that comes back in their ack
+function sendCommand(message, pending = {}) {
+    message.seq = nextCommandSeq++;
+    pendingCommands.set(message.seq, Object.assign({ action: message.action }, pending));
+    ws.send(JSON.stringify(message));
+}
+
+// An applied command stays pending until a snapshot from its tick or later
+// shows the result; anything else is rolled back at once
+function handleAck(ack) {
+    const pending = pendingCommands.get(ack.seq);
+    if (!pending) {
+        return;
+    }
+    if (ack.result === 'applied') {
+        pending.appliedTick = ack.tick !== undefined ? ack.tick : 0;
+        if (pending.action !== 'build_tower') {
+            pendingCommands.delete(ack.seq);
+        }
+        return;
+    }
+
+    pendingCommands.delete(ack.seq);
+    if (pending.action === 'build_tower') {
+        particleSystem.createFloatingText(pending.position.x, pending.position.y, "Can't build here", '#ff4444');
+    } else if (pending.action === 'special_ability') {
+        const ability = playerAbilities[pending.abilityName];
+        ability.cooldown = 0;
+        ability.ready = true;
+        particleSystem.createFloatingText(400, 300, 'Ability failed', '#ff4444');
+    } else {
+        particleSystem.createFloatingText(400, 300, 'Upgrade failed', '#ff4444');
+    }
+}
+
+function sendViewport(x, y, width, height) {
+    if (ws && isConnected) {
+        ws.send(JSON.stringify({ action: 'viewport', x, y, width, height }));
+    }
+}
+
 function disconnectFromServer() {
     if (ws) {
         ws.close();
@@ -355,9 +470,91 @@ function disconnectFromServer() {
     resetClientState();
 }
 
+function resetClientState() {
+    gameState = {
+        objects: [],
+        playerHealth: 100,
+        playerResources: 200,
+        currentWave: 0
+    };
+    previousGameState = {
+        objects: [],
+        playerResources: 200
+    };
+    selectedTower = null;
+    towerInfoPanel.classList.add('hidden');
+    snapshots = [];
+    serverClockOffset = null;
+    terrainState = null;
+    serverStats = null;
+    leftInterest.clear();
+    Projectiles.reset();
+    pendingCommands.clear();
+}
+
+// Budgeted clients are told reliably what to drop, ahead of the snapshot
+// it applies to
+function applyRemoved(message) {
+    const removed = new Set(message.ids);
+    gameState.objects = message.reset
+        ? []
+        : (gameState.objects || []).filter(obj => !removed.has(obj.id));
+}
+
+// A budgeted snapshot only carries the objects that were most due for an
+// update. The rest keep their last state, moved along their velocity.
+function mergePartialObjects(update) {
+    const updated = new Map(update.objects.map(obj => [obj.id, obj]));
+    const held = gameState.objects || [];
+    const dt = (gameState.time !== undefined && update.time !== undefined)
+        ? (update.time - gameState.time) / 1000
+        : 0;
+
+    const merged = [];
+    held.forEach(obj => {
+        const fresh = updated.get(obj.id);
+        if (fresh) {
+            merged.push(fresh);
+            updated.delete(obj.id);
+        } else {
+            merged.push(Object.assign({}, obj, {
+                position: {
+                    x: obj.position.x + obj.velocity.x * dt,
+                    y: obj.position.y + obj.velocity.y * dt
+                }
+            }));
+        }
+    });
+    updated.forEach(obj => merged.push(obj));
+    return merged;
+}
+
 function updateGameState(newState) {
+    // Older servers and the mock server send terrain with every state
+    if (newState.terrain) {
+        terrainState = newState.terrain;
+    }
+    newState.terrain = terrainState;
+
+    if (newState.partial) {
+        newState.objects = mergePartialObjects(newState);
+    }
+
+    if (newState.time !== undefined) {
+        bufferSnapshot(newState);
+    }
+
+    // Placements this snapshot already shows no longer need a ghost
+    pendingCommands.forEach((pending, seq) => {
+        if (pending.appliedTick !== undefined &&
+            (newState.tick === undefined || newState.tick >= pending.appliedTick)) {
+            pendingCommands.delete(seq);
+        }
+    });
+
     // Detect events and trigger particle effects
     detectGameEvents(gameState, newState);
+    leftInterest.clear();
 
     // Update state
     previousGameState = JSON.parse(JSON.stringify(gameState));
@@ -384,7 +581,9 @@ function updateGameState(newState) {
 
 function detectGameEvents(oldState, newState) {
     // Detect enemy deaths
-    const oldEnemies = oldState.objects ? oldState.objects.filter(obj => obj.type === 2) : [];
+    const oldEnemies = oldState.objects
+        ? oldState.objects.filter(obj => obj.type === 2 && !leftInterest.has(obj.id))
+        : [];
     const newEnemies = newState.objects ? newState.objects.filter(obj => obj.type === 2) : [];
 
     // Find enemies that were in old state but not in new state (died)
@@ -433,8 +632,11 @@ function detectGameEvents(oldState, newState) {
         }
     });
 
-    // Detect projectile hits
-    const oldProjectiles = oldState.objects ? oldState.objects.filter(obj => obj.type === 4) : [];
+    // Detect projectile hits (the mock server still sends projectiles in
+    // its state; the C++ server reports hits as events)
+    const oldProjectiles = oldState.objects
+        ? oldState.objects.filter(obj => obj.type === 4 && !leftInterest.has(obj.id))
+        : [];
     const newProjectiles = newState.objects ? newState.objects.filter(obj => obj.type === 4) : [];
 
     oldProjectiles.forEach(oldProj => {
@@ -496,6 +698,93 @@ function updateUI() {
     }
 }
 
+// Keep a tick-stamped snapshot for interpolation and update the server
+// clock estimate. The offset follows the least-delayed snapshot at once and
+// relaxes slowly when snapshots arrive late.
+function bufferSnapshot(state) {
+    const offset = state.time - performance.now();
+    if (serverClockOffset === null || offset > serverClockOffset) {
+        serverClockOffset = offset;
+    } else {
+        serverClockOffset += (offset - serverClockOffset) * 0.01;
+    }
+
+    const last = snapshots[snapshots.length - 1];
+    if (last && state.time <= last.time) {
+        // Server restarted or snapshot out of order; start over
+        snapshots = [];
+    }
+    state.byId = new Map(state.objects.map(obj => [obj.id, obj]));
+    snapshots.push(state);
+    if (snapshots.length > 32) {
+        snapshots.shift();
+    }
+}
+
+// Objects as they were INTERPOLATION_DELAY_MS ago in server time, blended
+// between the two snapshots around that moment. Falls back to the latest
+// state when snapshots are not tick-stamped.
+function getRenderObjects() {
+    if (snapshots.length === 0 || serverClockOffset === null) {
+        return gameState.objects || [];
+    }
+
+    const renderTime = performance.now() + serverClockOffset - INTERPOLATION_DELAY_MS;
+    while (snapshots.length > 2 && snapshots[1].time <= renderTime) {
+        snapshots.shift();
+    }
+
+    const from = snapshots[0];
+    const to = snapshots[1];
+    if (!to || renderTime <= from.time) {
+        return from.objects;
+    }
+    if (renderTime >= to.time) {
+        return to.objects;
+    }
+
+    const t = (renderTime - from.time) / (to.time - from.time);
+    return to.objects.map(obj => {
+        const prev = from.byId.get(obj.id);
+        if (!prev) {
+            return obj;  // Spawned between the two snapshots
+        }
+        return Object.assign({}, obj, {
+            position: {
+                x: prev.position.x + (obj.position.x - prev.position.x) * t,
+                y: prev.position.y + (obj.position.y - prev.position.y) * t
+            }
+        });
+    });
+}
+
+// Fractional server tick at the moment getRenderObjects() last drew, or
+// null before the first tick-stamped snapshot
+function getRenderTick() {
+    if (snapshots.length === 0 || serverClockOffset === null) {
+        return null;
+    }
+    const renderTime = performance.now() + serverClockOffset - INTERPOLATION_DELAY_MS;
+    const from = snapshots[0];
+    const to = snapshots[1];
+    if (!to || to.time <= from.time) {
+        return from.tick + (renderTime - from.time) * Projectiles.getTickRate() / 1000;
+    }
+    return from.tick + (renderTime - from.time) * (to.tick - from.tick) / (to.time - from.time);
+}
+
+// Projectiles aren't in snapshots; they are simulated locally from the
+// server's spawn and removal events, at the same moment as the objects
+function getRenderProjectiles() {
+    const renderTick = getRenderTick();
+    if (renderTick === null) {
+        return [];
+    }
+    return Projectiles.advance(renderTick, (x, y) => {
+        particleSystem.createHitSpark(x, y, '#ffff00', 8);
+    });
+}
+
 function render() {
     // Clear canvas
     ctx.fillStyle = '#001133';
@@ -551,7 +840,7 @@ function render() {
     
     // Draw game objects
     if (gameState.objects) {
-        gameState.objects.forEach(obj => {
+        getRenderObjects().concat(getRenderProjectiles()).forEach(obj => {
             let config = RENDER_CONFIG[obj.type];
             if (!config) return;
 
@@ -742,6 +1031,7 @@ function render() {
     }
 
     // Draw build preview
+    drawPendingTowers(ctx);
     drawBuildPreview(ctx);
 
     // Draw debug panel
@@ -792,11 +1082,10 @@ function activateAbility(abilityName) {
     ability.ready = false;
 
     // Send ability activation to server
-    const message = {
+    sendCommand({
         action: 'special_ability',
         abilityType: abilityName
-    };
-    ws.send(JSON.stringify(message));
+    }, { abilityName });
 
     // Client-side visual effects (optimistic)
     switch (abilityName) {
@@ -920,7 +1209,7 @@ function drawGravityField(ctx) {
 function drawDebugPanel(ctx) {
     // Semi-transparent background
     ctx.fillStyle = 'rgba(0, 0, 0, 0.7)';
-    ctx.fillRect(10, 10, 280, 200);
+    ctx.fillRect(10, 10, 280, 254);
 
     ctx.fillStyle = '#44ff44';
     ctx.font = 'bold 14px monospace';
@@ -956,6 +1245,17 @@ function drawDebugPanel(ctx) {
     ctx.fillText(`Score: ${gameStats.score}`, 20, y);
     y += lineHeight;
 
+    if (serverStats) {
+        ctx.fillText(`Server tick: ${serverStats.tick} @ ${serverStats.tickRate} Hz`, 20, y);
+        y += lineHeight;
+        ctx.fillText(`Server update: ${serverStats.updateMs.toFixed(2)} ms (match ${serverStats.match})`, 20, y);
+        y += lineHeight;
+        if (serverStats.rttP50Ms !== undefined) {
+            ctx.fillText(`RTT p50/p99: ${serverStats.rttP50Ms.toFixed(1)}/${serverStats.rttP99Ms.toFixed(1)} ms`, 20, y);
+            y += lineHeight;
+        }
+    }
+
     y += lineHeight * 0.5;
     ctx.fillStyle = '#44aaff';
     ctx.fillText('Toggles:', 20, y);
@@ -970,6 +1270,20 @@ function drawDebugPanel(ctx) {
 }
 
 // Draw build preview
+// Towers we asked for that no snapshot shows yet
+function drawPendingTowers(ctx) {
+    const config = RENDER_CONFIG[3];
+    pendingCommands.forEach(pending => {
+        if (pending.action !== 'build_tower') return;
+        ctx.beginPath();
+        ctx.arc(pending.position.x, pending.position.y, config.radius, 0, Math.PI * 2);
+        ctx.globalAlpha = 0.5;
+        ctx.fillStyle = TOWER_COLORS[pending.towerType] || config.color;
+        ctx.fill();
+        ctx.globalAlpha = 1.0;
+    });
+}
+
 function drawBuildPreview(ctx) {
     if (!buildPreview.visible) return;
 
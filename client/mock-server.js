@@ -16,6 +16,7 @@ class MockWebSocket {
             // Send welcome message
             this.simulateMessage({
                 type: 'welcome',
+                match: 0,
                 message: 'Connected to Mock Celestial Siege server'
             });
             
@@ -166,12 +167,8 @@ class MockWebSocket {
         try {
             const message = JSON.parse(data);
             if (message.action === 'build_tower') {
-                // Simulate tower placement
-                this.simulateMessage({
-                    type: 'ack',
-                    original: message
-                });
-                
+                let placedId = 0;
+
                 // Update game state
                 const towerType = message.towerType || 0;
                 const towerCosts = { 0: 50, 1: 75, 2: 60, 3: 100 };
@@ -200,8 +197,9 @@ class MockWebSocket {
                             
                             const config = towerConfigs[towerType] || towerConfigs[0];
                             
+                            placedId = Date.now();
                             this.gameState.objects.push({
-                                id: Date.now(),
+                                id: placedId,
                                 type: 3, // Tower
                                 towerType: towerType,
                                 position: message.position,
@@ -212,6 +210,16 @@ class MockWebSocket {
                         }
                     }
                 }
+
+                this.simulateMessage({
+                    type: 'ack',
+                    seq: message.seq,
+                    result: placedId ? 'applied' : 'rejected',
+                    id: placedId || undefined
+                });
+            } else if (message.seq !== undefined) {
+                // Other commands aren't simulated; acknowledge them anyway
+                this.simulateMessage({ type: 'ack', seq: message.seq, result: 'applied' });
             }
         } catch (e) {
             console.error('Error parsing message:', e);
@@ -0,0 +1,130 @@
+// Client side of projectile replication (see docs/PROTOCOL.md#projectiles).
+// The server only says when each projectile was fired and when it went
+// away. In between it is integrated here through the same static gravity
+// field, with the same arithmetic as PhysicsEngine::stepProjectiles and
+// PhysicsEngine::fieldAt, so it follows the server's path exactly.
+const Projectiles = (() => {
+    // Safety net for projectiles whose removal never arrives, e.g. after
+    // the game has ended; twice the server-side lifetime
+    const MAX_STEPS = 600;
+    // Old fields are kept so a late-arriving projectile still bends the
+    // way it did on the server
+    const MAX_FIELDS = 8;
+
+    let tickRate = 60;
+    let step = 1 / tickRate;
+    let fields = [];            // { tick, gravity, bodies: [[x, y, mass]] }, oldest first
+    const flying = new Map();   // id -> { tick, steps, x, y, vx, vy, removeTick, hit }
+
+    function reset() {
+        fields = [];
+        flying.clear();
+    }
+
+    // A field applies to every step that produces its tick or a later one
+    function applyField(message) {
+        tickRate = message.tickRate;
+        step = 1 / tickRate;
+        fields.push({ tick: message.tick, gravity: message.gravity, bodies: message.bodies });
+        fields.sort((a, b) => a.tick - b.tick);
+        if (fields.length > MAX_FIELDS) {
+            fields.shift();
+        }
+    }
+
+    function fieldFor(tick) {
+        let field = fields[0];
+        for (let i = 1; i < fields.length && fields[i].tick <= tick; i++) {
+            field = fields[i];
+        }
+        return field;
+    }
+
+    function applyEvents(message) {
+        message.spawned.forEach(([id, tick, x, y, vx, vy]) => {
+            // Projectiles in flight when we joined arrive twice; the first
+            // copy is already on the same path
+            if (!flying.has(id)) {
+                flying.set(id, { tick, steps: 0, x, y, vx, vy, removeTick: null, hit: false });
+            }
+        });
+        message.removed.forEach(([id, tick, hit]) => {
+            const projectile = flying.get(id);
+            if (projectile) {
+                projectile.removeTick = tick;
+                projectile.hit = hit;
+            }
+        });
+    }
+
+    // Keep the operation order identical to the server: doubles then give
+    // bit-identical results
+    function stepOnce(projectile) {
+        const field = fieldFor(projectile.tick + 1);
+        let ax = 0;
+        let ay = 0;
+        if (field) {
+            for (const [bx, by, mass] of field.bodies) {
+                const dx = bx - projectile.x;
+                const dy = by - projectile.y;
+                const distance = Math.sqrt(dx * dx + dy * dy);
+                let distanceSq = distance * distance;
+                if (distanceSq < 1) distanceSq = 1;
+                const magnitude = (field.gravity * mass) / distanceSq;
+                if (distance > 0) {
+                    ax += (dx / distance) * magnitude;
+                    ay += (dy / distance) * magnitude;
+                }
+            }
+        }
+        projectile.vx = projectile.vx + ax * step;
+        projectile.vy = projectile.vy + ay * step;
+        projectile.x = projectile.x + projectile.vx * step;
+        projectile.y = projectile.y + projectile.vy * step;
+        projectile.tick++;
+        projectile.steps++;
+    }
+
+    // Moves every projectile up to renderTick (fractional) and returns the
+    // ones in flight at that moment as render objects. onHit(x, y) is called
+    // for each projectile that hit something by then.
+    function advance(renderTick, onHit) {
+        const target = Math.floor(renderTick);
+        const objects = [];
+        flying.forEach((projectile, id) => {
+            const last = projectile.removeTick !== null ? Math.min(target, projectile.removeTick) : target;
+            while (projectile.tick < last && projectile.steps < MAX_STEPS) {
+                stepOnce(projectile);
+            }
+            if (projectile.removeTick !== null && renderTick >= projectile.removeTick) {
+                if (projectile.hit) {
+                    onHit(projectile.x, projectile.y);
+                }
+                flying.delete(id);
+                return;
+            }
+            if (projectile.steps >= MAX_STEPS) {
+                flying.delete(id);
+                return;
+            }
+            if (projectile.tick > renderTick) {
+                return;  // Not fired yet at this moment
+            }
+            // Drawn between this tick and the next
+            const t = (renderTick - projectile.tick) * step;
+            objects.push({
+                id,
+                type: 4,
+                position: { x: projectile.x + projectile.vx * t, y: projectile.y + projectile.vy * t },
+                velocity: { x: projectile.vx, y: projectile.vy }
+            });
+        });
+        return objects;
+    }
+
+    function getTickRate() {
+        return tickRate;
+    }
+
+    return { reset, applyField, applyEvents, advance, getTickRate };
+})();
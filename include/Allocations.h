@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Profiler.h"
+#include <array>
+#include <cstdint>
+
+// Heap allocations made through operator new on every thread since startup.
+// Linking this in replaces the global operator new and delete, aligned forms
+// included, with counting versions. Threads count into separate stripes, so allocating on many
+// threads at once doesn't contend on one cache line; reading sums them.
+//
+// While the profiler is on, allocations are also counted against the
+// innermost phase running on the allocating thread (see Profiler.h), so a
+// tick's allocations can be told apart by phase.
+class Allocations {
+public:
+    struct Counts {
+        uint64_t count = 0;
+        uint64_t bytes = 0;
+    };
+    // Made inside each phase, not counting the phases within it
+    using ByPhase = std::array<Counts, PHASE_COUNT>;
+
+    static uint64_t count();
+    static uint64_t bytes();
+    static ByPhase byPhase();
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "EntityState.h"
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+class CellularAutomata;
+
+// Appends little-endian primitives to a byte buffer
+class BinaryWriter {
+public:
+    explicit BinaryWriter(std::string& out) : m_out(out) {}
+
+    void writeU8(uint8_t v) { m_out.push_back(static_cast<char>(v)); }
+    void writeU16(uint16_t v) {
+        writeU8(static_cast<uint8_t>(v));
+        writeU8(static_cast<uint8_t>(v >> 8));
+    }
+    void writeU32(uint32_t v) {
+        writeU16(static_cast<uint16_t>(v));
+        writeU16(static_cast<uint16_t>(v >> 16));
+    }
+    void writeI16(int16_t v) { writeU16(static_cast<uint16_t>(v)); }
+    void writeI32(int32_t v) { writeU32(static_cast<uint32_t>(v)); }
+    void writeF32(float v) {
+        uint32_t bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        writeU32(bits);
+    }
+    void writeF64(double v) {
+        uint64_t bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        writeU32(static_cast<uint32_t>(bits));
+        writeU32(static_cast<uint32_t>(bits >> 32));
+    }
+
+    size_t size() const { return m_out.size(); }
+
+private:
+    std::string& m_out;
+};
+
+// Binary alternative to the JSON state broadcast. Layout (schema v3, all
+// numbers little-endian):
+//
+//   u8  messageType (MSG_STATE)      u8  schemaVersion
+//   u8  flags (FLAG_*)               u8  gameState
+//   i32 playerHealth                 i32 playerResources
+//   u16 currentWave                  u16 maxWaves
+//   u32 tick                         u32 time (ms)
+//   [FLAG_QUANTIZED] f32 minX, minY, maxX, maxY, maxSpeed
+//   u32 objectCount, then per object:
+//       u32 id, u8 type, u32 fieldMask (EntityField bits)
+//       position + velocity: u16/i16 fixed point if quantized, else f32
+//       present fields in bit order; flag-only fields carry no payload
+//   FLAG_PARTIAL marks a budgeted snapshot: objects not listed keep their
+//       last state. Removals go out separately (JsonProtocol::encodeRemoved).
+//   [FLAG_TERRAIN] u16 width, u16 height, f32 cellSize,
+//       ceil(width * height / 4) bytes of 2-bit cells, row-major, low bits first
+//
+// A terrain message (MSG_TERRAIN) is u8 messageType, u8 schemaVersion,
+// u32 tick, followed by the same terrain block.
+//
+// A projectile message (MSG_PROJECTILES) is u8 messageType, u8 schemaVersion,
+// u32 tick, then u32 spawnCount spawns (u32 id, u32 tick, f64 x, y, vx, vy)
+// and u32 removalCount removals (u32 id, u32 tick, u8 hit). Spawn states are
+// f64 so clients can integrate exactly what the server does.
+//
+// client/binary-protocol.js is the matching decoder and must be updated
+// together with this file.
+class BinaryProtocol {
+public:
+    static constexpr uint8_t SCHEMA_VERSION = 3;
+    static constexpr uint8_t MSG_STATE = 1;
+    static constexpr uint8_t MSG_TERRAIN = 2;
+    static constexpr uint8_t MSG_PROJECTILES = 3;
+
+    static constexpr uint8_t FLAG_QUANTIZED = 1 << 0;
+    static constexpr uint8_t FLAG_TERRAIN = 1 << 1;
+    static constexpr uint8_t FLAG_PARTIAL = 1 << 2;
+
+    // Quantized positions are 16-bit fixed point over the map bounds and
+    // velocities are signed 16-bit over [-maxSpeed, maxSpeed]. Values outside
+    // the range are clamped.
+    struct Quantization {
+        double minX = 0;
+        double minY = 0;
+        double maxX = 800;
+        double maxY = 600;
+        double maxSpeed = 2048;
+    };
+
+    // Encode one state frame into out (cleared first). Pass a null
+    // quantization for f32 positions, a null terrain to omit the grid, and
+    // partial for budgeted snapshots.
+    static void encodeState(std::string& out,
+                            const StateHeader& header,
+                            const std::vector<EntityState>& entities,
+                            const CellularAutomata* terrain,
+                            const Quantization* quantization,
+                            bool partial = false);
+
+    // Bytes one object adds to a state frame
+    static size_t entitySize(const EntityState& entity, const Quantization* quantization);
+
+    static void encodeTerrainMessage(std::string& out, uint32_t tick,
+                                     const CellularAutomata& terrain);
+
+    static void encodeProjectileEvents(std::string& out, uint32_t tick,
+                                       const std::vector<ProjectileSpawn>& spawns,
+                                       const std::vector<ProjectileRemoval>& removals);
+
+private:
+    static void encodeEntity(BinaryWriter& writer, const EntityState& entity,
+                             const Quantization* quantization);
+    static void encodeTerrain(BinaryWriter& writer, const CellularAutomata& terrain);
+};
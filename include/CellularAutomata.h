@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Vec2d.h"
+#include <cstdint>
 #include <vector>
 #include <random>
 
@@ -15,11 +16,15 @@ class CellularAutomata {
 public:
     CellularAutomata(int width, int height, double cellSize = 20.0);
     
+    // Reseeds the generator initialize() draws from; by default every
+    // automaton starts from a random seed
+    void seed(uint32_t seed) { m_rng.seed(seed); }
+
     // Initialize the grid with random seed pattern
     void initialize(double density = 0.45);
     
-    // Run one generation of Game of Life rules
-    void update();
+    // Run one generation of Game of Life rules. Returns true if any cell changed.
+    bool update();
     
     // Check if a position is buildable (has stardust)
     bool isBuildable(const Vec2d& worldPos) const;
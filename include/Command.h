@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Vec2d.h"
+#include <cstdint>
+
+class JsonValue;
+
+enum class CommandType : uint8_t {
+    BuildTower,
+    UpgradeTower,
+    SpecialAbility
+};
+
+enum class AbilityType : uint8_t {
+    MeteorStrike,
+    FreezeWave,
+    Repair
+};
+
+// A validated player action. Commands are decoded from client JSON on the
+// network thread and applied by GameWorld on the simulation thread, so they
+// carry plain values only - no views into the message they came from.
+struct Command {
+    // The map GameWorld's terrain covers; BuildTower positions outside it
+    // are rejected by decode()
+    static constexpr double MAP_WIDTH = 800.0;
+    static constexpr double MAP_HEIGHT = 600.0;
+
+    CommandType type = CommandType::BuildTower;
+    int clientId = 0;
+    uint32_t seq = 0;       // Client's sequence number, echoed in the ack; 0 if none
+    Vec2d position;         // BuildTower
+    int towerType = 0;      // BuildTower
+    int towerId = 0;        // UpgradeTower
+    AbilityType ability = AbilityType::MeteorStrike;  // SpecialAbility
+
+    // Fills out from a client message. Returns false (after logging why)
+    // for messages that aren't game commands or are malformed; clientId and
+    // seq are filled in either way.
+    static bool decode(const JsonValue& msg, int clientId, Command& out);
+};
+
+// What happened to a command, as reported in its ack
+enum class CommandResult : uint8_t {
+    Applied,    // Took effect on the tick in the ack
+    Rejected,   // Valid, but not allowed (resources, placement, game over)
+    Invalid,    // Not a command the game understands
+    Dropped     // The command queue was full
+};
+
@@ -104,20 +104,36 @@ public:
         std::cout << "Enemy at (" << position.x << ", " << position.y << ") with " << health << "/" << maxHealth << " HP" << std::endl;
     }
     
-    json toJson() const override {
-        json j = GameObject::toJson();
-        j["health"] = health;
-        j["maxHealth"] = maxHealth;
-        // Optionally add path visualization data
+    void captureState(EntityState& state) const override {
+        GameObject::captureState(state);
+        state.health = health;
+        state.maxHealth = maxHealth;
+        state.set(FIELD_HEALTH);
+        state.set(FIELD_MAX_HEALTH);
         if (!m_path.empty()) {
-            j["hasPath"] = true;
-            j["pathLength"] = static_cast<int>(m_path.size());
+            state.pathLength = static_cast<int>(m_path.size());
+            state.set(FIELD_HAS_PATH);
+            state.set(FIELD_PATH_LENGTH);
         }
-        // Add slow effect visualization
         if (m_slowDuration > 0) {
-            j["isSlowed"] = true;
-            j["slowFactor"] = m_slowFactor;
+            state.slowFactor = m_slowFactor;
+            state.set(FIELD_IS_SLOWED);
+            state.set(FIELD_SLOW_FACTOR);
         }
-        return j;
+    }
+
+    void hashState(StateHash& hash) const override {
+        GameObject::hashState(hash);
+        hash.add(health);
+        hash.add(maxHealth);
+        hash.add(speed);
+        hash.add(reward);
+        hash.add(m_path);
+        hash.add(static_cast<uint64_t>(m_currentPathIndex));
+        hash.add(m_targetPosition);
+        hash.add(m_pathRecalculateTimer);
+        hash.add(m_slowFactor);
+        hash.add(m_slowDuration);
+        hash.add(m_baseSpeed);
     }
 };
\ No newline at end of file
@@ -18,10 +18,10 @@ public:
         m_enemyType = EnemyType::Basic;
     }
 
-    json toJson() const override {
-        json j = Enemy::toJson();
-        j["enemyType"] = static_cast<int>(m_enemyType);
-        return j;
+    void captureState(EntityState& state) const override {
+        Enemy::captureState(state);
+        state.enemyType = static_cast<int>(m_enemyType);
+        state.set(FIELD_ENEMY_TYPE);
     }
 
 protected:
@@ -37,10 +37,10 @@ public:
         mass = 3.0;  // Lighter, less affected by gravity
     }
 
-    json toJson() const override {
-        json j = Enemy::toJson();
-        j["enemyType"] = static_cast<int>(m_enemyType);
-        return j;
+    void captureState(EntityState& state) const override {
+        Enemy::captureState(state);
+        state.enemyType = static_cast<int>(m_enemyType);
+        state.set(FIELD_ENEMY_TYPE);
     }
 
 protected:
@@ -56,10 +56,10 @@ public:
         mass = 15.0;  // Heavier, more affected by gravity
     }
 
-    json toJson() const override {
-        json j = Enemy::toJson();
-        j["enemyType"] = static_cast<int>(m_enemyType);
-        return j;
+    void captureState(EntityState& state) const override {
+        Enemy::captureState(state);
+        state.enemyType = static_cast<int>(m_enemyType);
+        state.set(FIELD_ENEMY_TYPE);
     }
 
 protected:
@@ -75,11 +75,11 @@ public:
         mass = 25.0;  // Very heavy
     }
 
-    json toJson() const override {
-        json j = Enemy::toJson();
-        j["enemyType"] = static_cast<int>(m_enemyType);
-        j["isBoss"] = true;
-        return j;
+    void captureState(EntityState& state) const override {
+        Enemy::captureState(state);
+        state.enemyType = static_cast<int>(m_enemyType);
+        state.set(FIELD_ENEMY_TYPE);
+        state.set(FIELD_IS_BOSS);
     }
 
 protected:
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Vec2d.h"
+#include <cstdint>
+#include <vector>
+
+// Optional per-object fields. The bit positions are also the presence mask of
+// the binary wire protocol, so never reorder them - append new fields instead
+// and bump BinaryProtocol::SCHEMA_VERSION.
+enum EntityField : uint32_t {
+    FIELD_ENEMY_TYPE       = 1u << 0,
+    FIELD_TOWER_TYPE       = 1u << 1,
+    FIELD_HEALTH           = 1u << 2,
+    FIELD_MAX_HEALTH       = 1u << 3,
+    FIELD_HAS_PATH         = 1u << 4,   // flag only, no payload
+    FIELD_PATH_LENGTH      = 1u << 5,
+    FIELD_IS_SLOWED        = 1u << 6,   // flag only, no payload
+    FIELD_SLOW_FACTOR      = 1u << 7,
+    FIELD_IS_BOSS          = 1u << 8,   // flag only, no payload
+    FIELD_RANGE            = 1u << 9,
+    FIELD_DAMAGE           = 1u << 10,
+    FIELD_FIRE_RATE        = 1u << 11,
+    FIELD_UPGRADE_LEVEL    = 1u << 12,
+    FIELD_UPGRADE_COST     = 1u << 13,
+    FIELD_SPLASH_RADIUS    = 1u << 14,
+    FIELD_GRAVITY_STRENGTH = 1u << 15,
+    FIELD_RADIUS           = 1u << 16,
+    FIELD_OWNER            = 1u << 17,
+    FIELD_SPEED            = 1u << 18
+};
+
+// Flat copy of everything a client is told about one object. Objects fill it
+// in through GameObject::captureState; the wire encoders only read it.
+struct EntityState {
+    uint32_t fields = 0;  // EntityField presence bits
+    int id = 0;
+    int type = 0;
+    Vec2d position;
+    Vec2d velocity;
+
+    double health = 0;
+    double maxHealth = 0;
+    double slowFactor = 0;
+    double range = 0;
+    double damage = 0;
+    double fireRate = 0;
+    double splashRadius = 0;
+    double gravityStrength = 0;
+    double radius = 0;
+    double speed = 0;
+    int pathLength = 0;
+    int enemyType = 0;
+    int towerType = 0;
+    int upgradeLevel = 0;
+    int upgradeCost = 0;
+    int owner = 0;
+
+    void set(EntityField field) { fields |= field; }
+    bool has(EntityField field) const { return (fields & field) != 0; }
+};
+
+// Header values that are not per-object
+struct StateHeader {
+    uint32_t tick = 0;      // Simulation tick the snapshot was taken on
+    uint32_t time = 0;      // Simulated time at that tick, in milliseconds
+    int playerHealth = 0;
+    int playerResources = 0;
+    int currentWave = 0;
+    int maxWaves = 0;
+    uint8_t gameState = 0;  // 0 = playing, 1 = victory, 2 = gameOver
+};
+
+// Projectiles are not part of snapshots. Clients are told when one is fired
+// and when it goes away, and integrate it through the static gravity field
+// in between (see PhysicsEngine::stepProjectiles).
+struct ProjectileSpawn {
+    int id = 0;
+    uint32_t tick = 0;   // First tick the projectile exists on, at this state
+    Vec2d position;
+    Vec2d velocity;
+};
+
+struct ProjectileRemoval {
+    int id = 0;
+    uint32_t tick = 0;   // Tick the projectile was removed on
+    bool hit = false;    // Hit an enemy, as opposed to running out of lifetime
+};
@@ -1,10 +1,9 @@
 #pragma once
 
 #include "Vec2d.h"
+#include "EntityState.h"
+#include "StateHash.h"
 #include <memory>
-#include "../libs/nlohmann/json.hpp"
-
-using json = nlohmann::json;
 
 enum class GameObjectType {
     Planet = 1,
@@ -15,7 +14,9 @@ enum class GameObjectType {
 
 class GameObject {
 public:
-    static int next_id;
+    // Per thread, so matches ticking on different threads never share it;
+    // see ObjectIdScope
+    static thread_local int next_id;
     int id;
     GameObjectType type;
     Vec2d position;
@@ -41,21 +42,45 @@ public:
         return (position - other.position).length();
     }
     
-    virtual json toJson() const {
-        json j;
-        j["id"] = id;
-        j["type"] = static_cast<int>(type);
-        j["position"] = json{{"x", position.x}, {"y", position.y}};
-        j["velocity"] = json{{"x", velocity.x}, {"y", velocity.y}};
-        return j;
+    // Copy what clients need into a flat EntityState; the wire encoders
+    // (JsonProtocol, BinaryProtocol) serialize from that
+    virtual void captureState(EntityState& state) const {
+        state = EntityState();
+        state.id = id;
+        state.type = static_cast<int>(type);
+        state.position = position;
+        state.velocity = velocity;
+    }
+
+    // Add everything the next tick reads from this object; derived types
+    // add their own members after the base's
+    virtual void hashState(StateHash& hash) const {
+        hash.add(id);
+        hash.add(type);
+        hash.add(position);
+        hash.add(velocity);
+        hash.add(mass);
+        hash.add(alive);
+        hash.add(isStatic);
     }
 };
 
-// JSON serialization helpers
-inline void to_json(json& j, const Vec2d& v) {
-    j = json{{"x", v.x}, {"y", v.y}};
-}
+// Numbers the objects created on this thread from a match's own counter for
+// as long as the scope lives, wherever that match happens to be ticking
+class ObjectIdScope {
+public:
+    explicit ObjectIdScope(int& counter) : m_counter(counter), m_saved(GameObject::next_id) {
+        GameObject::next_id = counter;
+    }
+    ~ObjectIdScope() {
+        m_counter = GameObject::next_id;
+        GameObject::next_id = m_saved;
+    }
+
+    ObjectIdScope(const ObjectIdScope&) = delete;
+    ObjectIdScope& operator=(const ObjectIdScope&) = delete;
 
-inline void to_json(json& j, const GameObject& obj) {
-    j = obj.toJson();
-}
\ No newline at end of file
+private:
+    int& m_counter;
+    int m_saved;
+};
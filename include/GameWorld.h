@@ -11,11 +11,21 @@
 #include "PhysicsEngine.h"
 #include "CellularAutomata.h"
 #include "PathfindingSystem.h"
+#include "BinaryProtocol.h"
+#include "JsonProtocol.h"
+#include "Command.h"
+#include "MpscQueue.h"
+#include "SpatialGrid.h"
+#include "JobSystem.h"
+#include "InputLog.h"
+#include "StressScenario.h"
 #include <vector>
 #include <memory>
 #include <algorithm>
+#include <atomic>
+#include <map>
+#include <unordered_map>
 #include <chrono>
-#include <thread>
 
 enum class GameState {
     Playing,
@@ -23,6 +33,35 @@ enum class GameState {
     GameOver
 };
 
+// Everything clients are sent for one tick, copied out of the world at the
+// end of the tick. GameWorld keeps two: the tick fills one while the other is
+// encoded and sent, possibly on another thread (see publishSnapshot()).
+struct WorldSnapshot {
+    explicit WorldSnapshot(const CellularAutomata& terrain) : terrain(terrain) {}
+
+    bool ready = false;         // Captured and not yet published
+    bool hasClients = false;    // The match had clients; nothing else is filled in otherwise
+    StateHeader header;
+    std::vector<EntityState> entities;
+    Vec2d base;                 // Player's planet, for send priorities
+    size_t objectCount = 0;
+    double updateMs = 0;
+    double tickMs = 0;
+    // Terrain and field are copied only when they changed since this
+    // snapshot last held them
+    bool terrainChanged = false;
+    uint32_t terrainVersion = 0;
+    CellularAutomata terrain;
+    bool fieldChanged = false;
+    uint32_t fieldVersion = 0;
+    std::vector<FieldBody> field;
+    // Projectile events, only on ticks they are flushed, and every
+    // projectile in flight for joining clients
+    std::vector<ProjectileSpawn> projectileSpawns;
+    std::vector<ProjectileRemoval> projectileRemovals;
+    std::vector<ProjectileSpawn> inFlight;
+};
+
 class GameWorld {
 private:
     std::vector<std::unique_ptr<GameObject>> m_objects;
@@ -30,43 +69,176 @@ private:
     int m_playerResources;
     double m_waveTimer;
     int m_currentWave;
-    bool m_running;
     GameState m_gameState;
     WebSocketServer m_webSocketServer;
+    // Shared with every match in the process; the tick's phases run as a
+    // graph on it and split their loops over objects into parallel chunks
+    JobSystem& m_jobs;
+    TaskGraph m_tickGraph;
+    double m_tickDelta;         // deltaTime of the tick m_tickGraph is running
+    std::vector<int> m_candidates;  // Per object: tower target or projectile hit, -1 for none
     PhysicsEngine m_physicsEngine;
     CellularAutomata m_cellularAutomata;
     double m_cellularUpdateTimer;
     PathfindingSystem m_pathfinding;
+    // m_back is filled by tick(), m_front is encoded by publishSnapshot()
+    std::unique_ptr<WorldSnapshot> m_back;
+    std::unique_ptr<WorldSnapshot> m_front;
+    // Encode buffers of publishSnapshot(); acks are encoded during the tick
+    std::string m_jsonBuffer;
+    std::string m_binaryBuffer;
+    std::string m_ackBuffer;
+    // Client commands, pushed by the network thread and drained each tick
+    MpscQueue<Command, 256> m_commands;
+    std::atomic<uint64_t> m_droppedCommands{0};
+    std::unique_ptr<InputRecorder> m_recorder;    // Null unless the match is recorded
+    std::unique_ptr<StressScenario> m_stress;     // Null unless the match is stressed
+    bool m_obstaclesDirty;
+    uint32_t m_tick;            // Simulation ticks since the match started
+    double m_simTime;           // Simulated seconds since the match started
+    bool m_terrainChanged;      // Set when the automaton changes, cleared once captured
+    uint32_t m_terrainVersion;  // Bumped on every terrain change
+    double m_updateMs;          // Smoothed cost of update(), reported on the stats channel
+    double m_tickMs;            // Smoothed cost of a whole tick, snapshot capture included
+    double m_publishMs;         // Smoothed cost of publishSnapshot()
+    int m_lingerTicks;          // Ticks the final state is still sent after the game ends
+    int m_nextObjectId;         // This match's object ids, see ObjectIdScope
+    bool m_fieldChanged;        // The projectile field changed, cleared once captured
+    uint32_t m_fieldVersion;    // Bumped on every field change
+    // Projectile events since the last flush, sent with the default snapshot rate
+    std::vector<ProjectileSpawn> m_projectileSpawns;
+    std::vector<ProjectileRemoval> m_projectileRemovals;
+    std::vector<ProjectileRemoval> m_noRemovals;
+    // Per-client snapshots for clients with a viewport or byte budget. The
+    // entity index is rebuilt once per snapshot. Only publishSnapshot()
+    // touches these.
+    struct ClientView {
+        std::vector<int> visibleIds;  // Viewport contents last tick, for enter/leave
+        std::vector<int> knownIds;    // Objects sent to the client and not removed (budgeted clients)
+        std::unordered_map<int, double> priority;  // Accumulated send priority per object
+        bool synced = false;          // The reset has been sent
+    };
+    SpatialGrid m_spatialGrid;
+    std::map<int, ClientView> m_clientViews;
+    std::vector<EntityState> m_culledStates;
+    std::vector<EntityState> m_selectedStates;
+    std::vector<std::pair<double, uint32_t>> m_ranked;
+    std::vector<uint32_t> m_queryIndices;
+    std::vector<int> m_worldIds;
+    std::vector<int> m_visibleIds;
+    std::vector<int> m_enteredIds;
+    std::vector<int> m_leftIds;
+    std::vector<int> m_removedIds;
+    std::vector<int> m_mergedIds;
+    std::vector<uint32_t> m_selectedIndices;
+    std::vector<int> m_departedClients;
 
 public:
     static const int MAX_WAVES = 15;  // Victory condition
+    static constexpr int SIM_RATE = 60;       // Simulation ticks per second
+    static constexpr int SNAPSHOT_RATE = 20;  // Default object snapshots per second
+    static constexpr double INTEREST_MARGIN = 64.0;  // World units added around each viewport
+    static constexpr size_t RESERVED_OBJECTS = 512;  // Room the per-tick buffers start with
 
-    GameWorld()
+    // The match's clients connect through server, and its work runs on
+    // jobs; both are shared with every other match in the process
+    GameWorld(websocket::Server& server, JobSystem& jobs, int matchId)
         : m_playerHealth(100), m_playerResources(200),
-          m_waveTimer(0), m_currentWave(0), m_running(false),
+          m_waveTimer(0), m_currentWave(0),
           m_gameState(GameState::Playing),
+          m_webSocketServer(server, matchId), m_jobs(jobs), m_tickDelta(0),
           m_cellularAutomata(80, 60, 10.0), m_cellularUpdateTimer(0),
-          m_pathfinding(80, 60, 10.0) {}
+          m_pathfinding(80, 60, 10.0), m_obstaclesDirty(false),
+          m_tick(0), m_simTime(0), m_terrainChanged(false), m_terrainVersion(1), m_updateMs(0),
+          m_tickMs(0), m_publishMs(0), m_lingerTicks(3 * SIM_RATE), m_nextObjectId(1),
+          m_fieldChanged(false), m_fieldVersion(1),
+          m_spatialGrid(800.0, 600.0, 50.0) {}
     
+    // Fixes the terrain the match starts with; call before init(). Unseeded
+    // matches get a random one.
+    void seed(uint32_t seed) { m_cellularAutomata.seed(seed); }
     void init();
-    void run();
+    // Logs every command the match applies from now on, for replaying it
+    // later; call before the first tick
+    void record(std::unique_ptr<InputRecorder> recorder) { m_recorder = std::move(recorder); }
+    // Adds synthetic load at the start of every tick from now on. The load
+    // isn't part of an input log, so a stressed match can't be replayed.
+    void stress(std::unique_ptr<StressScenario> scenario) { m_stress = std::move(scenario); }
+    // Hash of the simulation state - the world's counters and timers, every
+    // object's hashState() and the terrain - equal across runs and builds
+    // exactly when the simulations are
+    uint64_t stateHash() const;
+    // Advances the match by one tick and captures what clients are due into
+    // the back snapshot. Returns false once the game has ended and its final
+    // state has been shown for a few seconds. Only one thread may tick a
+    // match at a time.
+    bool tick(double deltaTime);
+    // Makes the last captured snapshot the one publishSnapshot() sends. Call
+    // between tick() and publishSnapshot(), with neither running, once per
+    // tick.
+    void swapSnapshots() { std::swap(m_back, m_front); }
+    // Encodes and sends the front snapshot. May run on another thread at the
+    // same time as the next tick(), but not at the same time as itself.
+    void publishSnapshot();
     void update(double deltaTime);
     void spawnWave();
+    void fireTowers();
     void handleCollisions();
     void cleanupDeadObjects();
     
+    // Queues a command for the start of the next tick, as if a client had
+    // sent it. Safe from any thread. False if the queue is full. Commands
+    // with clientId 0 are not acknowledged.
+    bool submitCommand(const Command& command) { return m_commands.tryPush(command); }
+
     bool placeTower(Vec2d position, int towerType);
     bool upgradeTower(int towerId);
     void spawnEnemy(Vec2d position);
     void spawnProjectile(Vec2d from, Vec2d to, double damage);
+    // Puts an object straight into the world, skipping costs and placement
+    // rules, for tools and StressScenario. Ids come from the calling
+    // thread's counter, which is the match's only during tick().
+    void addObject(std::unique_ptr<GameObject> object);
+    // Skips the game rules like addObject()
+    void setPlayerHealth(int health) { m_playerHealth = health; }
     
     const std::vector<std::unique_ptr<GameObject>>& getObjects() const { return m_objects; }
     int getPlayerHealth() const { return m_playerHealth; }
     int getPlayerResources() const { return m_playerResources; }
+    int getCurrentWave() const { return m_currentWave; }
+    GameState getGameState() const { return m_gameState; }
+    uint32_t getTick() const { return m_tick; }
+    int getMatchId() const { return m_webSocketServer.matchId(); }
+    double getTickMs() const { return m_tickMs; }
+    WebSocketServer& getWebSocketServer() { return m_webSocketServer; }
+    const CellularAutomata& getTerrain() const { return m_cellularAutomata; }
     
-    json getStateAsJson() const;
+    // State capture shared by the JSON and binary encoders
+    void captureEntityStates(std::vector<EntityState>& out) const;
+    StateHeader getStateHeader() const;
+    BinaryProtocol::Quantization getQuantization() const;
     
 private:
-    void handleClientMessage(const std::string& message);
-    void activateSpecialAbility(const std::string& abilityType);
+    void buildTickGraph();
+    void steerEnemies();
+    // Index of the nearest living enemy in range among the first count
+    // objects, or -1
+    int nearestEnemy(const Tower& tower, size_t count) const;
+    // Index of the first living enemy the projectile touches, from the
+    // given index on, or -1
+    int firstHit(const Projectile& projectile, size_t from) const;
+    void captureSnapshot(WorldSnapshot& snapshot);
+    void broadcastProjectiles(const WorldSnapshot& snapshot);
+    void broadcastObjects(const WorldSnapshot& snapshot);
+    void sendDedicatedObjects(const WorldSnapshot& snapshot);
+    void selectWithinBudget(const WorldSnapshot& snapshot, const SnapshotClient& client,
+                            ClientView& view, const std::vector<EntityState>& candidates);
+    double sendPriority(const EntityState& entity, const Vec2d& focus, const Vec2d& base) const;
+    void broadcastTerrain(const WorldSnapshot& snapshot);
+    void broadcastStats(const WorldSnapshot& snapshot);
+    void enqueueClientMessage(int clientId, const JsonValue& msg);
+    void processCommands();
+    void applyCommand(const Command& command);
+    void sendAck(const Command& command, CommandResult result, int objectId);
+    bool activateSpecialAbility(AbilityType abilityType);
 };
\ No newline at end of file
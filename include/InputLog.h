@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Command.h"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// The input of one match: the seed its terrain started from and every
+// command in the tick it was applied on. Nothing else feeds the simulation,
+// so replaying the commands on a world with the same seed plays the match
+// again bit for bit. A hash of every value the next tick reads (see
+// GameWorld::stateHash() and GameObject::hashState()) is logged once a
+// simulated second, so a replay can tell where it diverged.
+//
+// Logs are JSON lines, one entry per line:
+//   {"matchId":0,"seed":S,"type":"match","version":1}
+//   {"ability":0,"client":3,"command":0,"seq":7,"tick":120,"towerId":0,"towerType":1,"type":"command","x":412.5,"y":300}
+//   {"hash":"<16 hex digits>","tick":180,"type":"check"}
+//   {"hash":"<16 hex digits>","tick":1486,"type":"end"}
+// The end entry is only there if the game was decided before recording
+// stopped.
+class InputRecorder {
+public:
+    // Throws std::runtime_error if the file can't be created
+    InputRecorder(const std::string& path, uint32_t seed, int matchId);
+
+    void command(uint32_t tick, const Command& command);
+    void checkpoint(uint32_t tick, uint64_t stateHash);
+    void end(uint32_t tick, uint64_t stateHash);
+
+private:
+    void writeHash(const char* type, uint32_t tick, uint64_t stateHash);
+
+    std::ofstream m_out;
+    std::string m_line;
+};
+
+struct InputLog {
+    struct Entry {
+        uint32_t tick = 0;      // Applied at the start of this tick
+        Command command;
+    };
+    struct Checkpoint {
+        uint32_t tick = 0;
+        uint64_t hash = 0;      // GameWorld::stateHash() after the tick
+    };
+
+    uint32_t seed = 0;
+    int matchId = 0;
+    std::vector<Entry> commands;
+    std::vector<Checkpoint> checkpoints;    // The end entry included
+    uint32_t endTick = 0;                   // 0 if the recording stopped mid-game
+
+    // Last tick the recording says anything about
+    uint32_t lastTick() const;
+
+    // Throws std::runtime_error if the file can't be read or isn't a log
+    static InputLog load(const std::string& path);
+};
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+
+// Jobs started together and waited for together: the chunks of one
+// parallelFor or the tasks of one graph run. The first exception any of them
+// throws is kept and rethrown to the thread that waits for the group.
+struct JobGroup {
+    explicit JobGroup(size_t jobs) : pending(jobs) {}
+
+    void fail(std::exception_ptr exception) {
+        if (!failed.exchange(true, std::memory_order_acq_rel)) {
+            error = exception;
+        }
+    }
+
+    std::atomic<size_t> pending;        // Jobs not yet done
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;           // Written once, before its job counts as done
+};
+
+// Tasks with dependencies, built once and run as often as needed, e.g. the
+// phases of every tick. A task starts once all tasks it depends on are done;
+// tasks with nothing between them may run at the same time.
+class TaskGraph {
+public:
+    using TaskId = size_t;
+
+    TaskId add(std::function<void()> task);
+    // after runs only once before has finished
+    void precede(TaskId before, TaskId after);
+    size_t size() const { return m_tasks.size(); }
+
+private:
+    friend class JobSystem;
+
+    struct Task {
+        std::function<void()> run;
+        std::vector<TaskId> successors;
+        int predecessors = 0;
+    };
+
+    std::vector<Task> m_tasks;
+    std::unique_ptr<std::atomic<int>[]> m_remaining;   // Unfinished predecessors during run()
+    size_t m_remainingSize = 0;
+    JobSystem* m_system = nullptr;
+    JobGroup* m_group = nullptr;                       // Tasks of the current run
+};
+
+// Work-stealing scheduler over a fixed set of worker threads. Every worker
+// has its own deque: it pushes and pops work at the back, and idle workers
+// steal from the front of the others. Threads that wait for jobs - including
+// threads outside the pool - run queued jobs of the group they wait for
+// meanwhile instead of blocking, so jobs may start and wait for more jobs (a
+// match tick running its phases in parallel) without tying up a thread. They
+// never take another group's jobs, so a waiting phase isn't charged for work
+// of another phase or match. With no workers everything runs inline on the
+// calling thread.
+//
+// A job that throws doesn't stop the others of its group; once all are done
+// the exception is rethrown to the waiting caller. Tasks of a graph whose
+// run has failed are skipped.
+class JobSystem {
+public:
+    explicit JobSystem(size_t workers);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    size_t workers() const { return m_threads.size(); }
+    // Threads that can run jobs at once, counting the caller
+    size_t concurrency() const { return m_threads.size() + 1; }
+
+    // Calls body(chunkBegin, chunkEnd) over [begin, end) split into chunks of
+    // at least grain items, on any threads, and returns when every chunk is
+    // done. Chunks must not touch the same data unless it is read-only.
+    template <typename Body>
+    void parallelFor(size_t begin, size_t end, size_t grain, const Body& body) {
+        if (begin >= end) {
+            return;
+        }
+        size_t count = end - begin;
+        size_t chunks = chunkCount(count, grain);
+        if (chunks <= 1) {
+            body(begin, end);
+            return;
+        }
+        auto run = [](void* context, size_t chunkBegin, size_t chunkEnd) {
+            (*static_cast<const Body*>(context))(chunkBegin, chunkEnd);
+        };
+        runChunks(run, const_cast<Body*>(&body), begin, count, chunks);
+    }
+
+    // Runs every task of the graph in dependency order and returns when all
+    // are done
+    void run(TaskGraph& graph);
+
+private:
+    using JobFunction = void (*)(void* context, size_t begin, size_t end);
+
+    struct Job {
+        JobFunction function;
+        void* context;
+        size_t begin;
+        size_t end;
+        JobGroup* group;                // Counted down once the job is done
+    };
+
+    // Padded so neighbouring queues' locks don't share a cache line
+    struct alignas(64) Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    size_t chunkCount(size_t count, size_t grain) const;
+    void runChunks(JobFunction function, void* context, size_t begin, size_t count, size_t chunks);
+    void push(const Job& job);
+    // Take a job of the given group, or of any group if it is null
+    bool pop(Job& job, const JobGroup* group);
+    bool steal(Job& job, const JobGroup* group);
+    bool runOne(const JobGroup* group);
+    void execute(const Job& job);
+    // Returns once every job of the group is done, then rethrows the first
+    // exception one of them threw
+    void wait(JobGroup& group);
+    void wake(size_t jobs);
+    void work(size_t index);
+    size_t queueIndex() const;
+
+    static void runTask(void* context, size_t task, size_t);
+    void finishTask(TaskGraph& graph, size_t task);
+
+    // One queue per worker, then one shared by threads outside the pool
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_queued{0};    // Jobs in any queue
+    std::mutex m_sleepMutex;
+    std::condition_variable m_sleep;
+    size_t m_sleeping = 0;              // Under m_sleepMutex
+    bool m_stopping = false;            // Under m_sleepMutex
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Command.h"
+#include "EntityState.h"
+#include "JsonWriter.h"
+#include "PhysicsEngine.h"
+#include <string>
+#include <vector>
+
+class CellularAutomata;
+
+// Text state broadcast, written with JsonWriter from captured EntityStates.
+// The output matches what the old json tree produced with dump(): compact,
+// keys in std::map (alphabetical) order, doubles with six significant digits.
+class JsonProtocol {
+public:
+    // Encode one state frame into out (cleared first). Pass a null terrain
+    // to omit the grid, and partial for budgeted snapshots.
+    static void encodeState(std::string& out,
+                            const StateHeader& header,
+                            const std::vector<EntityState>& entities,
+                            const CellularAutomata* terrain,
+                            bool partial = false);
+
+    // Bytes one object adds to a state frame, separator included
+    static size_t entitySize(const EntityState& entity);
+
+    // Terrain-only message: {"terrain":{...},"tick":N,"type":"terrain"}
+    static void encodeTerrainMessage(std::string& out, uint32_t tick,
+                                     const CellularAutomata& terrain);
+
+    // Interest change for one client:
+    // {"entered":[ids],"left":[ids],"tick":N,"type":"interest"}
+    static void encodeInterest(std::string& out, uint32_t tick,
+                               const std::vector<int>& entered,
+                               const std::vector<int>& left);
+
+    // Objects a budgeted client should drop, and whether to drop everything
+    // it holds first: {"ids":[ids],"reset":true,"tick":N,"type":"removed"}.
+    // reset is left out when false.
+    static void encodeRemoved(std::string& out, uint32_t tick,
+                              const std::vector<int>& ids, bool reset);
+
+    // Command acknowledgement: {"id":N,"result":"applied","seq":N,"tick":N,"type":"ack"}.
+    // id (the object created) and tick are left out when 0.
+    static void encodeAck(std::string& out, uint32_t seq, CommandResult result,
+                          uint32_t tick, int objectId);
+
+    // Projectile events: {"removed":[[id,tick,hit]],"spawned":[[id,tick,x,y,vx,vy]],
+    // "tick":N,"type":"projectiles"}. Spawn states are written exactly.
+    static void encodeProjectileEvents(std::string& out, uint32_t tick,
+                                       const std::vector<ProjectileSpawn>& spawns,
+                                       const std::vector<ProjectileRemoval>& removals);
+
+    // The static bodies projectiles move through, in summation order:
+    // {"bodies":[[x,y,mass]],"gravity":G,"tick":N,"tickRate":R,"type":"field"}
+    static void encodeField(std::string& out, uint32_t tick, int tickRate,
+                            const std::vector<FieldBody>& bodies);
+
+    static void encodeEntity(JsonWriter& writer, const EntityState& entity);
+
+private:
+    static void encodeVec2d(JsonWriter& writer, const Vec2d& v);
+    static void encodeTerrain(JsonWriter& writer, const CellularAutomata& terrain);
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class JsonType : uint8_t {
+    Null,
+    Bool,
+    Number,
+    String,
+    Array,
+    Object
+};
+
+// One parsed value. Nodes are stored in document order (a "tape"): a
+// container is followed by its children, object members as key/value pairs,
+// and 'end' is the index just past the whole subtree.
+struct JsonNode {
+    JsonType type = JsonType::Null;
+    bool boolean = false;
+    uint32_t end = 0;
+    uint32_t count = 0;         // Array elements or object members
+    uint32_t rawOffset = 0;     // Exact source text of the value
+    uint32_t rawLength = 0;
+    std::string_view text;      // Decoded string contents
+    double number = 0;
+};
+
+class JsonDocument;
+
+// Lightweight handle to a node in a JsonDocument. A missing key or index
+// yields a null handle, and the typed getters throw std::runtime_error on a
+// type mismatch, so lookups can be chained without checks in between.
+class JsonValue {
+public:
+    JsonValue() = default;
+    JsonValue(const JsonDocument* document, uint32_t index)
+        : m_document(document), m_index(index) {}
+
+    JsonType type() const;
+    bool isNull() const { return type() == JsonType::Null; }
+    bool isString() const { return type() == JsonType::String; }
+    bool isNumber() const { return type() == JsonType::Number; }
+    bool isObject() const { return type() == JsonType::Object; }
+    bool isArray() const { return type() == JsonType::Array; }
+
+    // Object member lookup; null if missing or not an object
+    JsonValue operator[](std::string_view key) const;
+    // Array element; null if out of range or not an array
+    JsonValue at(size_t index) const;
+    size_t size() const;
+
+    // Views point into the parsed input (or the document's scratch buffer
+    // for strings containing escapes) and stay valid until the next parse
+    std::string_view getString() const;
+    bool getBool() const;
+    double getDouble() const;
+    int getInt() const;         // Truncates; throws if out of int range
+
+    // The exact input text this value was parsed from
+    std::string_view raw() const;
+
+    bool operator==(std::string_view str) const {
+        return isString() && getString() == str;
+    }
+    bool operator!=(std::string_view str) const { return !(*this == str); }
+
+private:
+    const JsonDocument* m_document = nullptr;
+    uint32_t m_index = 0;
+
+    const JsonNode* node() const;
+};
+
+// Strict RFC 8259 parser for small client messages. Parsing is a single
+// iterative pass over the input into a node array that is reused between
+// calls, so a long-lived document stops allocating once it has seen its
+// largest message. Strings are returned as views and never copied unless
+// they contain escapes. Invalid input throws std::runtime_error.
+//
+// The input must outlive the document's values.
+class JsonDocument {
+public:
+    static constexpr int MAX_DEPTH = 64;
+
+    JsonDocument() = default;
+    JsonDocument(const JsonDocument&) = delete;
+    JsonDocument& operator=(const JsonDocument&) = delete;
+
+    JsonValue parse(std::string_view input);
+    JsonValue root() const { return JsonValue(this, 0); }
+
+    size_t nodeCount() const { return m_nodes.size(); }
+
+private:
+    friend class JsonValue;
+
+    std::string_view m_input;
+    std::vector<JsonNode> m_nodes;
+    std::string m_strings;  // Decoded escaped strings; reserved so views stay valid
+    size_t m_pos = 0;
+
+    void skipWhitespace();
+    uint32_t addNode(JsonType type, size_t start);
+    void parseString(JsonNode& node);
+    void parseNumber(JsonNode& node);
+    void parseLiteral(std::string_view literal);
+    size_t skipPlainChars(size_t pos) const;
+    size_t validateUtf8(size_t pos) const;
+    size_t validateEscape(size_t pos) const;
+    void decodeString(size_t begin, size_t end, JsonNode& node);
+    [[noreturn]] void fail(const char* message) const;
+};
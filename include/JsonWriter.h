@@ -0,0 +1,126 @@
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Turns a key name into the quoted "name": prefix at compile time, e.g.
+// writer.key(JSON_KEY("position"))
+#define JSON_KEY(name) "\"" name "\":"
+
+// Streams compact JSON straight into a caller-owned buffer. Nothing is
+// allocated once the buffer has grown to its working size, so callers should
+// keep the same string around between frames. Numbers are formatted like an
+// ostream with default precision (std::to_chars, general, 6 digits).
+//
+// String values are limited to literals and are not escaped.
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out) : m_out(out) {}
+
+    void beginObject() { open('{'); }
+    void endObject() { close('}'); }
+    void beginArray() { open('['); }
+    void endArray() { close(']'); }
+
+    template <size_t N>
+    void key(const char (&quotedKey)[N]) {
+        separate();
+        m_out.append(quotedKey, N - 1);
+        m_afterKey = true;
+    }
+
+    void value(int v) {
+        separate();
+        char buf[16];
+        auto result = std::to_chars(buf, buf + sizeof(buf), v);
+        m_out.append(buf, result.ptr);
+    }
+
+    void value(uint32_t v) { value(static_cast<uint64_t>(v)); }
+
+    void value(uint64_t v) {
+        separate();
+        char buf[24];
+        auto result = std::to_chars(buf, buf + sizeof(buf), v);
+        m_out.append(buf, result.ptr);
+    }
+
+    void value(double v) {
+        separate();
+        char buf[32];
+        auto result = std::to_chars(buf, buf + sizeof(buf), v, std::chars_format::general, 6);
+        m_out.append(buf, result.ptr);
+    }
+
+    // Shortest text that parses back to exactly v, for values a client has
+    // to reproduce bit for bit
+    void exactValue(double v) {
+        separate();
+        char buf[32];
+        auto result = std::to_chars(buf, buf + sizeof(buf), v);
+        m_out.append(buf, result.ptr);
+    }
+
+    void value(bool v) {
+        separate();
+        if (v) {
+            m_out.append("true", 4);
+        } else {
+            m_out.append("false", 5);
+        }
+    }
+
+    template <size_t N>
+    void value(const char (&literal)[N]) {
+        separate();
+        m_out.push_back('"');
+        m_out.append(literal, N - 1);
+        m_out.push_back('"');
+    }
+
+    // Splices in already-serialized JSON, e.g. JsonValue::raw()
+    void rawValue(std::string_view json) {
+        separate();
+        m_out.append(json.data(), json.size());
+    }
+
+    template <size_t N, typename T>
+    void field(const char (&quotedKey)[N], const T& v) {
+        key(quotedKey);
+        value(v);
+    }
+
+private:
+    std::string& m_out;
+    uint64_t m_hasElement = 0;  // One bit per nesting level
+    int m_depth = 0;
+    bool m_afterKey = false;
+
+    // Emits the comma between siblings
+    void separate() {
+        if (m_afterKey) {
+            m_afterKey = false;
+            return;
+        }
+        uint64_t bit = uint64_t(1) << m_depth;
+        if (m_hasElement & bit) {
+            m_out.push_back(',');
+        }
+        m_hasElement |= bit;
+    }
+
+    void open(char bracket) {
+        separate();
+        m_out.push_back(bracket);
+        ++m_depth;
+        m_hasElement &= ~(uint64_t(1) << m_depth);
+    }
+
+    void close(char bracket) {
+        --m_depth;
+        m_out.push_back(bracket);
+    }
+};
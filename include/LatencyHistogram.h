@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Log-linear histogram of durations in microseconds: four buckets per power
+// of two, so any percentile is reported to within about 25%. Recording is a
+// couple of integer operations and the histogram is a fixed 1 KiB, so one can
+// be kept per client and merged for server-wide figures.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKETS = 4;  // Per power of two
+    static constexpr int BUCKETS = 32 * SUB_BUCKETS;
+
+    void record(uint32_t micros) {
+        ++m_counts[bucketFor(micros)];
+        ++m_count;
+        m_sum += micros;
+        if (micros > m_max) {
+            m_max = micros;
+        }
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (int i = 0; i < BUCKETS; ++i) {
+            m_counts[i] += other.m_counts[i];
+        }
+        m_count += other.m_count;
+        m_sum += other.m_sum;
+        if (other.m_max > m_max) {
+            m_max = other.m_max;
+        }
+    }
+
+    uint64_t count() const { return m_count; }
+    uint64_t sum() const { return m_sum; }
+    uint32_t max() const { return m_max; }
+    uint64_t bucketCount(int bucket) const { return m_counts[bucket]; }
+
+    // Upper bound of the bucket holding the given fraction (0..1) of the
+    // samples, capped at the largest sample. 0 when empty.
+    uint32_t percentile(double fraction) const {
+        if (m_count == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(m_count));
+        if (rank >= m_count) {
+            rank = m_count - 1;
+        }
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i) {
+            seen += m_counts[i];
+            if (seen > rank) {
+                uint64_t bound = bucketUpperBound(i);
+                return bound < m_max ? static_cast<uint32_t>(bound) : m_max;
+            }
+        }
+        return m_max;
+    }
+
+    // Bucket b holds [lower, bucketUpperBound(b)) microseconds
+    static int bucketFor(uint32_t micros) {
+        if (micros < SUB_BUCKETS) {
+            return static_cast<int>(micros);
+        }
+        int octave = 31 - __builtin_clz(micros);  // 2..31
+        int sub = static_cast<int>(micros >> (octave - 2)) & (SUB_BUCKETS - 1);
+        return (octave - 1) * SUB_BUCKETS + sub;
+    }
+
+    static uint64_t bucketUpperBound(int bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return static_cast<uint64_t>(bucket) + 1;
+        }
+        int octave = bucket / SUB_BUCKETS + 1;
+        int sub = bucket % SUB_BUCKETS;
+        return static_cast<uint64_t>(SUB_BUCKETS + sub + 1) << (octave - 2);
+    }
+
+private:
+    std::array<uint64_t, BUCKETS> m_counts{};
+    uint64_t m_count = 0;
+    uint64_t m_sum = 0;
+    uint32_t m_max = 0;
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+// Asynchronous logging. A log call formats its line into a buffer on the
+// stack and copies it into a ring buffer owned by the calling thread; a
+// background thread drains every thread's ring to stdout (debug and info)
+// or stderr (warnings and errors). Logging never blocks or makes a system
+// call: when a thread's ring is full the line is dropped and counted.
+//
+//   LOG_INFO("Tower placed").field("match", matchId).field("x", x);
+//   LOG_LIMITED(LogLevel::Warn, 5, "Command queue full").field("client", id);
+//
+// Lines read "12:00:01.234 INFO  Tower placed match=3 x=412.5". Levels below
+// LOG_MIN_LEVEL compile to nothing, so debug logging can stay in hot paths;
+// the rest can be filtered at run time with Log::setLevel(). LOG_LIMITED
+// lets through at most the given number of lines per second from its call
+// site, and the next line that gets through says how many were suppressed.
+//
+// Threads must stop logging before main() returns.
+
+enum class LogLevel : uint8_t {
+    Debug = 0,
+    Info = 1,
+    Warn = 2,
+    Error = 3
+};
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+class Log {
+public:
+    // Longest line kept, timestamp and level not counted; longer lines are cut
+    static constexpr size_t LINE_SIZE = 232;
+    // Lines each thread can have waiting for the writer
+    static constexpr size_t RING_SIZE = 512;
+
+    static bool enabled(LogLevel level) {
+#if LOG_MIN_LEVEL > 0
+        if (static_cast<int>(level) < LOG_MIN_LEVEL) {
+            return false;
+        }
+#endif
+        return level >= s_level.load(std::memory_order_relaxed);
+    }
+    static void setLevel(LogLevel level) { s_level.store(level, std::memory_order_relaxed); }
+    // "debug", "info", "warn" or "error"
+    static bool parseLevel(std::string_view name, LogLevel& level);
+
+    // Queues a finished line from the calling thread
+    static void write(LogLevel level, const char* text, size_t size);
+    // Blocks until every line queued so far has been written
+    static void flush();
+    // Lines dropped because a ring was full, since startup
+    static uint64_t dropped();
+
+private:
+    static std::atomic<LogLevel> s_level;
+};
+
+// One line being built; queued when it goes out of scope
+class LogRecord {
+public:
+    LogRecord(LogLevel level, std::string_view message, uint32_t suppressed = 0) : m_level(level) {
+        append(message);
+        if (suppressed > 0) {
+            field("suppressed", suppressed);
+        }
+    }
+    ~LogRecord() { Log::write(m_level, m_text, m_size); }
+
+    LogRecord(const LogRecord&) = delete;
+    LogRecord& operator=(const LogRecord&) = delete;
+
+    // Values with spaces are quoted
+    LogRecord& field(std::string_view key, std::string_view value) {
+        beginField(key);
+        bool quote = value.empty() || value.find(' ') != std::string_view::npos;
+        if (quote) {
+            append("\"");
+        }
+        append(value);
+        if (quote) {
+            append("\"");
+        }
+        return *this;
+    }
+    LogRecord& field(std::string_view key, const char* value) {
+        return field(key, std::string_view(value));
+    }
+    LogRecord& field(std::string_view key, bool value) {
+        beginField(key);
+        append(value ? "true" : "false");
+        return *this;
+    }
+    template <typename T>
+    std::enable_if_t<std::is_arithmetic_v<T>, LogRecord&> field(std::string_view key, T value) {
+        beginField(key);
+        char* end = m_text + sizeof(m_text);
+        std::to_chars_result result;
+        if constexpr (std::is_floating_point_v<T>) {
+            result = std::to_chars(m_text + m_size, end, static_cast<double>(value),
+                                   std::chars_format::general, 6);
+        } else {
+            result = std::to_chars(m_text + m_size, end, value);
+        }
+        if (result.ec == std::errc()) {
+            m_size = static_cast<size_t>(result.ptr - m_text);
+        }
+        return *this;
+    }
+
+private:
+    void beginField(std::string_view key) {
+        append(" ");
+        append(key);
+        append("=");
+    }
+    void append(std::string_view text) {
+        size_t count = std::min(text.size(), sizeof(m_text) - m_size);
+        text.copy(m_text + m_size, count);
+        m_size += count;
+    }
+
+    LogLevel m_level;
+    size_t m_size = 0;
+    char m_text[Log::LINE_SIZE];
+};
+
+// Lets through at most perSecond lines a second, shared by every thread
+class LogRateLimit {
+public:
+    explicit LogRateLimit(uint32_t perSecond) : m_perSecond(perSecond) {}
+
+    bool allow() {
+        int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t start = m_windowStart.load(std::memory_order_relaxed);
+        if (now - start >= 1000 && m_windowStart.compare_exchange_strong(start, now)) {
+            m_count.store(0, std::memory_order_relaxed);
+        }
+        if (m_count.fetch_add(1, std::memory_order_relaxed) < m_perSecond) {
+            return true;
+        }
+        m_suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // Lines held back since the last call
+    uint32_t takeSuppressed() { return m_suppressed.exchange(0, std::memory_order_relaxed); }
+
+private:
+    uint32_t m_perSecond;
+    std::atomic<int64_t> m_windowStart{0};
+    std::atomic<uint32_t> m_count{0};
+    std::atomic<uint32_t> m_suppressed{0};
+};
+
+#define LOG_AT(level, message) \
+    if (!Log::enabled(level)) {} else LogRecord((level), (message))
+#define LOG_DEBUG(message) LOG_AT(LogLevel::Debug, message)
+#define LOG_INFO(message) LOG_AT(LogLevel::Info, message)
+#define LOG_WARN(message) LOG_AT(LogLevel::Warn, message)
+#define LOG_ERROR(message) LOG_AT(LogLevel::Error, message)
+// At most perSecond lines a second from this call site
+#define LOG_LIMITED(level, perSecond, message)                                        \
+    if (static LogRateLimit logLimit_(perSecond); !Log::enabled(level) || !logLimit_.allow()) {} \
+    else LogRecord((level), (message), logLimit_.takeSuppressed())
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "../libs/websocket/websocket_server.hpp"
+#include "Allocations.h"
+#include "GameWorld.h"
+#include "JobSystem.h"
+#include "LatencyHistogram.h"
+#include "Profiler.h"
+#include "TickScheduler.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct MatchHostOptions {
+    int port = 9002;
+    int matches = 1;
+    int workers = 0;    // Threads ticking matches besides the one calling run()
+    // No networking and no pacing: every match is ticked as fast as the
+    // threads allow, for offline runs
+    bool headless = false;
+    uint64_t ticks = 0; // Stop after this many ticks of every match, 0 to run until stop()
+    // Terrain seed of the first match; later matches, restarts included,
+    // count up from it. 0 picks every seed at random.
+    uint32_t seed = 0;
+    std::string recordDir;  // Write an input log per match here, if not empty
+    // Time every tick and publish phase; requestTrace() saves the last
+    // traceSeconds of them to traceDir
+    bool profile = false;
+    std::string traceDir = ".";
+    double traceSeconds = 10;
+    StressOptions stress;   // Synthetic load added to every match
+};
+
+// Runs many matches in one process. Each match is a GameWorld; all of them
+// share one listening socket and server thread, and every frame one tick per
+// match is spread over a fixed pool of worker threads (a JobSystem, which
+// the ticks use for their own parallel phases too). Each tick only copies
+// out a snapshot; one publishing thread encodes and sends them while the
+// next frame is ticked. Clients pick a match
+// with the handshake path: "/match/<n>" for n in [0, matches), or "/" for
+// match 0. A plain GET of "/metrics" from this machine returns the host's
+// metrics in Prometheus text format.
+class MatchHost {
+public:
+    explicit MatchHost(const MatchHostOptions& options);
+    ~MatchHost();
+
+    MatchHost(const MatchHost&) = delete;
+    MatchHost& operator=(const MatchHost&) = delete;
+
+    // Ticks every match at GameWorld::SIM_RATE, or as fast as possible when
+    // headless, until stop() or the tick limit. A match that has ended is
+    // replaced by a fresh one and its clients are disconnected.
+    void run();
+    // Safe to call from any thread and from a signal handler
+    void stop() { m_stopRequested.store(true); }
+    // Saves a Chrome trace of the recent phases at the end of the current
+    // frame. Needs profile; safe from a signal handler.
+    void requestTrace() { m_traceRequested.store(true); }
+
+    // The match a handshake path asks for, or -1
+    static int parseMatchPath(const std::string& path, int matches);
+
+private:
+    struct Match {
+        std::unique_ptr<GameWorld> world;
+        bool running = true;    // Result of this frame's tick
+        uint32_t tickUs = 0;    // Duration of this frame's tick
+    };
+
+    // Written by the frame thread at every report, read by renderMetrics()
+    // on the server thread
+    struct PublishedMetrics {
+        std::atomic<uint32_t> tickP50Us{0};     // Over the last report
+        std::atomic<uint32_t> tickP99Us{0};
+        std::atomic<uint32_t> tickMaxUs{0};
+        std::atomic<uint64_t> ticks{0};         // Match ticks since startup
+        std::atomic<uint64_t> tickMicros{0};
+        std::atomic<double> frameMs{0};
+        std::atomic<double> publishWaitMs{0};
+        std::atomic<uint64_t> overruns{0};
+        std::atomic<uint64_t> droppedTicks{0};
+        std::atomic<uint64_t> restarts{0};
+        std::array<std::atomic<uint64_t>, 5> objects{};     // Living objects by GameObjectType
+    };
+
+    std::unique_ptr<GameWorld> createMatch(int matchId);
+    uint32_t nextSeed();
+    void tickMatch(Match& match, double deltaTime);
+    void restartMatch(int matchId);
+    void report(const TickScheduler& scheduler, double seconds);
+    void reportPhases();
+    void publishMetrics(const TickScheduler& scheduler);
+    // Prometheus text for the /metrics endpoint, on the server thread
+    void renderMetrics(std::string& out);
+    // Writes the trace on its own thread so the frame isn't held up
+    void startTrace();
+    // Publishing thread: sends every match's front snapshot once per frame
+    void publishLoop();
+    // Blocks until the snapshots handed over last frame have been sent
+    void waitForPublish();
+
+    // Connection events, on the server thread. They are passed on with
+    // m_routesMutex held, so a match can't be replaced while in use.
+    bool route(websocket::ConnectionHandle hdl, const std::string& path);
+    WebSocketServer* clientsOf(websocket::ConnectionHandle hdl);
+    void on_open(websocket::ConnectionHandle hdl);
+    void on_close(websocket::ConnectionHandle hdl);
+    void on_message(websocket::ConnectionHandle hdl, const std::string& msg);
+    void on_pong(websocket::ConnectionHandle hdl, const std::string& payload);
+
+    MatchHostOptions m_options;
+    websocket::Server m_server;
+    std::thread m_serverThread;
+    JobSystem m_jobs;
+    std::vector<Match> m_matches;
+    std::thread m_publishThread;
+    std::mutex m_publishMutex;
+    std::condition_variable m_publishSignal;
+    bool m_publishPending = false;      // Under m_publishMutex
+    bool m_publishStopping = false;     // Under m_publishMutex
+    std::mutex m_routesMutex;
+    std::unordered_map<int, int> m_routes;     // Connection id -> match
+    std::atomic<bool> m_stopRequested{false};
+    std::atomic<bool> m_traceRequested{false};
+    std::thread m_traceThread;
+    std::atomic<bool> m_tracing{false};     // m_traceThread is writing
+    // Reported on the console once a second
+    LatencyHistogram m_tickTimes;   // Every match tick since the last report
+    double m_frameMs = 0;           // Smoothed time to tick all matches once
+    double m_publishWaitMs = 0;     // Smoothed time the frame waited for publishing
+    uint64_t m_reportedTicks = 0;   // Scheduler ticks at the last report
+    int m_reportsSincePhases = 0;   // Phase times are logged every PHASE_REPORT_INTERVAL reports
+    Allocations::ByPhase m_phaseAllocations{};  // As of the last phase report
+    uint64_t m_restarts = 0;
+    PublishedMetrics m_metrics;
+    uint32_t m_seedsUsed = 0;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Counters the simulation bumps for the metrics endpoint (see
+// MatchHost::renderMetrics). Relaxed atomics: safe to bump from any match's
+// thread, and a scrape only needs each value to be recent.
+class Metrics {
+public:
+    static std::atomic<uint64_t> pathSearches;
+    static std::atomic<uint64_t> pathNodesExpanded;
+    static std::atomic<uint64_t> terrainGenerations;
+    static std::atomic<uint64_t> terrainMicros;
+    static std::atomic<uint64_t> commandsDropped;
+
+    static void add(std::atomic<uint64_t>& counter, uint64_t amount = 1) {
+        counter.fetch_add(amount, std::memory_order_relaxed);
+    }
+};
+
+// Prometheus text exposition format (version 0.0.4). Labels are passed
+// preformatted, e.g. match="0",client="12".
+class PrometheusWriter {
+public:
+    static constexpr const char* CONTENT_TYPE = "text/plain; version=0.0.4";
+
+    explicit PrometheusWriter(std::string& out) : m_out(out) {}
+
+    // Starts a metric family; its samples follow. Type is counter, gauge or
+    // summary.
+    void family(std::string_view name, std::string_view type, std::string_view help);
+    void sample(std::string_view name, double value, std::string_view labels = {});
+    void sample(std::string_view name, uint64_t value, std::string_view labels = {});
+
+private:
+    void beginSample(std::string_view name, std::string_view labels);
+
+    std::string& m_out;
+};
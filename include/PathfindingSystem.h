@@ -35,13 +35,14 @@ class PathfindingSystem {
 public:
     PathfindingSystem(int gridWidth, int gridHeight, double cellSize);
     
-    // Find path through gravity field
+    // Find path through gravity field. Safe to call from several threads
+    // at once.
     std::vector<Vec2d> findPath(
         const Vec2d& start, 
         const Vec2d& end,
         const std::vector<std::unique_ptr<GameObject>>& objects,
         const PhysicsEngine& physics
-    );
+    ) const;
     
     // Set obstacles (planets, towers, etc.)
     void updateObstacles(const std::vector<std::unique_ptr<GameObject>>& objects);
@@ -2,21 +2,52 @@
 
 #include "Vec2d.h"
 #include "GameObject.h"
+#include "JobSystem.h"
 #include <vector>
 #include <memory>
 
+// A static mass (planet or tower) that projectiles are attracted to
+struct FieldBody {
+    Vec2d position;
+    double mass;
+
+    bool operator==(const FieldBody& other) const {
+        return position.x == other.position.x && position.y == other.position.y &&
+               mass == other.mass;
+    }
+};
+
 class PhysicsEngine {
 public:
     // Gravitational constant - tuned for gameplay
     static constexpr double GRAVITATIONAL_CONSTANT = 100.0;
     
-    // Update all objects with gravitational forces
-    void update(std::vector<std::unique_ptr<GameObject>>& objects, double deltaTime);
+    // Update all objects except projectiles with gravitational forces. Each
+    // enemy sums its forces in object order, so the result is the same
+    // however the work is split.
+    void update(std::vector<std::unique_ptr<GameObject>>& objects, double deltaTime, JobSystem& jobs);
+
+    // Projectiles feel only the static bodies and advance by a fixed step,
+    // so a client given the spawn state and the field reproduces their
+    // paths exactly. Lifetime runs down by the same step.
+    void stepProjectiles(std::vector<std::unique_ptr<GameObject>>& objects, double step, JobSystem& jobs) const;
+
+    // Rebuilds the projectile field from the static bodies. Returns true if
+    // it changed.
+    bool updateField(const std::vector<std::unique_ptr<GameObject>>& objects);
+    const std::vector<FieldBody>& getField() const { return m_field; }
+
+    // Acceleration of a projectile at a point. client/main.js repeats this
+    // computation operation for operation, so change both together.
+    Vec2d fieldAt(const Vec2d& position) const;
     
     // Calculate gravity vector at a specific point (for pathfinding)
     Vec2d getGravityAt(const Vec2d& position, const std::vector<std::unique_ptr<GameObject>>& objects) const;
     
 private:
+    std::vector<FieldBody> m_field;
+    std::vector<FieldBody> m_nextField;
+
     // Calculate gravitational force between two objects
     Vec2d calculateGravitationalForce(const GameObject& obj1, const GameObject& obj2) const;
 };
\ No newline at end of file
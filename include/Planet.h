@@ -15,10 +15,17 @@ public:
         std::cout << "Planet at (" << position.x << ", " << position.y << ") with radius " << radius << std::endl;
     }
     
-    json toJson() const override {
-        json j = GameObject::toJson();
-        j["radius"] = radius;
-        j["owner"] = owner;
-        return j;
+    void captureState(EntityState& state) const override {
+        GameObject::captureState(state);
+        state.radius = radius;
+        state.owner = owner;
+        state.set(FIELD_RADIUS);
+        state.set(FIELD_OWNER);
+    }
+
+    void hashState(StateHash& hash) const override {
+        GameObject::hashState(hash);
+        hash.add(radius);
+        hash.add(owner);
     }
 };
\ No newline at end of file
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Where tick and frame time goes. PROFILE_SCOPE times the rest of the
+// enclosing block as one phase:
+//
+//   PROFILE_SCOPE(Phase::Physics, getMatchId());
+//
+// Off by default, when a scope costs one relaxed load and a branch. When on,
+// every finished scope is recorded on the thread that ran it: into a
+// histogram per phase, taken by takeStats() for rolling figures, and into a
+// ring of the thread's most recent phases, which writeTrace() saves as a
+// Chrome trace (chrome://tracing or ui.perfetto.dev). Each thread also
+// tracks its innermost phase, which Allocations uses to count heap
+// allocations by phase. Builds with PROFILE_COMPILED=0 leave the scopes out
+// altogether.
+
+enum class Phase : uint8_t {
+    Frame,              // MatchHost: every match ticked once
+    PublishWait,        // MatchHost: waiting for last frame's snapshots to go out
+    Tick,               // GameWorld::tick
+    Commands,           // Client commands applied
+    Physics,            // Gravity, integration, projectile stepping
+    Pathing,            // Enemy steering and A*
+    Objects,            // Per-object update()
+    Terrain,            // Cellular automaton
+    Spawn,              // A wave of enemies created
+    Targeting,          // Towers finding targets and firing
+    Collisions,         // Projectile hits and enemies reaching the base
+    Cleanup,            // Dead objects removed
+    Capture,            // Snapshot copied out of the world
+    Publish,            // GameWorld::publishSnapshot
+    PublishProjectiles, // Projectile events and the field encoded and sent
+    PublishObjects,     // Shared object snapshots encoded and sent
+    PublishClients,     // Per-client culled or budgeted snapshots
+    PublishTerrain,
+    PublishStats,
+    Count
+};
+
+constexpr size_t PHASE_COUNT = static_cast<size_t>(Phase::Count);
+
+#ifndef PROFILE_COMPILED
+#define PROFILE_COMPILED 1
+#endif
+
+class Profiler {
+public:
+    // Phases each thread keeps for traces; at 60 ticks a second this is
+    // minutes for one match, less when a thread runs many
+    static constexpr size_t EVENTS_PER_THREAD = 1 << 16;
+
+    using PhaseStats = std::array<LatencyHistogram, PHASE_COUNT>;
+
+    static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+    static void enable(bool on) { s_enabled.store(on, std::memory_order_relaxed); }
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    // "tick.physics" and so on
+    static const char* phaseName(Phase phase);
+
+    // The innermost phase running on this thread, Phase::Count outside any
+    // or while the profiler is off. Work a phase hands to other threads
+    // runs outside it.
+    static Phase currentPhase() { return s_phase; }
+    // Makes phase current; returns the phase to restore when it ends
+    static Phase enterPhase(Phase phase) {
+        Phase outer = s_phase;
+        s_phase = phase;
+        return outer;
+    }
+    static void leavePhase(Phase outer) { s_phase = outer; }
+
+    // Shown in traces instead of "thread N"
+    static void nameThread(std::string_view name);
+    static void record(Phase phase, int match, int64_t startNs, int64_t endNs);
+    // Microseconds per phase on every thread since the last call
+    static PhaseStats takeStats();
+    // Writes every phase that started in the last seconds as Chrome trace
+    // JSON. Returns the number of phases written; throws if path can't be
+    // written.
+    static size_t writeTrace(const std::string& path, double seconds);
+
+private:
+    static std::atomic<bool> s_enabled;
+    static thread_local Phase s_phase;
+};
+
+class ProfileScope {
+public:
+    explicit ProfileScope(Phase phase, int match = -1) {
+        if (Profiler::enabled()) {
+            m_phase = phase;
+            m_match = match;
+            m_outer = Profiler::enterPhase(phase);
+            m_start = Profiler::now();
+        }
+    }
+    ~ProfileScope() {
+        if (m_start != 0) {
+            int64_t end = Profiler::now();
+            // Recording allocates its ring once; that isn't the phase's doing
+            Profiler::leavePhase(m_outer);
+            Profiler::record(m_phase, m_match, m_start, end);
+        }
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    Phase m_phase = Phase::Count;
+    Phase m_outer = Phase::Count;
+    int m_match = -1;
+    int64_t m_start = 0;     // 0 while the profiler was off at the start
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#if PROFILE_COMPILED
+#define PROFILE_SCOPE(...) ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(__VA_ARGS__)
+#else
+#define PROFILE_SCOPE(...) do {} while (false)
+#endif
@@ -8,11 +8,12 @@ public:
     double damage;
     double speed;
     int targetId;
-    double lifetime;
+    double lifetime;  // Seconds left, run down by PhysicsEngine::stepProjectiles
+    bool hitTarget;  // Removed by a hit rather than by running out of lifetime
     
     Projectile(Vec2d position, Vec2d targetPosition, double damage = 20.0, double speed = 200.0)
         : GameObject(GameObjectType::Projectile, position, 1.0, false),
-          damage(damage), speed(speed), targetId(-1), lifetime(5.0) {
+          damage(damage), speed(speed), targetId(-1), lifetime(5.0), hitTarget(false) {
         
         // Calculate initial velocity towards target
         Vec2d direction = (targetPosition - position).normalized();
@@ -20,22 +21,24 @@ public:
         // Now gravity will curve its path!
     }
     
-    void update(double deltaTime) override {
-        // Don't call base update - physics engine handles movement
-        lifetime -= deltaTime;
-        if (lifetime <= 0) {
-            alive = false;
-        }
-    }
-    
     void render() const override {
         std::cout << "Projectile at (" << position.x << ", " << position.y << ")" << std::endl;
     }
     
-    json toJson() const override {
-        json j = GameObject::toJson();
-        j["damage"] = damage;
-        j["speed"] = speed;
-        return j;
+    void captureState(EntityState& state) const override {
+        GameObject::captureState(state);
+        state.damage = damage;
+        state.speed = speed;
+        state.set(FIELD_DAMAGE);
+        state.set(FIELD_SPEED);
+    }
+
+    void hashState(StateHash& hash) const override {
+        GameObject::hashState(hash);
+        hash.add(damage);
+        hash.add(speed);
+        hash.add(targetId);
+        hash.add(lifetime);
+        hash.add(hitTarget);
     }
 };
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "EntityState.h"
+#include <cstdint>
+#include <vector>
+
+// Uniform bucket grid over captured entity positions, rebuilt once per
+// snapshot and queried once per client viewport. Entities are bucketed with a
+// counting sort into flat arrays, so a rebuild allocates nothing once the
+// arrays have grown. Positions outside the map land in the edge cells.
+class SpatialGrid {
+public:
+    SpatialGrid(double width, double height, double cellSize);
+
+    // Index entities by position. The grid keeps a pointer to the vector,
+    // which must stay unchanged until the next build().
+    void build(const std::vector<EntityState>& entities);
+
+    // Indices into the built vector of every entity whose position lies
+    // inside the rectangle (edges included), in ascending order
+    void query(double minX, double minY, double maxX, double maxY,
+               std::vector<uint32_t>& out) const;
+
+private:
+    int m_columns;
+    int m_rows;
+    double m_cellSize;
+    const std::vector<EntityState>* m_entities = nullptr;
+    std::vector<uint32_t> m_cellStart;   // m_entries offset of each cell, plus an end marker
+    std::vector<uint32_t> m_entries;     // Entity indices grouped by cell
+    std::vector<uint32_t> m_entityCell;  // Cell of each entity
+    std::vector<uint32_t> m_cursor;      // Next free m_entries slot per cell during build()
+
+    int column(double x) const;
+    int row(double y) const;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Vec2d.h"
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// FNV-1a over the bytes of simulation values, for GameWorld::stateHash().
+// Values are added one by one, never as whole structs, so padding bytes
+// can't make equal states hash differently.
+class StateHash {
+public:
+    void mix(const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            m_hash = (m_hash ^ bytes[i]) * 1099511628211ull;
+        }
+    }
+
+    template <typename T>
+    void add(const T& value) {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                      "add the members one by one");
+        mix(&value, sizeof(value));
+    }
+
+    void add(const Vec2d& v) {
+        add(v.x);
+        add(v.y);
+    }
+
+    // The length first, so adjacent lists can't trade elements
+    void add(const std::vector<Vec2d>& points) {
+        add(static_cast<uint64_t>(points.size()));
+        for (const Vec2d& point : points) {
+            add(point);
+        }
+    }
+
+    uint64_t value() const { return m_hash; }
+
+private:
+    uint64_t m_hash = 1469598103934665603ull;
+};
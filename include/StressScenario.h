@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+class GameWorld;
+
+// Synthetic load far beyond what waves produce, for finding where a host
+// stops keeping up
+struct StressOptions {
+    int enemies = 0;            // Kept alive: any that die or arrive are replaced
+    int towerColumns = 0;       // Grid of towers centred on the base
+    int towerRows = 0;
+    double towerSpacing = 20;   // World units between neighbouring grid towers
+    double projectileRate = 0;  // Extra projectiles per second, fired at enemies
+
+    bool enabled() const {
+        return enemies > 0 || (towerColumns > 0 && towerRows > 0) || projectileRate > 0;
+    }
+};
+
+// Applies StressOptions to one match at the start of each of its ticks (see
+// GameWorld::stress()). Positions and types are drawn from the seed, so a
+// stressed match is as repeatable as any other. The base can't fall, so the
+// match runs until its waves are over.
+class StressScenario {
+public:
+    StressScenario(const StressOptions& options, uint32_t seed);
+
+    void apply(GameWorld& world, double deltaTime);
+
+private:
+    void buildTowers(GameWorld& world);
+    void spawnEnemies(GameWorld& world, int count);
+    void fireProjectiles(GameWorld& world, int count);
+
+    StressOptions m_options;
+    std::mt19937 m_rng;
+    bool m_built = false;
+    double m_projectilesOwed = 0;   // Fractional projectiles carried to the next tick
+};
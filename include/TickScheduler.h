@@ -0,0 +1,43 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+#include <chrono>
+#include <cstdint>
+
+// Paces a fixed-rate loop against absolute deadlines: tick n is due at
+// start + n * period, however long the ticks before it took, so the rate
+// doesn't drift with load. A tick that starts after its deadline is an
+// overrun; the loop then runs the ticks it owes back to back, and if it is
+// more than MAX_CATCH_UP periods behind it drops them and starts counting
+// from now. Without real time pacing, every tick is due at once.
+class TickScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Ticks the loop may run back to back to make up for a stall
+    static constexpr int MAX_CATCH_UP = 5;
+
+    TickScheduler(Clock::duration period, bool realTime);
+
+    // Waits until the next tick is due
+    void waitForTick();
+
+    bool realTime() const { return m_realTime; }
+    uint64_t ticks() const { return m_ticks; }
+    uint64_t overruns() const { return m_overruns; }
+    uint64_t dropped() const { return m_dropped; }
+    // Lateness of every overrunning tick, in microseconds
+    const LatencyHistogram& lateness() const { return m_lateness; }
+    // Resets the counters, e.g. once they have been reported
+    void resetStats();
+
+private:
+    Clock::duration m_period;
+    bool m_realTime;
+    Clock::time_point m_deadline;   // When the next tick is due
+    bool m_started = false;
+    uint64_t m_ticks = 0;
+    uint64_t m_overruns = 0;
+    uint64_t m_dropped = 0;
+    LatencyHistogram m_lateness;
+};
@@ -41,14 +41,28 @@ public:
         std::cout << "Tower at (" << position.x << ", " << position.y << ") with range " << range << std::endl;
     }
     
-    json toJson() const override {
-        json j = GameObject::toJson();
-        j["range"] = range;
-        j["damage"] = damage;
-        j["fireRate"] = fireRate;
-        j["upgradeLevel"] = upgradeLevel;
-        j["upgradeCost"] = getUpgradeCost();
-        return j;
+    void captureState(EntityState& state) const override {
+        GameObject::captureState(state);
+        state.range = range;
+        state.damage = damage;
+        state.fireRate = fireRate;
+        state.upgradeLevel = upgradeLevel;
+        state.upgradeCost = getUpgradeCost();
+        state.set(FIELD_RANGE);
+        state.set(FIELD_DAMAGE);
+        state.set(FIELD_FIRE_RATE);
+        state.set(FIELD_UPGRADE_LEVEL);
+        state.set(FIELD_UPGRADE_COST);
+    }
+
+    void hashState(StateHash& hash) const override {
+        GameObject::hashState(hash);
+        hash.add(range);
+        hash.add(damage);
+        hash.add(fireRate);
+        hash.add(cooldownRemaining);
+        hash.add(cost);
+        hash.add(upgradeLevel);
     }
     
     bool canUpgrade() const {
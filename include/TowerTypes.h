@@ -21,10 +21,15 @@ public:
         m_towerType = TowerType::Basic;
     }
     
-    json toJson() const override {
-        json j = Tower::toJson();
-        j["towerType"] = static_cast<int>(m_towerType);
-        return j;
+    void captureState(EntityState& state) const override {
+        Tower::captureState(state);
+        state.towerType = static_cast<int>(m_towerType);
+        state.set(FIELD_TOWER_TYPE);
+    }
+
+    void hashState(StateHash& hash) const override {
+        Tower::hashState(hash);
+        hash.add(m_towerType);
     }
     
 protected:
@@ -57,11 +62,18 @@ public:
         cooldownRemaining = 1.0 / fireRate;
     }
     
-    json toJson() const override {
-        json j = Tower::toJson();
-        j["towerType"] = static_cast<int>(m_towerType);
-        j["splashRadius"] = m_splashRadius;
-        return j;
+    void captureState(EntityState& state) const override {
+        Tower::captureState(state);
+        state.towerType = static_cast<int>(m_towerType);
+        state.splashRadius = m_splashRadius;
+        state.set(FIELD_TOWER_TYPE);
+        state.set(FIELD_SPLASH_RADIUS);
+    }
+
+    void hashState(StateHash& hash) const override {
+        Tower::hashState(hash);
+        hash.add(m_towerType);
+        hash.add(m_splashRadius);
     }
     
 protected:
@@ -91,11 +103,19 @@ public:
         cooldownRemaining = 1.0 / fireRate;
     }
     
-    json toJson() const override {
-        json j = Tower::toJson();
-        j["towerType"] = static_cast<int>(m_towerType);
-        j["slowFactor"] = m_slowFactor;
-        return j;
+    void captureState(EntityState& state) const override {
+        Tower::captureState(state);
+        state.towerType = static_cast<int>(m_towerType);
+        state.slowFactor = m_slowFactor;
+        state.set(FIELD_TOWER_TYPE);
+        state.set(FIELD_SLOW_FACTOR);
+    }
+
+    void hashState(StateHash& hash) const override {
+        Tower::hashState(hash);
+        hash.add(m_towerType);
+        hash.add(m_slowFactor);
+        hash.add(m_slowDuration);
     }
     
 protected:
@@ -130,11 +150,18 @@ public:
         return false; // Never fires projectiles
     }
     
-    json toJson() const override {
-        json j = Tower::toJson();
-        j["towerType"] = static_cast<int>(m_towerType);
-        j["gravityStrength"] = m_gravityStrength;
-        return j;
+    void captureState(EntityState& state) const override {
+        Tower::captureState(state);
+        state.towerType = static_cast<int>(m_towerType);
+        state.gravityStrength = m_gravityStrength;
+        state.set(FIELD_TOWER_TYPE);
+        state.set(FIELD_GRAVITY_STRENGTH);
+    }
+
+    void hashState(StateHash& hash) const override {
+        Tower::hashState(hash);
+        hash.add(m_towerType);
+        hash.add(m_gravityStrength);
     }
     
 protected:
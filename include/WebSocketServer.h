@@ -1,30 +1,165 @@
 #pragma once
 
 #include "../libs/websocket/websocket_server.hpp"
-#include "../libs/nlohmann/json.hpp"
+#include "JsonReader.h"
+#include "LatencyHistogram.h"
 #include <string>
 #include <functional>
-#include <thread>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
 
-using json = nlohmann::json;
+// Encoding a client has negotiated for state broadcasts
+enum class WireFormat {
+    Json,
+    Binary,
+    BinaryQuantized
+};
 
+// Broadcast channels. Everything except Reliable is latest-wins: a client
+// that falls behind only receives the newest message that hasn't started
+// sending yet. Clients subscribe to Objects, Terrain and Stats separately.
+enum class Channel : websocket::CoalesceKey {
+    Reliable = websocket::reliable,
+    Objects = 1,
+    Terrain = 2,
+    Stats = 3
+};
+
+// Region of interest in world units
+struct Viewport {
+    double minX = 0;
+    double minY = 0;
+    double maxX = 0;
+    double maxY = 0;
+};
+
+// What one client has negotiated and subscribed to. Intervals are in
+// simulation ticks; 0 means not subscribed.
+struct ClientSubscription {
+    WireFormat format = WireFormat::Json;
+    int objectsInterval = 0;
+    int statsInterval = 0;
+    bool terrain = true;
+    bool needsTerrain = true;  // Send the grid on the next tick even if unchanged
+    bool culled = false;       // Objects are limited to the viewport
+    Viewport viewport;
+    int budget = 0;            // Bytes per object snapshot, 0 for no limit
+    bool needsProjectiles = true;  // Send the field and projectiles in flight before more events
+
+    // Gets object snapshots encoded just for this client
+    bool dedicated() const { return culled || budget > 0; }
+};
+
+// A client due an object snapshot of its own this tick
+struct SnapshotClient {
+    websocket::ConnectionHandle hdl;
+    WireFormat format;
+    bool culled;
+    Viewport viewport;
+    int budget;
+};
+
+// Round trips of the server's pings to one client
+struct ClientLatency {
+    uint32_t lastRttUs = 0;
+    double smoothedRttUs = 0;   // Moving average with gain 1/8, like TCP's SRTT
+    double jitterUs = 0;        // RFC 3550 style: mean change between successive RTTs
+    LatencyHistogram rtt;
+    LatencyHistogram jitter;    // Change between successive RTTs
+};
+
+// A client that has just started receiving projectile events
+struct JoiningClient {
+    websocket::ConnectionHandle hdl;
+    WireFormat format;
+};
+
+// The clients of one match. The websocket::Server and its thread are shared
+// by every match in the process (see MatchHost), which hands each
+// connection's events to the WebSocketServer of the match it asked for.
 class WebSocketServer {
 private:
-    websocket::Server m_server;
-    std::function<void(const std::string&)> m_on_message_callback;
-    std::thread m_server_thread;
+    websocket::Server& m_server;
+    int m_match_id;
+    std::function<void(int, const JsonValue&)> m_on_message_callback;
+    std::map<int, ClientSubscription> m_clients;
+    mutable std::mutex m_clients_mutex;
+    JsonDocument m_document;    // Reused for every incoming message
+    std::string m_response;
+    std::vector<websocket::ConnectionHandle> m_broadcast_targets;  // Reused by broadcast()
+    int m_sim_rate = 60;
+    int m_default_objects_interval = 3;
+    // Recipients for the current tick, by channel and format, rebuilt by beginTick()
+    std::array<std::array<std::vector<websocket::ConnectionHandle>, 3>, 4> m_tick_targets;
+    std::vector<SnapshotClient> m_snapshot_targets;  // Dedicated clients due objects this tick
+    std::vector<JoiningClient> m_joining_targets;    // Clients that need projectile catch-up
+    std::vector<int> m_departed;    // Reset dedicated clients not yet reported, under m_clients_mutex
+    // Ping round trips per client, and for every client since startup.
+    // Written on the server thread, under m_clients_mutex.
+    std::map<int, ClientLatency> m_latency;
+    LatencyHistogram m_all_rtt;
+    LatencyHistogram m_all_jitter;
     
 public:
-    WebSocketServer();
-    ~WebSocketServer();
+    WebSocketServer(websocket::Server& server, int matchId);
     
-    void run(int port);
-    void stop();
-    void broadcast(const std::string& message);
-    void setOnMessageCallback(std::function<void(const std::string&)> callback);
-    
-private:
+    int matchId() const { return m_match_id; }
+    size_t clientCount() const;
+    // Sends to every client that negotiated the given format
+    void broadcast(const std::string& message, WireFormat format = WireFormat::Json,
+                   Channel channel = Channel::Reliable);
+    bool hasClients(WireFormat format) const;
+
+    // Simulation rate and the object snapshot rate new clients start with.
+    // Subscriptions are rounded to a whole number of ticks.
+    void setRates(int simRate, int defaultSnapshotRate);
+    // Works out which clients are due on each channel this tick. Clients on
+    // the same rate are due on the same ticks, so they share one encode.
+    // Every client subscribed to objects is a Reliable target, for
+    // projectile events.
+    void beginTick(uint32_t tick, bool terrainChanged);
+    bool hasTargets(Channel channel, WireFormat format) const;
+    // Sends to the clients beginTick() found due on this channel and format.
+    // Clients with a viewport or byte budget are never in the shared Objects
+    // lists.
+    void publish(const std::string& message, Channel channel, WireFormat format);
+    // Sends JSON text to every client due on the channel, whatever its format
+    void publishText(const std::string& message, Channel channel);
+    // Clients that started following projectiles this tick
+    const std::vector<JoiningClient>& joiningTargets() const { return m_joining_targets; }
+    // Clients with a viewport or byte budget that are due an object snapshot
+    // this tick
+    const std::vector<SnapshotClient>& snapshotTargets() const { return m_snapshot_targets; }
+    void sendTo(websocket::ConnectionHandle hdl, const std::string& message,
+                Channel channel, WireFormat format);
+    // Ids of clients that disconnected or changed viewport/budget mode since
+    // the last call, so per-client snapshot state can be released
+    void takeDepartedClients(std::vector<int>& out);
+    // Send queue depth and drop/disconnect counters, for the whole process
+    websocket::QueueStats queueStats() const;
+    // Pings every client with the send time as payload; the pong gives the
+    // round trip. Call about once a second.
+    void pingClients();
+    // Round-trip and jitter histograms over every pong since startup
+    void latencyStats(LatencyHistogram& rtt, LatencyHistogram& jitter) const;
+    // False if the client is unknown or hasn't answered a ping yet
+    bool clientLatency(int clientId, ClientLatency& out) const;
+    // Called on the server thread with the client id and each parsed message
+    void setOnMessageCallback(std::function<void(int, const JsonValue&)> callback);
+
+    // Events for this match's connections, called on the server thread
     void on_open(websocket::ConnectionHandle hdl);
     void on_close(websocket::ConnectionHandle hdl);
     void on_message(websocket::ConnectionHandle hdl, const std::string& msg);
+    void on_pong(websocket::ConnectionHandle hdl, const std::string& payload);
+    
+private:
+    void negotiate(websocket::ConnectionHandle hdl, const JsonValue& request);
+    void subscribe(websocket::ConnectionHandle hdl, const JsonValue& request);
+    void setViewport(websocket::ConnectionHandle hdl, const JsonValue& request);
+    int rateToInterval(double rate) const;
+    void setDedicated(int clientId, ClientSubscription& sub, bool culled, int budget);
 };
\ No newline at end of file
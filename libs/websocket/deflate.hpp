@@ -0,0 +1,142 @@
+#pragma once
+
+// permessage-deflate (RFC 7692) payload transforms on top of zlib. Both
+// directions run in no-context-takeover mode: every message is compressed
+// and decompressed independently, so a single stream object can serve any
+// number of connections.
+
+#include <zlib.h>
+
+#include <stdexcept>
+#include <string>
+
+namespace websocket {
+
+class Deflater {
+public:
+    explicit Deflater(int level = Z_DEFAULT_COMPRESSION) {
+        m_stream = z_stream{};
+        // Negative window bits: raw deflate without zlib header or trailer
+        if (deflateInit2(&m_stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("deflateInit2 failed");
+        }
+    }
+
+    ~Deflater() { deflateEnd(&m_stream); }
+
+    Deflater(const Deflater&) = delete;
+    Deflater& operator=(const Deflater&) = delete;
+
+    // Appends the compressed message to out, minus the 00 00 FF FF tail
+    // that RFC 7692 says to strip
+    void compress(const char* data, size_t size, std::string& out) {
+        deflateReset(&m_stream);
+        size_t start = out.size();
+        out.resize(start + deflateBound(&m_stream, size) + 16);
+
+        m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        m_stream.avail_in = static_cast<uInt>(size);
+        m_stream.next_out = reinterpret_cast<Bytef*>(&out[start]);
+        m_stream.avail_out = static_cast<uInt>(out.size() - start);
+        deflate(&m_stream, Z_SYNC_FLUSH);
+
+        size_t written = out.size() - start - m_stream.avail_out;
+        out.resize(start + written - 4);
+    }
+
+private:
+    z_stream m_stream;
+};
+
+class Inflater {
+public:
+    Inflater() {
+        m_stream = z_stream{};
+        if (inflateInit2(&m_stream, -15) != Z_OK) {
+            throw std::runtime_error("inflateInit2 failed");
+        }
+    }
+
+    ~Inflater() { inflateEnd(&m_stream); }
+
+    Inflater(const Inflater&) = delete;
+    Inflater& operator=(const Inflater&) = delete;
+
+    // Replaces out with the decompressed message. Returns false if the data
+    // is corrupt or inflates to more than limit bytes.
+    bool decompress(const std::string& data, std::string& out, size_t limit) {
+        static const unsigned char tail[4] = {0x00, 0x00, 0xFF, 0xFF};
+        inflateReset(&m_stream);
+        out.clear();
+
+        const unsigned char* inputs[2] = {reinterpret_cast<const unsigned char*>(data.data()), tail};
+        size_t sizes[2] = {data.size(), sizeof(tail)};
+        char buffer[16384];
+        for (int part = 0; part < 2; ++part) {
+            m_stream.next_in = const_cast<Bytef*>(inputs[part]);
+            m_stream.avail_in = static_cast<uInt>(sizes[part]);
+            do {
+                m_stream.next_out = reinterpret_cast<Bytef*>(buffer);
+                m_stream.avail_out = sizeof(buffer);
+                int result = inflate(&m_stream, Z_SYNC_FLUSH);
+                if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR) {
+                    return false;
+                }
+                out.append(buffer, sizeof(buffer) - m_stream.avail_out);
+                if (out.size() > limit) {
+                    return false;
+                }
+                if (result == Z_STREAM_END || (result == Z_BUF_ERROR && m_stream.avail_out != 0)) {
+                    break;
+                }
+            } while (m_stream.avail_in > 0 || m_stream.avail_out == 0);
+        }
+        return true;
+    }
+
+private:
+    z_stream m_stream;
+};
+
+// Parses a Sec-WebSocket-Extensions offer and returns true if it contains a
+// permessage-deflate offer we can accept: one that doesn't ask us to use a
+// smaller compression window than zlib's default.
+inline bool accepts_permessage_deflate(const std::string& header) {
+    size_t pos = 0;
+    while (pos <= header.size()) {
+        size_t end = header.find(',', pos);
+        if (end == std::string::npos) end = header.size();
+        std::string offer = header.substr(pos, end - pos);
+        pos = end + 1;
+
+        bool is_deflate = false;
+        bool acceptable = true;
+        size_t param_pos = 0;
+        for (int index = 0; param_pos <= offer.size(); ++index) {
+            size_t param_end = offer.find(';', param_pos);
+            if (param_end == std::string::npos) param_end = offer.size();
+            std::string param = offer.substr(param_pos, param_end - param_pos);
+            param_pos = param_end + 1;
+
+            size_t first = param.find_first_not_of(" \t");
+            size_t last = param.find_last_not_of(" \t");
+            param = first == std::string::npos ? std::string() : param.substr(first, last - first + 1);
+            std::string name = param.substr(0, param.find('='));
+
+            if (index == 0) {
+                is_deflate = param == "permessage-deflate";
+            } else if (name == "server_max_window_bits") {
+                acceptable = acceptable && param == "server_max_window_bits=15";
+            } else if (name != "client_max_window_bits" && name != "server_no_context_takeover" &&
+                       name != "client_no_context_takeover") {
+                acceptable = false;
+            }
+        }
+        if (is_deflate && acceptable) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace websocket
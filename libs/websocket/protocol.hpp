@@ -0,0 +1,213 @@
+#pragma once
+
+// RFC 6455 building blocks shared by the server and the loopback client:
+// SHA-1 and base64 for the opening handshake, and frame header encoding and
+// parsing.
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace websocket {
+
+enum class Opcode {
+    Continuation = 0x0,
+    Text = 0x1,
+    Binary = 0x2,
+    Close = 0x8,
+    Ping = 0x9,
+    Pong = 0xA
+};
+
+namespace close_code {
+constexpr uint16_t normal = 1000;
+constexpr uint16_t going_away = 1001;
+constexpr uint16_t protocol_error = 1002;
+constexpr uint16_t too_big = 1009;
+
+// Whether a close frame may carry the code (RFC 6455 section 7.4). 1004,
+// 1005, 1006 and 1015 are reserved or only reported locally, 1016-2999 are
+// kept for future use, and 3000-4999 belong to libraries and applications.
+inline bool valid_on_wire(uint16_t code) {
+    return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1014) ||
+           (code >= 3000 && code <= 4999);
+}
+}
+
+namespace detail {
+
+inline uint32_t rotl(uint32_t v, int bits) {
+    return (v << bits) | (v >> (32 - bits));
+}
+
+inline std::array<uint8_t, 20> sha1(const std::string& input) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+    std::string data = input;
+    uint64_t bit_length = static_cast<uint64_t>(input.size()) * 8;
+    data.push_back(static_cast<char>(0x80));
+    while (data.size() % 64 != 56) {
+        data.push_back('\0');
+    }
+    for (int i = 7; i >= 0; --i) {
+        data.push_back(static_cast<char>((bit_length >> (i * 8)) & 0xFF));
+    }
+
+    for (size_t chunk = 0; chunk < data.size(); chunk += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data() + chunk + i * 4);
+            w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+        }
+        for (int i = 16; i < 80; ++i) {
+            w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = temp;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+
+    std::array<uint8_t, 20> digest;
+    for (int i = 0; i < 5; ++i) {
+        digest[i * 4] = static_cast<uint8_t>(h[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(h[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(h[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(h[i]);
+    }
+    return digest;
+}
+
+inline std::string base64_encode(const uint8_t* data, size_t size) {
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((size + 2) / 3 * 4);
+    for (size_t i = 0; i < size; i += 3) {
+        uint32_t n = uint32_t(data[i]) << 16;
+        if (i + 1 < size) n |= uint32_t(data[i + 1]) << 8;
+        if (i + 2 < size) n |= uint32_t(data[i + 2]);
+        out.push_back(table[(n >> 18) & 0x3F]);
+        out.push_back(table[(n >> 12) & 0x3F]);
+        out.push_back(i + 1 < size ? table[(n >> 6) & 0x3F] : '=');
+        out.push_back(i + 2 < size ? table[n & 0x3F] : '=');
+    }
+    return out;
+}
+
+} // namespace detail
+
+// Sec-WebSocket-Accept value for a client's Sec-WebSocket-Key
+inline std::string compute_accept_key(const std::string& client_key) {
+    auto digest = detail::sha1(client_key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
+    return detail::base64_encode(digest.data(), digest.size());
+}
+
+struct FrameHeader {
+    bool fin = false;
+    bool rsv1 = false;
+    bool rsv2 = false;
+    bool rsv3 = false;
+    Opcode opcode = Opcode::Text;
+    bool masked = false;
+    uint8_t mask[4] = {0, 0, 0, 0};
+    uint64_t payload_length = 0;
+    size_t header_size = 0;
+};
+
+inline bool is_control(Opcode opcode) {
+    return (static_cast<int>(opcode) & 0x8) != 0;
+}
+
+// Parses a frame header. Returns false if more bytes are needed.
+inline bool parse_frame_header(const char* data, size_t size, FrameHeader& header) {
+    if (size < 2) return false;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+
+    header.fin = (p[0] & 0x80) != 0;
+    header.rsv1 = (p[0] & 0x40) != 0;
+    header.rsv2 = (p[0] & 0x20) != 0;
+    header.rsv3 = (p[0] & 0x10) != 0;
+    header.opcode = static_cast<Opcode>(p[0] & 0x0F);
+    header.masked = (p[1] & 0x80) != 0;
+
+    size_t pos = 2;
+    uint64_t length = p[1] & 0x7F;
+    if (length == 126) {
+        if (size < pos + 2) return false;
+        length = (uint64_t(p[2]) << 8) | p[3];
+        pos += 2;
+    } else if (length == 127) {
+        if (size < pos + 8) return false;
+        length = 0;
+        for (int i = 0; i < 8; ++i) {
+            length = (length << 8) | p[2 + i];
+        }
+        pos += 8;
+    }
+    if (header.masked) {
+        if (size < pos + 4) return false;
+        std::memcpy(header.mask, p + pos, 4);
+        pos += 4;
+    }
+    header.payload_length = length;
+    header.header_size = pos;
+    return true;
+}
+
+// Appends a frame header for a payload of the given length
+inline void write_frame_header(std::string& out, Opcode opcode, uint64_t length,
+                               bool fin = true, bool rsv1 = false,
+                               const uint8_t* mask = nullptr) {
+    uint8_t first = static_cast<uint8_t>(opcode) & 0x0F;
+    if (fin) first |= 0x80;
+    if (rsv1) first |= 0x40;
+    out.push_back(static_cast<char>(first));
+
+    uint8_t mask_bit = mask ? 0x80 : 0;
+    if (length < 126) {
+        out.push_back(static_cast<char>(mask_bit | length));
+    } else if (length <= 0xFFFF) {
+        out.push_back(static_cast<char>(mask_bit | 126));
+        out.push_back(static_cast<char>((length >> 8) & 0xFF));
+        out.push_back(static_cast<char>(length & 0xFF));
+    } else {
+        out.push_back(static_cast<char>(mask_bit | 127));
+        for (int i = 7; i >= 0; --i) {
+            out.push_back(static_cast<char>((length >> (i * 8)) & 0xFF));
+        }
+    }
+    if (mask) {
+        out.append(reinterpret_cast<const char*>(mask), 4);
+    }
+}
+
+// XORs data with the masking key; offset is the position within the payload
+inline void apply_mask(char* data, size_t size, const uint8_t mask[4], size_t offset = 0) {
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<char>(data[i] ^ mask[(offset + i) & 3]);
+    }
+}
+
+} // namespace websocket
@@ -0,0 +1,238 @@
+#pragma once
+
+// Minimal RFC 6455 client for local testing of the server. connect() blocks
+// through the opening handshake; afterwards the socket is non-blocking and
+// read_message() returns whatever complete messages have arrived, so many
+// clients can be driven from one thread with poll().
+
+#include "deflate.hpp"
+#include "protocol.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+namespace websocket {
+
+class Client {
+public:
+    Client() = default;
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    ~Client() {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+    }
+
+    // Throws std::runtime_error if the connection or handshake fails. With
+    // deflate set, permessage-deflate is offered and incoming compressed
+    // messages are inflated; outgoing messages are always sent uncompressed.
+    void connect(const std::string& host, int port, const std::string& path = "/",
+                 bool deflate = false) {
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* result = nullptr;
+        if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0 || !result) {
+            throw std::runtime_error("cannot resolve " + host);
+        }
+        m_fd = ::socket(result->ai_family, result->ai_socktype | SOCK_CLOEXEC, result->ai_protocol);
+        int rc = m_fd < 0 ? -1 : ::connect(m_fd, result->ai_addr, result->ai_addrlen);
+        ::freeaddrinfo(result);
+        if (rc < 0) {
+            throw std::runtime_error(std::string("connect: ") + std::strerror(errno));
+        }
+        int one = 1;
+        ::setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        uint8_t nonce[16];
+        for (auto& byte : nonce) {
+            byte = static_cast<uint8_t>(m_random());
+        }
+        std::string key = detail::base64_encode(nonce, sizeof(nonce));
+        std::string request =
+            "GET " + path + " HTTP/1.1\r\n"
+            "Host: " + host + ":" + std::to_string(port) + "\r\n"
+            "Upgrade: websocket\r\n"
+            "Connection: Upgrade\r\n"
+            "Sec-WebSocket-Key: " + key + "\r\n"
+            "Sec-WebSocket-Version: 13\r\n";
+        if (deflate) {
+            request += "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n";
+        }
+        request += "\r\n";
+        write_all(request.data(), request.size());
+
+        // The server may send its first frames right behind the response
+        size_t end;
+        while ((end = m_in.find("\r\n\r\n")) == std::string::npos) {
+            if (!read_some(true)) {
+                throw std::runtime_error("connection closed during handshake");
+            }
+        }
+        std::string response = m_in.substr(0, end);
+        m_in.erase(0, end + 4);
+        if (response.compare(0, 12, "HTTP/1.1 101") != 0 ||
+            response.find(compute_accept_key(key)) == std::string::npos) {
+            throw std::runtime_error("handshake rejected: " + response.substr(0, response.find("\r\n")));
+        }
+        m_deflate = deflate && response.find("permessage-deflate") != std::string::npos;
+
+        int flags = ::fcntl(m_fd, F_GETFL, 0);
+        ::fcntl(m_fd, F_SETFL, flags | O_NONBLOCK);
+        m_open = true;
+    }
+
+    void send(const std::string& message, Opcode opcode = Opcode::Text) {
+        uint8_t mask[4];
+        for (auto& byte : mask) {
+            byte = static_cast<uint8_t>(m_random());
+        }
+        std::string frame;
+        write_frame_header(frame, opcode, message.size(), true, false, mask);
+        size_t payload = frame.size();
+        frame.append(message);
+        apply_mask(&frame[payload], message.size(), mask);
+        write_all(frame.data(), frame.size());
+    }
+
+    // Returns true and fills message/opcode if a complete data message is
+    // available. Pings are answered and pongs recorded along the way.
+    bool read_message(std::string& message, Opcode& opcode) {
+        if (m_open) {
+            read_some(false);
+        }
+        for (;;) {
+            FrameHeader header;
+            size_t available = m_in.size() - m_in_pos;
+            if (!parse_frame_header(m_in.data() + m_in_pos, available, header) ||
+                available < header.header_size + header.payload_length) {
+                // Drop consumed bytes only once nothing more can be parsed
+                m_in.erase(0, m_in_pos);
+                m_in_pos = 0;
+                return false;
+            }
+            std::string payload = m_in.substr(m_in_pos + header.header_size,
+                                              static_cast<size_t>(header.payload_length));
+            m_in_pos += header.header_size + static_cast<size_t>(header.payload_length);
+
+            if (header.opcode == Opcode::Ping) {
+                send(payload, Opcode::Pong);
+            } else if (header.opcode == Opcode::Pong) {
+                m_last_pong = payload;
+                ++m_pongs;
+            } else if (header.opcode == Opcode::Close) {
+                if (m_open) {
+                    send(payload, Opcode::Close);
+                }
+                m_open = false;
+            } else {
+                if (header.opcode != Opcode::Continuation) {
+                    m_message.clear();
+                    m_message_opcode = header.opcode;
+                    m_message_compressed = header.rsv1;
+                }
+                m_message.append(payload);
+                if (header.fin) {
+                    if (m_message_compressed) {
+                        if (!m_inflater) {
+                            m_inflater = std::make_unique<Inflater>();
+                        }
+                        if (!m_inflater->decompress(m_message, message, SIZE_MAX)) {
+                            throw std::runtime_error("corrupt compressed message");
+                        }
+                    } else {
+                        message.swap(m_message);
+                    }
+                    m_message.clear();
+                    opcode = m_message_opcode;
+                    return true;
+                }
+            }
+        }
+    }
+
+    void close(uint16_t code = close_code::normal) {
+        if (m_open) {
+            std::string payload = {static_cast<char>(code >> 8), static_cast<char>(code & 0xFF)};
+            send(payload, Opcode::Close);
+            m_open = false;
+        }
+    }
+
+    bool is_open() const { return m_open; }
+    bool deflate() const { return m_deflate; }
+    // Bytes read from the socket after the handshake, i.e. on the wire
+    uint64_t bytes_received() const { return m_bytes_received; }
+    int fd() const { return m_fd; }
+    const std::string& last_pong() const { return m_last_pong; }
+    uint64_t pong_count() const { return m_pongs; }
+
+private:
+    int m_fd = -1;
+    bool m_open = false;
+    std::string m_in;
+    size_t m_in_pos = 0;    // Start of the first unparsed frame in m_in
+    std::string m_message;
+    Opcode m_message_opcode = Opcode::Text;
+    bool m_message_compressed = false;
+    bool m_deflate = false;
+    std::unique_ptr<Inflater> m_inflater;
+    uint64_t m_bytes_received = 0;
+    std::string m_last_pong;
+    uint64_t m_pongs = 0;
+    std::minstd_rand m_random{std::random_device{}()};
+
+    // Returns false once the peer has closed the connection
+    bool read_some(bool blocking) {
+        char buffer[16384];
+        for (;;) {
+            ssize_t n = ::recv(m_fd, buffer, sizeof(buffer), 0);
+            if (n > 0) {
+                m_in.append(buffer, static_cast<size_t>(n));
+                if (m_open) m_bytes_received += static_cast<uint64_t>(n);
+                if (blocking) return true;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+            m_open = false;
+            return false;
+        }
+    }
+
+    void write_all(const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ::send(m_fd, data, size, MSG_NOSIGNAL);
+            if (n > 0) {
+                data += n;
+                size -= static_cast<size_t>(n);
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                pollfd pfd{m_fd, POLLOUT, 0};
+                ::poll(&pfd, 1, 1000);
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                m_open = false;
+                throw std::runtime_error(std::string("send: ") + std::strerror(errno));
+            }
+        }
+    }
+};
+
+} // namespace websocket
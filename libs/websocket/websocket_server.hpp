@@ -1,12 +1,63 @@
 #pragma once
 
-#include <string>
-#include <set>
-#include <functional>
-#include <thread>
+// Single-threaded RFC 6455 WebSocket server on an edge-triggered epoll loop.
+//
+// run() blocks on the calling thread and owns all socket reads, the opening
+// handshake and frame parsing; handlers are invoked from that thread.
+// send(), broadcast() and close() may be called from any thread. Outgoing
+// messages are framed once into an immutable shared buffer; each connection
+// only queues a reference to it, and queues are written with a single
+// sendmsg() per flush (gathering up to max_iov frames) without blocking.
+// Whatever the socket does not accept is flushed when it becomes writable.
+//
+// Output queues are bounded (see QueuePolicy). Frames sent with a non-zero
+// CoalesceKey are latest-wins: a newer frame replaces a queued one with the
+// same key that has not started going out, so a slow client receives fewer
+// state snapshots instead of an ever-growing backlog. A newer frame never
+// replaces one queued ahead of a reliable frame, so it can't overtake a
+// reliable message sent before it. Key 0 frames are never dropped or
+// reordered; if they would overflow the queue, or the socket makes no
+// progress for the stall timeout, the client is disconnected.
+//
+// permessage-deflate is negotiated in no-context-takeover mode for both
+// directions, so each broadcast is compressed at most once and the result is
+// shared by every connection that negotiated it (see CompressionOptions).
+//
+// Plain HTTP GETs (no Upgrade header) from loopback addresses can be
+// answered by an HttpHandler, e.g. for a metrics scrape; the connection is
+// closed after the response.
+//
+// Not supported: other extensions, subprotocols, TLS, and UTF-8 validation of
+// text messages (the application parser validates its own input).
+
+#include "deflate.hpp"
+#include "protocol.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 namespace websocket {
@@ -20,95 +71,949 @@ public:
     }
 };
 
-class Message {
-public:
-    std::string payload;
-    ConnectionHandle handle;
-    
-    Message(const std::string& data, const ConnectionHandle& hdl) 
-        : payload(data), handle(hdl) {}
+// A complete frame (header and payload), shared between every connection
+// it is queued on
+using SharedFrame = std::shared_ptr<const std::string>;
+
+// Frames queued with the same non-zero key supersede each other
+using CoalesceKey = uint8_t;
+constexpr CoalesceKey reliable = 0;
+
+struct QueuePolicy {
+    size_t max_queued_bytes = 1 << 20;  // Per connection
+    int stall_timeout_ms = 5000;        // Data queued but nothing written
+};
+
+struct CompressionOptions {
+    bool enabled = true;        // Accept permessage-deflate offers
+    int level = 1;              // zlib level, 1 (fastest) to 9 (smallest)
+    size_t min_size = 256;      // Smaller messages are sent uncompressed
+};
+
+// A message framed for sending. The deflated variant is only built when a
+// connection negotiated permessage-deflate and compression paid off.
+struct PreparedMessage {
+    SharedFrame plain;
+    SharedFrame deflated;
+};
+
+struct QueueStats {
+    size_t connections = 0;
+    size_t queued_frames = 0;
+    size_t queued_bytes = 0;
+    size_t max_connection_bytes = 0;    // Deepest single queue
+    uint64_t coalesced_frames = 0;      // Superseded before being sent
+    uint64_t overflow_disconnects = 0;
+    uint64_t stall_disconnects = 0;
+    uint64_t sent_frames = 0;           // Written completely, since startup
+    uint64_t sent_bytes = 0;
+};
+
+// One open connection's queue and what it has been sent
+struct ConnectionStats {
+    int id = 0;
+    size_t queued_frames = 0;
+    size_t queued_bytes = 0;
+    uint64_t sent_frames = 0;
+    uint64_t sent_bytes = 0;
 };
 
 using MessageHandler = std::function<void(ConnectionHandle, const std::string&)>;
 using ConnectionHandler = std::function<void(ConnectionHandle)>;
+using ValidateHandler = std::function<bool(ConnectionHandle, const std::string&)>;
+// Given the request target, fills in the content type and body of a 200
+// response; returning false answers 404
+using HttpHandler = std::function<bool(const std::string&, std::string&, std::string&)>;
+// Given a one-line description of a failed system call or a dropped client
+using ErrorHandler = std::function<void(const std::string&)>;
 
 class Server {
-private:
-    std::set<ConnectionHandle> m_connections;
-    MessageHandler m_on_message;
-    ConnectionHandler m_on_open;
-    ConnectionHandler m_on_close;
-    bool m_running = false;
-    int m_next_conn_id = 1;
-    int m_port = 0;
-    
 public:
+    static constexpr size_t max_message_size = 1 << 20;
+    static constexpr size_t max_handshake_size = 8192;
+    static constexpr int max_iov = 64;
+
     Server() = default;
-    
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    ~Server() {
+        stop();
+        close_fd(m_listen_fd);
+        close_fd(m_epoll_fd);
+        close_fd(m_wake_fd);
+    }
+
     void set_message_handler(MessageHandler handler) {
         m_on_message = handler;
     }
-    
+
     void set_open_handler(ConnectionHandler handler) {
         m_on_open = handler;
     }
-    
+
     void set_close_handler(ConnectionHandler handler) {
         m_on_close = handler;
     }
-    
+
+    // Called with the payload of every pong, e.g. to time pings sent with
+    // send(hdl, payload, Opcode::Ping)
+    void set_pong_handler(MessageHandler handler) {
+        m_on_pong = handler;
+    }
+
+    // Called with the request target (e.g. "/match/3") of every valid
+    // upgrade request before it is accepted; returning false answers 404
+    void set_validate_handler(ValidateHandler handler) {
+        m_on_validate = handler;
+    }
+
+    // Called on the loop thread for plain GET requests from loopback
+    // addresses; without one they are answered 400 like any bad handshake
+    void set_http_handler(HttpHandler handler) {
+        m_on_http = handler;
+    }
+
+    // Called on the loop thread, never under a lock; without one errors go
+    // to std::cerr
+    void set_error_handler(ErrorHandler handler) {
+        m_on_error = handler;
+    }
+
+    void set_queue_policy(const QueuePolicy& policy) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_policy = policy;
+    }
+
+    // Applies to connections opened afterwards
+    void set_compression(const CompressionOptions& options) {
+        std::lock_guard<std::mutex> lock(m_deflate_mutex);
+        m_compression = options;
+        m_deflater.reset();
+    }
+
+    // Binds the listening socket; port 0 picks a free port (see port())
     void listen(int port) {
-        m_port = port;
-        std::cout << "WebSocket server configured to listen on port " << port << std::endl;
+        m_listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (m_listen_fd < 0) {
+            throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+        }
+        int one = 1;
+        ::setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        if (::bind(m_listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+            ::listen(m_listen_fd, SOMAXCONN) < 0) {
+            throw std::runtime_error("bind port " + std::to_string(port) + ": " + std::strerror(errno));
+        }
+
+        socklen_t len = sizeof(addr);
+        ::getsockname(m_listen_fd, reinterpret_cast<sockaddr*>(&addr), &len);
+        m_port = ntohs(addr.sin_port);
+
+        m_epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        m_wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_epoll_fd < 0 || m_wake_fd < 0) {
+            throw std::runtime_error(std::string("epoll setup: ") + std::strerror(errno));
+        }
+        watch(m_listen_fd, listen_tag, EPOLLIN | EPOLLET);
+        watch(m_wake_fd, wake_tag, EPOLLIN | EPOLLET);
+
+        m_stop_requested = false;
+        std::cout << "WebSocket server listening on port " << m_port << std::endl;
     }
-    
+
     void run() {
-        m_running = true;
-        std::cout << "WebSocket server running on port " << m_port << std::endl;
-        
-        // Simulate accepting connections
-        std::thread connection_simulator([this]() {
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-            if (m_running && m_on_open) {
-                ConnectionHandle hdl(m_next_conn_id++);
-                m_connections.insert(hdl);
-                m_on_open(hdl);
-            }
-        });
-        connection_simulator.detach();
-        
-        // Keep server running
-        while (m_running) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        }
-    }
-    
+        if (m_epoll_fd < 0) {
+            return;
+        }
+
+        epoll_event events[128];
+        while (!m_stop_requested) {
+            int count = ::epoll_wait(m_epoll_fd, events, 128, stall_check_ms);
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                report_error(std::string("epoll_wait: ") + std::strerror(errno));
+                break;
+            }
+            for (int i = 0; i < count; ++i) {
+                uint64_t tag = events[i].data.u64;
+                if (tag == listen_tag) {
+                    accept_connections();
+                } else if (tag == wake_tag) {
+                    uint64_t value;
+                    while (::read(m_wake_fd, &value, sizeof(value)) > 0) {}
+                    reap_broken_connections();
+                } else {
+                    handle_event(static_cast<int>(tag), events[i].events);
+                }
+            }
+            check_stalled_connections();
+        }
+
+        close_all();
+    }
+
+    // Makes run() return; connections are closed with 1001 (going away)
     void stop() {
-        m_running = false;
-        for (const auto& conn : m_connections) {
-            if (m_on_close) {
-                m_on_close(conn);
+        m_stop_requested = true;
+        wake();
+    }
+
+    // Frames a message once so it can be queued on any number of connections
+    static SharedFrame make_frame(const std::string& message, Opcode opcode = Opcode::Text) {
+        auto frame = std::make_shared<std::string>();
+        frame->reserve(message.size() + 10);
+        write_frame_header(*frame, opcode, message.size());
+        frame->append(message);
+        return frame;
+    }
+
+    // Frames a message once, and compresses it once if any connection can
+    // take the compressed form. Safe to call from any thread.
+    PreparedMessage prepare(const std::string& message, Opcode opcode = Opcode::Text) {
+        PreparedMessage prepared;
+        prepared.plain = make_frame(message, opcode);
+        if (m_deflate_connections.load(std::memory_order_relaxed) == 0 || is_control(opcode)) {
+            return prepared;
+        }
+
+        std::lock_guard<std::mutex> lock(m_deflate_mutex);
+        if (message.size() < m_compression.min_size) {
+            return prepared;
+        }
+        if (!m_deflater) {
+            m_deflater = std::make_unique<Deflater>(m_compression.level);
+        }
+        m_scratch.clear();
+        m_deflater->compress(message.data(), message.size(), m_scratch);
+        if (m_scratch.size() < message.size()) {
+            auto frame = std::make_shared<std::string>();
+            frame->reserve(m_scratch.size() + 10);
+            write_frame_header(*frame, opcode, m_scratch.size(), true, true);
+            frame->append(m_scratch);
+            prepared.deflated = std::move(frame);
+        }
+        return prepared;
+    }
+
+    void send(ConnectionHandle hdl, const std::string& message, Opcode opcode = Opcode::Text) {
+        send_prepared(hdl, prepare(message, opcode));
+    }
+
+    void send_prepared(ConnectionHandle hdl, const PreparedMessage& message, CoalesceKey key = reliable) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_connections.find(hdl.id);
+        if (it != m_connections.end() && it->second->open && !it->second->closing) {
+            queue_locked(*it->second, frame_for(*it->second, message), key);
+        }
+    }
+
+    // Queues the same message on each of the given connections under one lock
+    void send_prepared(const std::vector<ConnectionHandle>& handles, const PreparedMessage& message,
+                       CoalesceKey key = reliable) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& hdl : handles) {
+            auto it = m_connections.find(hdl.id);
+            if (it != m_connections.end() && it->second->open && !it->second->closing) {
+                queue_locked(*it->second, frame_for(*it->second, message), key);
+            }
+        }
+    }
+
+    void broadcast(const std::string& message, Opcode opcode = Opcode::Text,
+                   CoalesceKey key = reliable) {
+        PreparedMessage prepared = prepare(message, opcode);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& entry : m_connections) {
+            Connection& conn = *entry.second;
+            if (conn.open && !conn.closing) {
+                queue_locked(conn, frame_for(conn, prepared), key);
+            }
+        }
+    }
+
+    // Starts the closing handshake; the socket is closed once the close
+    // frame has been written
+    void close(ConnectionHandle hdl, uint16_t code = close_code::normal) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_connections.find(hdl.id);
+        if (it != m_connections.end()) {
+            begin_close_locked(*it->second, code);
+        }
+    }
+
+    // Snapshot of connections that completed the handshake
+    std::set<ConnectionHandle> get_connections() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::set<ConnectionHandle> result;
+        for (const auto& entry : m_connections) {
+            if (entry.second->open) {
+                result.insert(ConnectionHandle(entry.first));
+            }
+        }
+        return result;
+    }
+
+    int port() const { return m_port; }
+
+    QueueStats queue_stats() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        QueueStats stats = m_stats;
+        for (const auto& entry : m_connections) {
+            const Connection& conn = *entry.second;
+            if (!conn.open) continue;
+            ++stats.connections;
+            stats.queued_frames += conn.out.size();
+            stats.queued_bytes += conn.queued_bytes;
+            stats.max_connection_bytes = std::max(stats.max_connection_bytes, conn.queued_bytes);
+        }
+        return stats;
+    }
+
+    // Every connection that completed the handshake
+    std::vector<ConnectionStats> connection_stats() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<ConnectionStats> result;
+        for (const auto& entry : m_connections) {
+            const Connection& conn = *entry.second;
+            if (conn.open) {
+                result.push_back({conn.id, conn.out.size(), conn.queued_bytes, conn.sent_frames, conn.sent_bytes});
+            }
+        }
+        return result;
+    }
+
+private:
+    static constexpr uint64_t listen_tag = ~uint64_t(0);
+    static constexpr uint64_t wake_tag = ~uint64_t(0) - 1;
+    static constexpr int stall_check_ms = 250;
+
+    using Clock = std::chrono::steady_clock;
+
+    struct QueuedFrame {
+        SharedFrame frame;
+        CoalesceKey key;
+    };
+
+    struct Connection {
+        int fd = -1;
+        int id = 0;
+        // Written under m_mutex, possibly from a sending thread, but read by
+        // the loop thread while it parses input without the lock
+        std::atomic<bool> open{false};      // Handshake completed
+        std::atomic<bool> closing{false};   // Close frame queued; drop once flushed
+        bool broken = false;    // Write failed on another thread
+        bool loopback = false;  // Peer is on this machine
+
+        std::string in;                 // Only touched by the loop thread
+        std::deque<QueuedFrame> out;    // Guarded by m_mutex
+        size_t out_offset = 0;          // Bytes of out.front() already written
+        size_t queued_bytes = 0;        // Unwritten bytes in out
+        uint64_t sent_frames = 0;       // Guarded by m_mutex, like out
+        uint64_t sent_bytes = 0;
+        Clock::time_point last_progress;
+
+        // Reassembly of fragmented messages
+        std::string message;
+        Opcode message_opcode = Opcode::Text;
+        bool in_message = false;
+        bool message_compressed = false;
+
+        bool deflate = false;   // Negotiated permessage-deflate
+    };
+
+    int m_listen_fd = -1;
+    int m_epoll_fd = -1;
+    int m_wake_fd = -1;
+    int m_port = 0;
+    int m_next_conn_id = 1;
+    std::atomic<bool> m_stop_requested{false};
+
+    // Connections are only inserted and erased on the loop thread, with the
+    // lock held, so the loop may use them without locking in between
+    mutable std::mutex m_mutex;
+    std::map<int, std::unique_ptr<Connection>> m_connections;
+    QueuePolicy m_policy;
+    QueueStats m_stats;     // Only the counters are kept up to date
+    // Why connections were dropped, reported by the loop thread once the
+    // lock is released so senders never wait on the error handler
+    std::vector<std::string> m_notices;
+
+    // Outgoing compression may run on any sending thread
+    std::mutex m_deflate_mutex;
+    CompressionOptions m_compression;
+    std::unique_ptr<Deflater> m_deflater;
+    std::string m_scratch;
+    std::atomic<int> m_deflate_connections{0};
+
+    // Incoming messages are only decompressed on the loop thread
+    Inflater m_inflater;
+    std::string m_inflated;
+    Clock::time_point m_last_stall_check;
+
+    MessageHandler m_on_message;
+    ConnectionHandler m_on_open;
+    ConnectionHandler m_on_close;
+    MessageHandler m_on_pong;
+    ValidateHandler m_on_validate;
+    HttpHandler m_on_http;
+    ErrorHandler m_on_error;
+
+    static void close_fd(int& fd) {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    void watch(int fd, uint64_t tag, uint32_t events) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.u64 = tag;
+        ::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    void wake() {
+        if (m_wake_fd >= 0) {
+            uint64_t one = 1;
+            ssize_t ignored = ::write(m_wake_fd, &one, sizeof(one));
+            (void)ignored;
+        }
+    }
+
+    Connection* find(int id) {
+        auto it = m_connections.find(id);
+        return it == m_connections.end() ? nullptr : it->second.get();
+    }
+
+    void accept_connections() {
+        for (;;) {
+            sockaddr_in peer{};
+            socklen_t peer_len = sizeof(peer);
+            int fd = ::accept4(m_listen_fd, reinterpret_cast<sockaddr*>(&peer), &peer_len,
+                               SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    report_error(std::string("accept: ") + std::strerror(errno));
+                }
+                return;
+            }
+            int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            auto conn = std::make_unique<Connection>();
+            conn->fd = fd;
+            conn->id = m_next_conn_id++;
+            conn->loopback = (ntohl(peer.sin_addr.s_addr) >> 24) == 127;
+            conn->last_progress = Clock::now();
+            int id = conn->id;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_connections[id] = std::move(conn);
+            }
+            watch(fd, static_cast<uint64_t>(id), EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+        }
+    }
+
+    void handle_event(int id, uint32_t events) {
+        Connection* conn = find(id);
+        if (!conn) {
+            return;
+        }
+
+        bool alive = !(events & EPOLLERR);
+        if (alive && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))) {
+            alive = read_available(*conn);
+        }
+        if (alive && (events & EPOLLOUT)) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            flush_locked(*conn);
+        }
+
+        bool done;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            done = !alive || conn->broken || (conn->closing && conn->out.empty());
+        }
+        if (done) {
+            close_connection(id);
+        }
+    }
+
+    // Returns false once the peer has gone away. Input is parsed after every
+    // read so the buffer never holds more than one partial frame.
+    bool read_available(Connection& conn) {
+        char buffer[16384];
+        for (;;) {
+            ssize_t n = ::recv(conn.fd, buffer, sizeof(buffer), 0);
+            if (n == 0) {
+                return false;
+            }
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+
+            conn.in.append(buffer, static_cast<size_t>(n));
+            if (!conn.open && !conn.closing) {
+                process_handshake(conn);
+            }
+            if (conn.open) {
+                process_frames(conn);
+            }
+            if (conn.closing) {
+                conn.in.clear();
+            }
+        }
+    }
+
+    void report_error(const std::string& error) {
+        if (m_on_error) {
+            m_on_error(error);
+        } else {
+            std::cerr << error << std::endl;
+        }
+    }
+
+    static std::string lowercase(std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return s;
+    }
+
+    static std::string trim(const std::string& s) {
+        size_t begin = s.find_first_not_of(" \t");
+        size_t end = s.find_last_not_of(" \t");
+        return begin == std::string::npos ? std::string() : s.substr(begin, end - begin + 1);
+    }
+
+    // Sends a complete HTTP response and closes once it is written
+    void respond_and_close(Connection& conn, const char* status, const std::string& extra_headers,
+                           const std::string& body) {
+        std::string response = std::string("HTTP/1.1 ") + status + "\r\n" + extra_headers +
+                               "Connection: close\r\nContent-Length: " + std::to_string(body.size()) +
+                               "\r\n\r\n" + body;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        queue_locked(conn, std::make_shared<const std::string>(std::move(response)), reliable);
+        conn.closing = true;
+    }
+
+    void reject_handshake(Connection& conn, const char* status, const char* extra_headers = "") {
+        respond_and_close(conn, status, extra_headers, std::string());
+    }
+
+    void answer_http(Connection& conn, const std::string& target) {
+        if (!conn.loopback) {
+            reject_handshake(conn, "403 Forbidden");
+            return;
+        }
+        std::string content_type;
+        std::string body;
+        if (!m_on_http(target, content_type, body)) {
+            reject_handshake(conn, "404 Not Found");
+            return;
+        }
+        respond_and_close(conn, "200 OK", "Content-Type: " + content_type + "\r\n", body);
+    }
+
+    void process_handshake(Connection& conn) {
+        size_t end = conn.in.find("\r\n\r\n");
+        if (end == std::string::npos) {
+            if (conn.in.size() > max_handshake_size) {
+                reject_handshake(conn, "431 Request Header Fields Too Large");
+            }
+            return;
+        }
+
+        std::string request = conn.in.substr(0, end + 2);
+        conn.in.erase(0, end + 4);
+
+        size_t line_end = request.find("\r\n");
+        std::string request_line = request.substr(0, line_end);
+        if (request_line.compare(0, 4, "GET ") != 0 ||
+            request_line.find(" HTTP/1.1") == std::string::npos) {
+            reject_handshake(conn, "400 Bad Request");
+            return;
+        }
+
+        std::map<std::string, std::string> headers;
+        size_t pos = line_end + 2;
+        while (pos < request.size()) {
+            size_t next = request.find("\r\n", pos);
+            std::string line = request.substr(pos, next - pos);
+            pos = next + 2;
+            size_t colon = line.find(':');
+            if (colon != std::string::npos) {
+                // Repeated headers combine into one comma-separated list
+                std::string& value = headers[lowercase(trim(line.substr(0, colon)))];
+                value += (value.empty() ? "" : ", ") + trim(line.substr(colon + 1));
+            }
+        }
+
+        std::string target = request_line.substr(4, request_line.rfind(' ') - 4);
+        if (m_on_http && headers.find("upgrade") == headers.end()) {
+            answer_http(conn, target);
+            return;
+        }
+
+        std::string key = headers["sec-websocket-key"];
+        if (lowercase(headers["upgrade"]) != "websocket" ||
+            lowercase(headers["connection"]).find("upgrade") == std::string::npos ||
+            key.size() != 24) {
+            reject_handshake(conn, "400 Bad Request");
+            return;
+        }
+        if (headers["sec-websocket-version"] != "13") {
+            reject_handshake(conn, "426 Upgrade Required", "Sec-WebSocket-Version: 13\r\n");
+            return;
+        }
+
+        if (m_on_validate && !m_on_validate(ConnectionHandle(conn.id), target)) {
+            reject_handshake(conn, "404 Not Found");
+            return;
+        }
+
+        bool enabled;
+        {
+            std::lock_guard<std::mutex> lock(m_deflate_mutex);
+            enabled = m_compression.enabled;
+        }
+        bool deflate = enabled && accepts_permessage_deflate(headers["sec-websocket-extensions"]);
+
+        std::string response =
+            "HTTP/1.1 101 Switching Protocols\r\n"
+            "Upgrade: websocket\r\n"
+            "Connection: Upgrade\r\n"
+            "Sec-WebSocket-Accept: " + compute_accept_key(key) + "\r\n";
+        if (deflate) {
+            response += "Sec-WebSocket-Extensions: permessage-deflate; "
+                        "server_no_context_takeover; client_no_context_takeover\r\n";
+        }
+        response += "\r\n";
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            queue_locked(conn, std::make_shared<const std::string>(std::move(response)), reliable);
+            conn.open = true;
+            conn.deflate = deflate;
+        }
+        if (deflate) {
+            ++m_deflate_connections;
+        }
+
+        if (m_on_open) {
+            m_on_open(ConnectionHandle(conn.id));
+        }
+    }
+
+    void fail_connection(Connection& conn, uint16_t code) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        begin_close_locked(conn, code);
+    }
+
+    void process_frames(Connection& conn) {
+        size_t pos = 0;
+        while (!conn.closing) {
+            FrameHeader header;
+            if (!parse_frame_header(conn.in.data() + pos, conn.in.size() - pos, header)) {
+                break;
+            }
+
+            Opcode op = header.opcode;
+            bool known = op == Opcode::Continuation || op == Opcode::Text || op == Opcode::Binary ||
+                         op == Opcode::Close || op == Opcode::Ping || op == Opcode::Pong;
+            // RSV1 marks a compressed message and is only valid on its first frame
+            bool compressed_start = conn.deflate && (op == Opcode::Text || op == Opcode::Binary);
+            if (!header.masked || (header.rsv1 && !compressed_start) || header.rsv2 || header.rsv3 || !known ||
+                (is_control(op) && (!header.fin || header.payload_length > 125))) {
+                fail_connection(conn, close_code::protocol_error);
+                break;
+            }
+            if (header.payload_length > max_message_size ||
+                conn.message.size() + header.payload_length > max_message_size) {
+                fail_connection(conn, close_code::too_big);
+                break;
+            }
+
+            size_t frame_size = header.header_size + static_cast<size_t>(header.payload_length);
+            if (conn.in.size() - pos < frame_size) {
+                break;
+            }
+
+            char* payload = &conn.in[pos + header.header_size];
+            size_t length = static_cast<size_t>(header.payload_length);
+            apply_mask(payload, length, header.mask);
+            pos += frame_size;
+
+            if (op == Opcode::Ping) {
+                SharedFrame pong = make_frame(std::string(payload, length), Opcode::Pong);
+                std::lock_guard<std::mutex> lock(m_mutex);
+                queue_locked(conn, pong, reliable);
+            } else if (op == Opcode::Pong) {
+                // Unsolicited pongs are allowed; the handler decides what
+                // the payload means
+                if (m_on_pong) {
+                    m_on_pong(ConnectionHandle(conn.id), std::string(payload, length));
+                }
+            } else if (op == Opcode::Close) {
+                // An empty close is answered 1000; a lone byte or a code
+                // that may not be sent is a protocol error, never echoed
+                uint16_t code = close_code::normal;
+                if (length == 1) {
+                    code = close_code::protocol_error;
+                } else if (length >= 2) {
+                    code = static_cast<uint16_t>((static_cast<unsigned char>(payload[0]) << 8) |
+                                                 static_cast<unsigned char>(payload[1]));
+                    if (!close_code::valid_on_wire(code)) {
+                        code = close_code::protocol_error;
+                    }
+                }
+                fail_connection(conn, code);
+            } else if (op == Opcode::Continuation) {
+                if (!conn.in_message) {
+                    fail_connection(conn, close_code::protocol_error);
+                    break;
+                }
+                conn.message.append(payload, length);
+                if (header.fin) {
+                    deliver(conn);
+                }
+            } else {
+                if (conn.in_message) {
+                    fail_connection(conn, close_code::protocol_error);
+                    break;
+                }
+                conn.message.assign(payload, length);
+                conn.message_opcode = op;
+                conn.message_compressed = header.rsv1;
+                conn.in_message = true;
+                if (header.fin) {
+                    deliver(conn);
+                }
             }
         }
-        m_connections.clear();
+        conn.in.erase(0, pos);
     }
-    
-    void send(ConnectionHandle hdl, const std::string& message) {
-        if (m_connections.find(hdl) != m_connections.end()) {
-            std::cout << "Sending to connection " << hdl.id << ": " 
-                      << message.substr(0, 50) << "..." << std::endl;
+
+    void deliver(Connection& conn) {
+        conn.in_message = false;
+        const std::string* message = &conn.message;
+        if (conn.message_compressed) {
+            if (!m_inflater.decompress(conn.message, m_inflated, max_message_size)) {
+                bool too_big = m_inflated.size() > max_message_size;
+                fail_connection(conn, too_big ? close_code::too_big : close_code::protocol_error);
+                conn.message.clear();
+                return;
+            }
+            message = &m_inflated;
+        }
+        if (m_on_message) {
+            m_on_message(ConnectionHandle(conn.id), *message);
         }
+        conn.message.clear();
     }
-    
-    void broadcast(const std::string& message) {
-        for (const auto& conn : m_connections) {
-            send(conn, message);
+
+    static const SharedFrame& frame_for(const Connection& conn, const PreparedMessage& message) {
+        return conn.deflate && message.deflated ? message.deflated : message.plain;
+    }
+
+    void queue_locked(Connection& conn, const SharedFrame& frame, CoalesceKey key) {
+        if (conn.broken) {
+            return;
+        }
+
+        if (key != reliable) {
+            // Replace a superseded frame that hasn't started going out. Only
+            // frames queued after the last reliable one are candidates, so a
+            // newer frame never overtakes a reliable message sent before it.
+            size_t first = conn.out_offset > 0 ? 1 : 0;
+            for (size_t i = conn.out.size(); i-- > first;) {
+                QueuedFrame& queued = conn.out[i];
+                if (queued.key == reliable) {
+                    break;
+                }
+                if (queued.key == key) {
+                    conn.queued_bytes = conn.queued_bytes - queued.frame->size() + frame->size();
+                    queued.frame = frame;
+                    ++m_stats.coalesced_frames;
+                    return;
+                }
+            }
+        }
+
+        // A single oversized frame is allowed through an empty queue
+        if (!conn.out.empty() && conn.queued_bytes + frame->size() > m_policy.max_queued_bytes) {
+            m_notices.push_back("Disconnecting client " + std::to_string(conn.id) + ": send queue full (" +
+                                std::to_string(conn.queued_bytes) + " bytes)");
+            ++m_stats.overflow_disconnects;
+            drop_locked(conn);
+            return;
         }
+
+        bool idle = conn.out.empty();
+        conn.out.push_back(QueuedFrame{frame, key});
+        conn.queued_bytes += frame->size();
+        if (idle) {
+            // A non-empty queue means the socket is full and EPOLLOUT will
+            // flush it
+            conn.last_progress = Clock::now();
+            flush_locked(conn);
+        }
+    }
+
+    // Hard close: queued data is discarded and the loop reaps the socket
+    void drop_locked(Connection& conn) {
+        conn.broken = true;
+        conn.out.clear();
+        conn.out_offset = 0;
+        conn.queued_bytes = 0;
+        wake();
     }
-    
-    const std::set<ConnectionHandle>& get_connections() const {
-        return m_connections;
+
+    void check_stalled_connections() {
+        Clock::time_point now = Clock::now();
+        if (now - m_last_stall_check < std::chrono::milliseconds(stall_check_ms)) {
+            return;
+        }
+        m_last_stall_check = now;
+
+        bool dropped = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto timeout = std::chrono::milliseconds(m_policy.stall_timeout_ms);
+            for (auto& entry : m_connections) {
+                Connection& conn = *entry.second;
+                // Connections that never finish the handshake count as stalled too
+                bool waiting = !conn.out.empty() || !conn.open;
+                if (waiting && !conn.broken && now - conn.last_progress > timeout) {
+                    m_notices.push_back("Disconnecting client " + std::to_string(conn.id) + ": no progress for " +
+                                        std::to_string(m_policy.stall_timeout_ms) + " ms");
+                    ++m_stats.stall_disconnects;
+                    drop_locked(conn);
+                    dropped = true;
+                }
+            }
+        }
+        if (dropped) {
+            reap_broken_connections();
+        }
+    }
+
+    void begin_close_locked(Connection& conn, uint16_t code) {
+        if (conn.closing) {
+            return;
+        }
+        if (conn.open) {
+            std::string payload = {static_cast<char>(code >> 8), static_cast<char>(code & 0xFF)};
+            queue_locked(conn, make_frame(payload, Opcode::Close), reliable);
+        }
+        conn.closing = true;
+        wake();
+    }
+
+    void flush_locked(Connection& conn) {
+        iovec iov[max_iov];
+        while (!conn.out.empty() && !conn.broken) {
+            int count = 0;
+            for (auto it = conn.out.begin(); it != conn.out.end() && count < max_iov; ++it, ++count) {
+                size_t skip = count == 0 ? conn.out_offset : 0;
+                iov[count].iov_base = const_cast<char*>(it->frame->data() + skip);
+                iov[count].iov_len = it->frame->size() - skip;
+            }
+
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = static_cast<size_t>(count);
+            ssize_t n = ::sendmsg(conn.fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    conn.broken = true;
+                    wake();
+                }
+                return;
+            }
+
+            // Release every frame that went out completely
+            size_t written = static_cast<size_t>(n);
+            conn.queued_bytes -= written;
+            conn.last_progress = Clock::now();
+            while (written > 0) {
+                size_t remaining = conn.out.front().frame->size() - conn.out_offset;
+                if (written < remaining) {
+                    conn.out_offset += written;
+                    return;
+                }
+                written -= remaining;
+                ++conn.sent_frames;
+                conn.sent_bytes += conn.out.front().frame->size();
+                ++m_stats.sent_frames;
+                m_stats.sent_bytes += conn.out.front().frame->size();
+                conn.out.pop_front();
+                conn.out_offset = 0;
+            }
+        }
+    }
+
+    void reap_broken_connections() {
+        std::vector<int> dead;
+        std::vector<std::string> notices;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const auto& entry : m_connections) {
+                const Connection& conn = *entry.second;
+                if (conn.broken || (conn.closing && conn.out.empty())) {
+                    dead.push_back(entry.first);
+                }
+            }
+            notices.swap(m_notices);
+        }
+        for (const std::string& notice : notices) {
+            report_error(notice);
+        }
+        for (int id : dead) {
+            close_connection(id);
+        }
+    }
+
+    void close_connection(int id) {
+        bool was_open = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_connections.find(id);
+            if (it == m_connections.end()) {
+                return;
+            }
+            was_open = it->second->open;
+            if (it->second->deflate) {
+                --m_deflate_connections;
+            }
+            ::epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, it->second->fd, nullptr);
+            ::close(it->second->fd);
+            m_connections.erase(it);
+        }
+        if (was_open && m_on_close) {
+            m_on_close(ConnectionHandle(id));
+        }
+    }
+
+    void close_all() {
+        std::vector<int> ids;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto& entry : m_connections) {
+                begin_close_locked(*entry.second, close_code::going_away);
+                ids.push_back(entry.first);
+            }
+        }
+        for (int id : ids) {
+            close_connection(id);
+        }
     }
 };
 
-} // namespace websocket
\ No newline at end of file
+} // namespace websocket
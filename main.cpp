@@ -1,14 +1,117 @@
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
-#include "GameWorld.h"
+#include <string>
+#include <thread>
+#include "Log.h"
+#include "MatchHost.h"
+
+// Usage: Celestial_Siege [--port P] [--matches N] [--workers W] [--headless] [--ticks T]
+//                        [--seed S] [--record DIR] [--log-level debug|info|warn|error]
+//                        [--profile] [--trace-dir DIR] [--trace-seconds S]
+//                        [--stress-enemies N] [--stress-towers COLSxROWS]
+//                        [--stress-spacing D] [--stress-projectiles HZ]
+//
+// With --profile, SIGUSR1 saves a Chrome trace of the last few seconds. The
+// --stress options add synthetic load to every match (see StressScenario).
+
+namespace {
+
+std::atomic<MatchHost*> g_host{nullptr};
+
+void onSignal(int) {
+    if (MatchHost* host = g_host.load()) {
+        host->stop();
+    }
+}
+
+void onTraceSignal(int) {
+    if (MatchHost* host = g_host.load()) {
+        host->requestTrace();
+    }
+}
+
+MatchHostOptions parseOptions(int argc, char** argv) {
+    MatchHostOptions options;
+    // The thread calling run() ticks matches as well
+    options.workers = std::max(1, static_cast<int>(std::thread::hardware_concurrency())) - 1;
+    LogLevel level;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--port" && hasValue) {
+            options.port = std::atoi(argv[++i]);
+        } else if (arg == "--matches" && hasValue) {
+            options.matches = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--workers" && hasValue) {
+            options.workers = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--ticks" && hasValue) {
+            options.ticks = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--record" && hasValue) {
+            options.recordDir = argv[++i];
+        } else if (arg == "--profile") {
+            options.profile = true;
+        } else if (arg == "--trace-dir" && hasValue) {
+            options.traceDir = argv[++i];
+        } else if (arg == "--trace-seconds" && hasValue) {
+            options.traceSeconds = std::max(0.1, std::atof(argv[++i]));
+        } else if (arg == "--stress-enemies" && hasValue) {
+            options.stress.enemies = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--stress-towers" && hasValue &&
+                   std::sscanf(argv[i + 1], "%dx%d", &options.stress.towerColumns, &options.stress.towerRows) == 2) {
+            ++i;
+        } else if (arg == "--stress-spacing" && hasValue) {
+            options.stress.towerSpacing = std::max(1.0, std::atof(argv[++i]));
+        } else if (arg == "--stress-projectiles" && hasValue) {
+            options.stress.projectileRate = std::max(0.0, std::atof(argv[++i]));
+        } else if (arg == "--log-level" && hasValue && Log::parseLevel(argv[i + 1], level)) {
+            Log::setLevel(level);
+            ++i;
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--port P] [--matches N] [--workers W] [--headless] [--ticks T]"
+                      << " [--seed S] [--record DIR] [--log-level debug|info|warn|error]"
+                      << " [--profile] [--trace-dir DIR] [--trace-seconds S]"
+                      << " [--stress-enemies N] [--stress-towers COLSxROWS] [--stress-spacing D]"
+                      << " [--stress-projectiles HZ]" << std::endl;
+            std::exit(2);
+        }
+    }
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    MatchHostOptions options = parseOptions(argc, argv);
 
-int main() {
     std::cout << "Celestial Siege - Tower Defense Game" << std::endl;
-    std::cout << "Starting game..." << std::endl;
-    
-    GameWorld world;
-    world.init();
-    world.run();
-    
-    std::cout << "\nGame Over!" << std::endl;
+    std::cout << "Planets create gravitational fields that affect all objects" << std::endl;
+    std::cout << "Dynamic terrain using Game of Life cellular automata" << std::endl;
+    std::cout << "Enemies use gravity-aware A* pathfinding" << std::endl;
+
+    try {
+        MatchHost host(options);
+        g_host.store(&host);
+        std::signal(SIGINT, onSignal);
+        std::signal(SIGTERM, onSignal);
+        std::signal(SIGUSR1, onTraceSignal);
+        host.run();
+        g_host.store(nullptr);
+    } catch (const std::exception& e) {
+        Log::flush();
+        std::cerr << "Server error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    Log::flush();
+    std::cout << "Server stopped" << std::endl;
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,106 @@
+#include "Allocations.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+constexpr unsigned STRIPES = 16;
+
+struct alignas(64) Stripe {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> phaseCount[PHASE_COUNT] = {};
+    std::atomic<uint64_t> phaseBytes[PHASE_COUNT] = {};
+};
+
+Stripe g_stripes[STRIPES];
+std::atomic<unsigned> g_nextStripe{0};
+// Plain data, so using it never allocates or runs an initializer
+thread_local unsigned t_stripe = STRIPES;
+
+Stripe& stripe() {
+    if (t_stripe == STRIPES) {
+        t_stripe = g_nextStripe.fetch_add(1, std::memory_order_relaxed) % STRIPES;
+    }
+    return g_stripes[t_stripe];
+}
+
+void record(std::size_t size) {
+    Stripe& counts = stripe();
+    counts.count.fetch_add(1, std::memory_order_relaxed);
+    counts.bytes.fetch_add(size, std::memory_order_relaxed);
+    size_t phase = static_cast<size_t>(Profiler::currentPhase());
+    if (phase < PHASE_COUNT) {
+        counts.phaseCount[phase].fetch_add(1, std::memory_order_relaxed);
+        counts.phaseBytes[phase].fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+} // namespace
+
+// The array and nothrow forms the library provides call these, so they are
+// counted too
+void* operator new(std::size_t size) {
+    record(size);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// Types aligned beyond what malloc guarantees, e.g. alignas(64)
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    record(size);
+    size_t align = static_cast<size_t>(alignment);
+    // aligned_alloc wants a multiple of the alignment
+    size_t rounded = (std::max<size_t>(size, 1) + align - 1) / align * align;
+    if (void* p = std::aligned_alloc(align, rounded)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+uint64_t Allocations::count() {
+    uint64_t total = 0;
+    for (const Stripe& counts : g_stripes) {
+        total += counts.count.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t Allocations::bytes() {
+    uint64_t total = 0;
+    for (const Stripe& counts : g_stripes) {
+        total += counts.bytes.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+Allocations::ByPhase Allocations::byPhase() {
+    ByPhase total;
+    for (const Stripe& counts : g_stripes) {
+        for (size_t i = 0; i < PHASE_COUNT; ++i) {
+            total[i].count += counts.phaseCount[i].load(std::memory_order_relaxed);
+            total[i].bytes += counts.phaseBytes[i].load(std::memory_order_relaxed);
+        }
+    }
+    return total;
+}
@@ -0,0 +1,171 @@
+#include "BinaryProtocol.h"
+#include "CellularAutomata.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+uint16_t quantizeUnsigned(double value, double min, double max) {
+    double t = (value - min) / (max - min);
+    t = std::clamp(t, 0.0, 1.0);
+    return static_cast<uint16_t>(std::lround(t * 65535.0));
+}
+
+int16_t quantizeSigned(double value, double limit) {
+    double t = std::clamp(value / limit, -1.0, 1.0);
+    return static_cast<int16_t>(std::lround(t * 32767.0));
+}
+
+} // namespace
+
+void BinaryProtocol::encodeState(std::string& out,
+                                 const StateHeader& header,
+                                 const std::vector<EntityState>& entities,
+                                 const CellularAutomata* terrain,
+                                 const Quantization* quantization,
+                                 bool partial) {
+    out.clear();
+    BinaryWriter writer(out);
+
+    uint8_t flags = 0;
+    if (quantization) flags |= FLAG_QUANTIZED;
+    if (terrain) flags |= FLAG_TERRAIN;
+    if (partial) flags |= FLAG_PARTIAL;
+
+    writer.writeU8(MSG_STATE);
+    writer.writeU8(SCHEMA_VERSION);
+    writer.writeU8(flags);
+    writer.writeU8(header.gameState);
+    writer.writeI32(header.playerHealth);
+    writer.writeI32(header.playerResources);
+    writer.writeU16(static_cast<uint16_t>(header.currentWave));
+    writer.writeU16(static_cast<uint16_t>(header.maxWaves));
+    writer.writeU32(header.tick);
+    writer.writeU32(header.time);
+
+    if (quantization) {
+        writer.writeF32(static_cast<float>(quantization->minX));
+        writer.writeF32(static_cast<float>(quantization->minY));
+        writer.writeF32(static_cast<float>(quantization->maxX));
+        writer.writeF32(static_cast<float>(quantization->maxY));
+        writer.writeF32(static_cast<float>(quantization->maxSpeed));
+    }
+
+    writer.writeU32(static_cast<uint32_t>(entities.size()));
+    for (const auto& entity : entities) {
+        encodeEntity(writer, entity, quantization);
+    }
+
+    if (terrain) {
+        encodeTerrain(writer, *terrain);
+    }
+}
+
+size_t BinaryProtocol::entitySize(const EntityState& entity, const Quantization* quantization) {
+    thread_local std::string scratch;
+    scratch.clear();
+    BinaryWriter writer(scratch);
+    encodeEntity(writer, entity, quantization);
+    return scratch.size();
+}
+
+void BinaryProtocol::encodeTerrainMessage(std::string& out, uint32_t tick,
+                                          const CellularAutomata& terrain) {
+    out.clear();
+    BinaryWriter writer(out);
+    writer.writeU8(MSG_TERRAIN);
+    writer.writeU8(SCHEMA_VERSION);
+    writer.writeU32(tick);
+    encodeTerrain(writer, terrain);
+}
+
+void BinaryProtocol::encodeProjectileEvents(std::string& out, uint32_t tick,
+                                            const std::vector<ProjectileSpawn>& spawns,
+                                            const std::vector<ProjectileRemoval>& removals) {
+    out.clear();
+    BinaryWriter writer(out);
+    writer.writeU8(MSG_PROJECTILES);
+    writer.writeU8(SCHEMA_VERSION);
+    writer.writeU32(tick);
+    writer.writeU32(static_cast<uint32_t>(spawns.size()));
+    for (const ProjectileSpawn& spawn : spawns) {
+        writer.writeU32(static_cast<uint32_t>(spawn.id));
+        writer.writeU32(spawn.tick);
+        writer.writeF64(spawn.position.x);
+        writer.writeF64(spawn.position.y);
+        writer.writeF64(spawn.velocity.x);
+        writer.writeF64(spawn.velocity.y);
+    }
+    writer.writeU32(static_cast<uint32_t>(removals.size()));
+    for (const ProjectileRemoval& removal : removals) {
+        writer.writeU32(static_cast<uint32_t>(removal.id));
+        writer.writeU32(removal.tick);
+        writer.writeU8(removal.hit ? 1 : 0);
+    }
+}
+
+void BinaryProtocol::encodeEntity(BinaryWriter& writer, const EntityState& entity,
+                                  const Quantization* quantization) {
+    writer.writeU32(static_cast<uint32_t>(entity.id));
+    writer.writeU8(static_cast<uint8_t>(entity.type));
+    writer.writeU32(entity.fields);
+
+    if (quantization) {
+        writer.writeU16(quantizeUnsigned(entity.position.x, quantization->minX, quantization->maxX));
+        writer.writeU16(quantizeUnsigned(entity.position.y, quantization->minY, quantization->maxY));
+        writer.writeI16(quantizeSigned(entity.velocity.x, quantization->maxSpeed));
+        writer.writeI16(quantizeSigned(entity.velocity.y, quantization->maxSpeed));
+    } else {
+        writer.writeF32(static_cast<float>(entity.position.x));
+        writer.writeF32(static_cast<float>(entity.position.y));
+        writer.writeF32(static_cast<float>(entity.velocity.x));
+        writer.writeF32(static_cast<float>(entity.velocity.y));
+    }
+
+    // Payloads follow in EntityField bit order
+    if (entity.has(FIELD_ENEMY_TYPE)) writer.writeU8(static_cast<uint8_t>(entity.enemyType));
+    if (entity.has(FIELD_TOWER_TYPE)) writer.writeU8(static_cast<uint8_t>(entity.towerType));
+    if (entity.has(FIELD_HEALTH)) writer.writeF32(static_cast<float>(entity.health));
+    if (entity.has(FIELD_MAX_HEALTH)) writer.writeF32(static_cast<float>(entity.maxHealth));
+    if (entity.has(FIELD_PATH_LENGTH)) {
+        writer.writeU16(static_cast<uint16_t>(std::min(entity.pathLength, 0xFFFF)));
+    }
+    if (entity.has(FIELD_SLOW_FACTOR)) writer.writeF32(static_cast<float>(entity.slowFactor));
+    if (entity.has(FIELD_RANGE)) writer.writeF32(static_cast<float>(entity.range));
+    if (entity.has(FIELD_DAMAGE)) writer.writeF32(static_cast<float>(entity.damage));
+    if (entity.has(FIELD_FIRE_RATE)) writer.writeF32(static_cast<float>(entity.fireRate));
+    if (entity.has(FIELD_UPGRADE_LEVEL)) writer.writeU8(static_cast<uint8_t>(entity.upgradeLevel));
+    if (entity.has(FIELD_UPGRADE_COST)) writer.writeI32(entity.upgradeCost);
+    if (entity.has(FIELD_SPLASH_RADIUS)) writer.writeF32(static_cast<float>(entity.splashRadius));
+    if (entity.has(FIELD_GRAVITY_STRENGTH)) writer.writeF32(static_cast<float>(entity.gravityStrength));
+    if (entity.has(FIELD_RADIUS)) writer.writeF32(static_cast<float>(entity.radius));
+    if (entity.has(FIELD_OWNER)) writer.writeU8(static_cast<uint8_t>(static_cast<int8_t>(entity.owner)));
+    if (entity.has(FIELD_SPEED)) writer.writeF32(static_cast<float>(entity.speed));
+}
+
+void BinaryProtocol::encodeTerrain(BinaryWriter& writer, const CellularAutomata& terrain) {
+    int width = terrain.getWidth();
+    int height = terrain.getHeight();
+    writer.writeU16(static_cast<uint16_t>(width));
+    writer.writeU16(static_cast<uint16_t>(height));
+    writer.writeF32(static_cast<float>(terrain.getCellSize()));
+
+    // Four 2-bit cells per byte
+    const auto& grid = terrain.getGrid();
+    uint8_t packed = 0;
+    int shift = 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            packed |= static_cast<uint8_t>((static_cast<int>(grid[y][x]) & 0x3) << shift);
+            shift += 2;
+            if (shift == 8) {
+                writer.writeU8(packed);
+                packed = 0;
+                shift = 0;
+            }
+        }
+    }
+    if (shift != 0) {
+        writer.writeU8(packed);
+    }
+}
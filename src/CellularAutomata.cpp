@@ -44,16 +44,19 @@ void CellularAutomata::initialize(double density) {
     }
 }
 
-void CellularAutomata::update() {
+bool CellularAutomata::update() {
     // Apply Game of Life rules to each cell
+    bool changed = false;
     for (int y = 0; y < m_height; ++y) {
         for (int x = 0; x < m_width; ++x) {
             m_nextGrid[y][x] = applyRules(x, y);
+            changed = changed || m_nextGrid[y][x] != m_grid[y][x];
         }
     }
     
     // Swap grids
     std::swap(m_grid, m_nextGrid);
+    return changed;
 }
 
 bool CellularAutomata::isBuildable(const Vec2d& worldPos) const {
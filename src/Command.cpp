@@ -0,0 +1,97 @@
+#include "Command.h"
+#include "JsonReader.h"
+#include "Log.h"
+#include <cmath>
+#include <cstdint>
+
+bool Command::decode(const JsonValue& msg, int clientId, Command& out) {
+    out = Command();
+    out.clientId = clientId;
+
+    // Read first so even a rejected message can be acknowledged
+    try {
+        if (msg["seq"].isNumber()) {
+            double seq = msg["seq"].getDouble();
+            if (seq >= 0 && seq <= UINT32_MAX) {
+                out.seq = static_cast<uint32_t>(seq);
+            }
+        }
+    } catch (const std::exception&) {
+        out.seq = 0;
+    }
+
+    std::string_view action;
+    try {
+        action = msg["action"].getString();
+    } catch (const std::exception& e) {
+        LOG_LIMITED(LogLevel::Warn, 5, "Invalid action")
+            .field("client", clientId).field("error", e.what());
+        return false;
+    }
+
+    if (action == "build_tower") {
+        try {
+            out.type = CommandType::BuildTower;
+            out.position = Vec2d(msg["position"]["x"].getDouble(), msg["position"]["y"].getDouble());
+            // Grid lookups cast positions to int, and the input log must be
+            // able to write them back out, so only finite on-map ones pass
+            const Vec2d& p = out.position;
+            if (!std::isfinite(p.x) || !std::isfinite(p.y) || p.x < 0 || p.x >= MAP_WIDTH || p.y < 0 ||
+                p.y >= MAP_HEIGHT) {
+                LOG_LIMITED(LogLevel::Warn, 5, "build_tower position off the map")
+                    .field("client", clientId).field("x", p.x).field("y", p.y);
+                return false;
+            }
+
+            // Default to Basic if the type is missing or invalid
+            try {
+                out.towerType = msg["towerType"].getInt();
+            } catch (const std::exception&) {
+                out.towerType = 0;
+            }
+        } catch (const std::exception& e) {
+            LOG_LIMITED(LogLevel::Warn, 5, "Invalid build_tower message")
+                .field("client", clientId).field("error", e.what());
+            return false;
+        }
+        return true;
+    }
+
+    if (action == "upgrade_tower") {
+        try {
+            out.type = CommandType::UpgradeTower;
+            out.towerId = msg["towerId"].getInt();
+        } catch (const std::exception& e) {
+            LOG_LIMITED(LogLevel::Warn, 5, "Invalid upgrade_tower message")
+                .field("client", clientId).field("error", e.what());
+            return false;
+        }
+        return true;
+    }
+
+    if (action == "special_ability") {
+        std::string_view abilityType;
+        try {
+            abilityType = msg["abilityType"].getString();
+        } catch (const std::exception& e) {
+            LOG_LIMITED(LogLevel::Warn, 5, "Invalid special_ability message")
+                .field("client", clientId).field("error", e.what());
+            return false;
+        }
+
+        out.type = CommandType::SpecialAbility;
+        if (abilityType == "meteorStrike") {
+            out.ability = AbilityType::MeteorStrike;
+        } else if (abilityType == "freezeWave") {
+            out.ability = AbilityType::FreezeWave;
+        } else if (abilityType == "repair") {
+            out.ability = AbilityType::Repair;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // Not a game command (e.g. negotiation is handled by the server)
+    return false;
+}
@@ -1,3 +1,3 @@
 #include "GameObject.h"
 
-int GameObject::next_id = 1;
\ No newline at end of file
+thread_local int GameObject::next_id = 1;
\ No newline at end of file
@@ -1,8 +1,12 @@
 #include "GameWorld.h"
-#include <iostream>
-#include "../libs/nlohmann/json.hpp"
+#include "Log.h"
+#include "Metrics.h"
+#include "Profiler.h"
+#include <iterator>
 
 void GameWorld::init() {
+    ObjectIdScope ids(m_nextObjectId);
+
     // Create a solar system with planets that create gravitational fields
     m_objects.push_back(std::make_unique<Planet>(Vec2d(400, 300), 50, 8000.0, 1)); // Player's planet (massive)
     m_objects.push_back(std::make_unique<Planet>(Vec2d(150, 150), 30, 3000.0, 0)); // Neutral planet
@@ -12,40 +16,57 @@ void GameWorld::init() {
     // Initialize cellular automata for dynamic terrain
     m_cellularAutomata.initialize(0.35); // 35% initial density
     
-    // Initialize pathfinding obstacles
+    // Initialize pathfinding obstacles and the field projectiles fly through
     m_pathfinding.updateObstacles(m_objects);
+    m_physicsEngine.updateField(m_objects);
+    buildTickGraph();
+    m_back = std::make_unique<WorldSnapshot>(m_cellularAutomata);
+    m_front = std::make_unique<WorldSnapshot>(m_cellularAutomata);
+
+    // Buffers the tick refills every time start big enough for a busy
+    // match, so a running match doesn't grow them at each new high. The
+    // event lists trade places with the snapshots', so those get room too,
+    // as do the snapshots' copies of the field.
+    m_objects.reserve(RESERVED_OBJECTS);
+    m_candidates.reserve(RESERVED_OBJECTS);
+    m_projectileSpawns.reserve(RESERVED_OBJECTS);
+    m_projectileRemovals.reserve(RESERVED_OBJECTS);
+    for (WorldSnapshot* snapshot : {m_back.get(), m_front.get()}) {
+        snapshot->projectileSpawns.reserve(RESERVED_OBJECTS);
+        snapshot->projectileRemovals.reserve(RESERVED_OBJECTS);
+        snapshot->field.reserve(RESERVED_OBJECTS);
+    }
     
     // Set up WebSocket message handler
+    m_webSocketServer.setRates(SIM_RATE, SNAPSHOT_RATE);
     m_webSocketServer.setOnMessageCallback(
-        [this](const std::string& msg) { this->handleClientMessage(msg); });
-    
-    std::cout << "Celestial Siege initialized - Gravity simulation active!" << std::endl;
-    std::cout << "Planets create gravitational fields that affect all objects" << std::endl;
-    std::cout << "Dynamic terrain using Game of Life cellular automata" << std::endl;
-    std::cout << "Enemies use gravity-aware A* pathfinding" << std::endl;
+        [this](int clientId, const JsonValue& msg) { this->enqueueClientMessage(clientId, msg); });
 }
 
-void GameWorld::run() {
-    // Start WebSocket server
-    m_webSocketServer.run(9002);
-    std::cout << "WebSocket server started on port 9002" << std::endl;
-
-    auto last_time = std::chrono::high_resolution_clock::now();
-    m_running = true;
-
-    while (m_running && m_gameState == GameState::Playing) {
-        auto current_time = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> elapsed = current_time - last_time;
-        double deltaTime = elapsed.count();
-        last_time = current_time;
+bool GameWorld::tick(double deltaTime) {
+    // Objects created this tick take this match's ids, whichever thread
+    // it runs on
+    ObjectIdScope ids(m_nextObjectId);
+    PROFILE_SCOPE(Phase::Tick, getMatchId());
+    auto start = std::chrono::high_resolution_clock::now();
 
+    // Everything update() does is stamped with the tick it produces
+    ++m_tick;
+    if (m_gameState == GameState::Playing) {
+        if (m_stress) {
+            m_stress->apply(*this, deltaTime);
+        }
         update(deltaTime);
+        m_simTime += deltaTime;
+
+        std::chrono::duration<double, std::milli> updateTime =
+            std::chrono::high_resolution_clock::now() - start;
+        m_updateMs += (updateTime.count() - m_updateMs) * 0.05;
 
         // Check game over condition
         if (m_playerHealth <= 0) {
             m_gameState = GameState::GameOver;
-            std::cout << "\n\n=== GAME OVER ===" << std::endl;
-            std::cout << "You survived " << m_currentWave << " waves!" << std::endl;
+            LOG_INFO("Game over").field("match", getMatchId()).field("waves", m_currentWave);
         }
 
         // Check victory condition only after clearing final wave
@@ -54,120 +75,218 @@ void GameWorld::run() {
         });
         if (m_currentWave >= MAX_WAVES && !enemiesRemaining) {
             m_gameState = GameState::Victory;
-            std::cout << "\n\n=== VICTORY ===" << std::endl;
-            std::cout << "You successfully defended your planet!" << std::endl;
+            LOG_INFO("Victory").field("match", getMatchId()).field("health", m_playerHealth);
         }
 
-        // Broadcast game state to all connected clients
-        json state = getStateAsJson();
-        m_webSocketServer.broadcast(state.dump());
+        if (m_recorder) {
+            if (m_gameState != GameState::Playing) {
+                m_recorder->end(m_tick, stateHash());
+            } else if (m_tick % SIM_RATE == 0) {
+                m_recorder->checkpoint(m_tick, stateHash());
+            }
+        }
+    } else if (m_lingerTicks > 0) {
+        // Keep sending the final state for a bit (~3 seconds)
+        --m_lingerTicks;
+        m_simTime += 1.0 / SIM_RATE;
+    } else {
+        return false;
+    }
 
-        // Simple console output
-        std::cout << "\rHealth: " << m_playerHealth << " Resources: " << m_playerResources
-                  << " Wave: " << m_currentWave << "/" << MAX_WAVES << " Objects: " << m_objects.size() << std::flush;
+    // Copy out what clients are due; encoding and sending it is left to
+    // publishSnapshot(), which may overlap the next tick
+    captureSnapshot(*m_back);
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(16)); // ~60fps
-    }
+    std::chrono::duration<double, std::milli> tickTime =
+        std::chrono::high_resolution_clock::now() - start;
+    m_tickMs += (tickTime.count() - m_tickMs) * 0.05;
+    return true;
+}
 
-    // Keep server running for a bit to show final state
-    for (int i = 0; i < 180; i++) { // ~3 seconds
-        json state = getStateAsJson();
-        m_webSocketServer.broadcast(state.dump());
-        std::this_thread::sleep_for(std::chrono::milliseconds(16));
+uint64_t GameWorld::stateHash() const {
+    // Every value that feeds the next tick. Scratch buffers, timings and
+    // the per-client views only affect what is sent, not the simulation.
+    // The id counter is left out: during a tick, when the recorder hashes,
+    // ObjectIdScope holds it, and a wrong one shows in the next new object.
+    StateHash hash;
+    hash.add(m_tick);
+    hash.add(m_simTime);
+    hash.add(m_gameState);
+    hash.add(m_lingerTicks);
+    hash.add(m_playerHealth);
+    hash.add(m_playerResources);
+    hash.add(m_currentWave);
+    hash.add(m_waveTimer);
+    hash.add(m_cellularUpdateTimer);
+    hash.add(m_obstaclesDirty);
+    hash.add(static_cast<uint64_t>(m_objects.size()));
+    for (const auto& obj : m_objects) {
+        obj->hashState(hash);
     }
+    for (const auto& row : m_cellularAutomata.getGrid()) {
+        hash.mix(row.data(), row.size() * sizeof(CellType));
+    }
+    return hash.value();
+}
 
-    m_webSocketServer.stop();
+void GameWorld::buildTickGraph() {
+    // Physics, steering and object updates each need the previous one to
+    // have finished with every object; the terrain automaton shares nothing
+    // with them and runs alongside
+    TaskGraph::TaskId physics = m_tickGraph.add([this]() {
+        PROFILE_SCOPE(Phase::Physics, getMatchId());
+        // First, apply physics to all objects (gravity simulation)
+        m_physicsEngine.update(m_objects, m_tickDelta, m_jobs);
+        m_physicsEngine.stepProjectiles(m_objects, 1.0 / SIM_RATE, m_jobs);
+    });
+    TaskGraph::TaskId steering = m_tickGraph.add([this]() { steerEnemies(); });
+    TaskGraph::TaskId objects = m_tickGraph.add([this]() {
+        PROFILE_SCOPE(Phase::Objects, getMatchId());
+        // Then update individual objects
+        m_jobs.parallelFor(0, m_objects.size(), 64, [this](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                m_objects[i]->update(m_tickDelta);
+            }
+        });
+    });
+    m_tickGraph.add([this]() {
+        PROFILE_SCOPE(Phase::Terrain, getMatchId());
+        // Update cellular automata periodically (every 2 seconds)
+        m_cellularUpdateTimer += m_tickDelta;
+        if (m_cellularUpdateTimer > 2.0) {
+            auto started = std::chrono::steady_clock::now();
+            bool changed = m_cellularAutomata.update();
+            Metrics::add(Metrics::terrainGenerations);
+            Metrics::add(Metrics::terrainMicros, static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - started).count()));
+            if (changed) {
+                m_terrainChanged = true;
+                ++m_terrainVersion;
+            }
+            m_cellularUpdateTimer = 0;
+        }
+    });
+    m_tickGraph.precede(physics, steering);
+    m_tickGraph.precede(steering, objects);
 }
 
 void GameWorld::update(double deltaTime) {
+    // Apply client input queued since the last tick
+    processCommands();
+
     // Don't update if game is over
     if (m_gameState != GameState::Playing) {
         return;
     }
 
-    // First, apply physics to all objects (gravity simulation)
-    m_physicsEngine.update(m_objects, deltaTime);
+    m_tickDelta = deltaTime;
+    m_jobs.run(m_tickGraph);
     
-    // Update pathfinding for enemies
-    for (auto& obj : m_objects) {
-        if (obj->type == GameObjectType::Enemy && obj->alive) {
-            Enemy* enemy = static_cast<Enemy*>(obj.get());
-            
+    // Update wave timer
+    m_waveTimer += deltaTime;
+    if (m_waveTimer > 10.0) { // Spawn wave every 10 seconds
+        spawnWave();
+        m_waveTimer = 0;
+    }
+    
+    fireTowers();
+    handleCollisions();
+    cleanupDeadObjects();
+}
+
+void GameWorld::steerEnemies() {
+    PROFILE_SCOPE(Phase::Pathing, getMatchId());
+    // Each enemy only touches its own path and velocity; the pathfinder
+    // reads static objects alone
+    m_jobs.parallelFor(0, m_objects.size(), 4, [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            GameObject* obj = m_objects[i].get();
+            if (obj->type != GameObjectType::Enemy || !obj->alive) {
+                continue;
+            }
+            Enemy* enemy = static_cast<Enemy*>(obj);
+
             // Check if enemy needs a new path
             if (enemy->needsNewPath()) {
                 // Find path to player's home planet
                 std::vector<Vec2d> path = m_pathfinding.findPath(
-                    enemy->position, 
+                    enemy->position,
                     m_objects[0]->position, // Player's planet
                     m_objects,
                     m_physicsEngine
                 );
                 enemy->setPath(path);
             }
-            
+
             // Apply velocity towards next path target
             Vec2d target = enemy->getNextPathTarget();
             Vec2d direction = (target - enemy->position).normalized();
             enemy->velocity = direction * enemy->speed;
         }
+    });
+}
+
+int GameWorld::nearestEnemy(const Tower& tower, size_t count) const {
+    int nearest = -1;
+    double nearestDistance = tower.range;
+    for (size_t i = 0; i < count; ++i) {
+        const GameObject& target = *m_objects[i];
+        if (target.type == GameObjectType::Enemy && target.alive) {
+            double dist = tower.distanceTo(target);
+            if (dist < nearestDistance) {
+                nearestDistance = dist;
+                nearest = static_cast<int>(i);
+            }
+        }
     }
-    
-    // Then update individual objects
-    for (auto& obj : m_objects) {
-        obj->update(deltaTime);
-    }
-    
-    // Update cellular automata periodically (every 2 seconds)
-    m_cellularUpdateTimer += deltaTime;
-    if (m_cellularUpdateTimer > 2.0) {
-        m_cellularAutomata.update();
-        m_cellularUpdateTimer = 0;
-    }
-    
-    // Update wave timer
-    m_waveTimer += deltaTime;
-    if (m_waveTimer > 10.0) { // Spawn wave every 10 seconds
-        spawnWave();
-        m_waveTimer = 0;
-    }
-    
-    // Handle tower shooting
-    for (auto& obj : m_objects) {
-        if (obj->type == GameObjectType::Tower && obj->alive) {
-            Tower* tower = static_cast<Tower*>(obj.get());
-            if (tower->canFire()) {
-                // Find nearest enemy
-                GameObject* nearestEnemy = nullptr;
-                double nearestDistance = tower->range;
-                
-                for (auto& target : m_objects) {
-                    if (target->type == GameObjectType::Enemy && target->alive) {
-                        double dist = tower->distanceTo(*target);
-                        if (dist < nearestDistance) {
-                            nearestDistance = dist;
-                            nearestEnemy = target.get();
-                        }
-                    }
-                }
-                
-                if (nearestEnemy) {
-                    // Use the new fireAt method which handles different tower types
-                    tower->fireAt(nearestEnemy, m_objects);
-                    
-                    // Basic towers still spawn projectiles
-                    if (dynamic_cast<BasicTower*>(tower) != nullptr) {
-                        spawnProjectile(tower->position, nearestEnemy->position, tower->damage);
-                    }
-                }
+    return nearest;
+}
+
+void GameWorld::fireTowers() {
+    PROFILE_SCOPE(Phase::Targeting, getMatchId());
+    // Targets are found in parallel among the enemies alive now. Towers
+    // still fire one after another in object order, and one whose target
+    // was killed by an earlier tower this tick searches again, so the
+    // outcome is the same as searching at the moment of firing.
+    size_t count = m_objects.size();  // Projectiles fired below are appended
+    m_candidates.assign(count, -1);
+    m_jobs.parallelFor(0, count, 16, [this, count](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const GameObject& obj = *m_objects[i];
+            if (obj.type == GameObjectType::Tower && obj.alive &&
+                static_cast<const Tower&>(obj).canFire()) {
+                m_candidates[i] = nearestEnemy(static_cast<const Tower&>(obj), count);
+            }
+        }
+    });
+
+    for (size_t i = 0; i < count; ++i) {
+        if (m_candidates[i] < 0) {
+            continue;
+        }
+        Tower* tower = static_cast<Tower*>(m_objects[i].get());
+        int target = m_candidates[i];
+        if (!m_objects[target]->alive) {
+            target = nearestEnemy(*tower, count);
+            if (target < 0) {
+                continue;
             }
         }
+        GameObject* nearestEnemy = m_objects[target].get();
+
+        // Use the new fireAt method which handles different tower types
+        tower->fireAt(nearestEnemy, m_objects);
+
+        // Basic towers still spawn projectiles
+        if (dynamic_cast<BasicTower*>(tower) != nullptr) {
+            spawnProjectile(tower->position, nearestEnemy->position, tower->damage);
+        }
     }
-    
-    handleCollisions();
-    cleanupDeadObjects();
 }
 
 void GameWorld::spawnWave() {
+    PROFILE_SCOPE(Phase::Spawn, getMatchId());
     m_currentWave++;
 
     // Don't spawn more waves after reaching max
@@ -179,12 +298,8 @@ void GameWorld::spawnWave() {
     double healthMultiplier = 1.0 + (m_currentWave - 1) * 0.2; // Enemies get 20% tougher each wave
     bool isBossWave = (m_currentWave % 5 == 0); // Boss every 5 waves
 
-    std::cout << "\n=== Wave " << m_currentWave << " / " << MAX_WAVES << " ===" << std::endl;
-
     if (isBossWave) {
         // Boss wave: spawn fewer enemies but include a boss
-        std::cout << "*** BOSS WAVE ***" << std::endl;
-
         // Spawn boss at top
         Vec2d bossPos(400, 50);
         auto boss = createEnemy(EnemyType::Boss, bossPos, healthMultiplier);
@@ -204,7 +319,8 @@ void GameWorld::spawnWave() {
             m_objects.push_back(std::move(enemy));
         }
 
-        std::cout << "Boss + " << supportCount << " support enemies" << std::endl;
+        LOG_INFO("Boss wave").field("match", getMatchId()).field("wave", m_currentWave)
+            .field("support", supportCount).field("multiplier", healthMultiplier);
     } else {
         // Normal wave: mix of enemy types
         for (int i = 0; i < enemyCount; i++) {
@@ -235,33 +351,58 @@ void GameWorld::spawnWave() {
             m_objects.push_back(std::move(enemy));
         }
 
-        std::cout << "Enemies: " << enemyCount << " (mixed types)" << std::endl;
+        LOG_INFO("Wave").field("match", getMatchId()).field("wave", m_currentWave)
+            .field("enemies", enemyCount).field("multiplier", healthMultiplier);
     }
+}
 
-    std::cout << "Health Multiplier: " << healthMultiplier << "x" << std::endl;
+int GameWorld::firstHit(const Projectile& projectile, size_t from) const {
+    for (size_t i = from; i < m_objects.size(); ++i) {
+        const GameObject& enemy = *m_objects[i];
+        if (enemy.type == GameObjectType::Enemy && enemy.alive &&
+            projectile.distanceTo(enemy) < 10) { // Hit radius
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
 }
 
 void GameWorld::handleCollisions() {
-    // Check projectile-enemy collisions
-    for (auto& proj : m_objects) {
-        if (proj->type == GameObjectType::Projectile && proj->alive) {
-            Projectile* projectile = static_cast<Projectile*>(proj.get());
-            
-            for (auto& enemy : m_objects) {
-                if (enemy->type == GameObjectType::Enemy && enemy->alive) {
-                    if (projectile->distanceTo(*enemy) < 10) { // Hit radius
-                        Enemy* e = static_cast<Enemy*>(enemy.get());
-                        e->takeDamage(projectile->damage);
-                        projectile->alive = false;
-                        
-                        if (!e->alive) {
-                            m_playerResources += e->reward;
-                        }
-                        break;
-                    }
-                }
+    PROFILE_SCOPE(Phase::Collisions, getMatchId());
+    // Check projectile-enemy collisions. The first enemy each projectile
+    // touches is found in parallel; hits are then applied in object order.
+    // If an earlier hit this tick killed that enemy, the search carries on
+    // past it, which is what a serial search would have found.
+    m_candidates.assign(m_objects.size(), -1);
+    m_jobs.parallelFor(0, m_objects.size(), 16, [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const GameObject& obj = *m_objects[i];
+            if (obj.type == GameObjectType::Projectile && obj.alive) {
+                m_candidates[i] = firstHit(static_cast<const Projectile&>(obj), 0);
             }
         }
+    });
+
+    for (size_t i = 0; i < m_objects.size(); ++i) {
+        int hit = m_candidates[i];
+        if (hit < 0) {
+            continue;
+        }
+        Projectile* projectile = static_cast<Projectile*>(m_objects[i].get());
+        if (!m_objects[hit]->alive) {
+            hit = firstHit(*projectile, hit + 1);
+            if (hit < 0) {
+                continue;
+            }
+        }
+        Enemy* e = static_cast<Enemy*>(m_objects[hit].get());
+        e->takeDamage(projectile->damage);
+        projectile->alive = false;
+        projectile->hitTarget = true;
+
+        if (!e->alive) {
+            m_playerResources += e->reward;
+        }
     }
     
     // Check enemy reaching player base
@@ -277,6 +418,14 @@ void GameWorld::handleCollisions() {
 }
 
 void GameWorld::cleanupDeadObjects() {
+    PROFILE_SCOPE(Phase::Cleanup, getMatchId());
+    for (const auto& obj : m_objects) {
+        if (obj->type == GameObjectType::Projectile && !obj->alive) {
+            const Projectile* projectile = static_cast<const Projectile*>(obj.get());
+            m_projectileRemovals.push_back({projectile->id, m_tick, projectile->hitTarget});
+        }
+    }
+
     m_objects.erase(
         std::remove_if(m_objects.begin(), m_objects.end(),
             [](const std::unique_ptr<GameObject>& obj) {
@@ -289,7 +438,8 @@ void GameWorld::cleanupDeadObjects() {
 bool GameWorld::placeTower(Vec2d position, int towerType) {
     // Check if position is buildable according to cellular automata
     if (!m_cellularAutomata.isBuildable(position)) {
-        std::cout << "\nCannot build here - terrain is not suitable!" << std::endl;
+        LOG_LIMITED(LogLevel::Debug, 10, "Tower rejected, terrain not buildable")
+            .field("match", getMatchId()).field("x", position.x).field("y", position.y);
         return false;
     }
     
@@ -298,7 +448,8 @@ bool GameWorld::placeTower(Vec2d position, int towerType) {
         if (obj->alive && obj->isStatic) {
             double dist = (obj->position - position).length();
             if (dist < 40) { // Minimum distance between static objects
-                std::cout << "\nToo close to existing structure!" << std::endl;
+                LOG_LIMITED(LogLevel::Debug, 10, "Tower rejected, too close to a structure")
+                    .field("match", getMatchId()).field("x", position.x).field("y", position.y);
                 return false;
             }
         }
@@ -309,8 +460,8 @@ bool GameWorld::placeTower(Vec2d position, int towerType) {
     if (m_playerResources >= tower->cost) {
         m_playerResources -= tower->cost;
         m_objects.push_back(std::move(tower));
-        // Update pathfinding obstacles when new tower is placed
-        m_pathfinding.updateObstacles(m_objects);
+        // Pathfinding obstacles are rebuilt once the tick's commands are applied
+        m_obstaclesDirty = true;
         return true;
     }
     return false;
@@ -324,7 +475,8 @@ bool GameWorld::upgradeTower(int towerId) {
 
             // Check if tower can be upgraded
             if (!tower->canUpgrade()) {
-                std::cout << "\nTower is already at max level!" << std::endl;
+                LOG_LIMITED(LogLevel::Debug, 10, "Upgrade rejected, tower at max level")
+                    .field("match", getMatchId()).field("tower", towerId);
                 return false;
             }
 
@@ -333,18 +485,20 @@ bool GameWorld::upgradeTower(int towerId) {
             if (m_playerResources >= upgradeCost) {
                 m_playerResources -= upgradeCost;
                 tower->upgrade();
-                std::cout << "\nTower upgraded to level " << tower->upgradeLevel
-                          << " for " << upgradeCost << " resources!" << std::endl;
+                LOG_INFO("Tower upgraded").field("match", getMatchId()).field("tower", towerId)
+                    .field("level", tower->upgradeLevel).field("cost", upgradeCost);
                 return true;
             } else {
-                std::cout << "\nInsufficient resources to upgrade tower (need "
-                          << upgradeCost << ", have " << m_playerResources << ")" << std::endl;
+                LOG_LIMITED(LogLevel::Debug, 10, "Upgrade rejected, insufficient resources")
+                    .field("match", getMatchId()).field("tower", towerId)
+                    .field("cost", upgradeCost).field("resources", m_playerResources);
                 return false;
             }
         }
     }
 
-    std::cout << "\nTower not found (ID: " << towerId << ")" << std::endl;
+    LOG_LIMITED(LogLevel::Debug, 10, "Upgrade rejected, no such tower")
+        .field("match", getMatchId()).field("tower", towerId);
     return false;
 }
 
@@ -357,128 +511,547 @@ void GameWorld::spawnEnemy(Vec2d position) {
 }
 
 void GameWorld::spawnProjectile(Vec2d from, Vec2d to, double damage) {
-    m_objects.push_back(std::make_unique<Projectile>(from, to, damage));
+    auto projectile = std::make_unique<Projectile>(from, to, damage);
+    m_projectileSpawns.push_back({projectile->id, m_tick, projectile->position, projectile->velocity});
+    m_objects.push_back(std::move(projectile));
 }
 
-json GameWorld::getStateAsJson() const {
-    json state;
-    state["objects"] = json::array();
+void GameWorld::addObject(std::unique_ptr<GameObject> object) {
+    // Obstacles and the field catch up at the start of the next update
+    if (object->isStatic) {
+        m_obstaclesDirty = true;
+    }
+    m_objects.push_back(std::move(object));
+}
 
+void GameWorld::captureEntityStates(std::vector<EntityState>& out) const {
+    // Projectiles are replicated as events instead, see broadcastProjectiles()
+    out.clear();
     for (const auto& obj : m_objects) {
-        if (obj->alive) {
-            state["objects"].push_back(obj->toJson());
+        if (obj->alive && obj->type != GameObjectType::Projectile) {
+            out.emplace_back();
+            obj->captureState(out.back());
         }
     }
+}
 
-    state["playerHealth"] = m_playerHealth;
-    state["playerResources"] = m_playerResources;
-    state["currentWave"] = m_currentWave;
-    state["maxWaves"] = MAX_WAVES;
-
-    // Add game state
+StateHeader GameWorld::getStateHeader() const {
+    StateHeader header;
+    header.playerHealth = m_playerHealth;
+    header.playerResources = m_playerResources;
+    header.currentWave = m_currentWave;
+    header.maxWaves = MAX_WAVES;
+    header.tick = m_tick;
+    header.time = static_cast<uint32_t>(m_simTime * 1000.0);
     if (m_gameState == GameState::Victory) {
-        state["gameState"] = "victory";
+        header.gameState = 1;
     } else if (m_gameState == GameState::GameOver) {
-        state["gameState"] = "gameOver";
-    } else {
-        state["gameState"] = "playing";
+        header.gameState = 2;
     }
+    return header;
+}
 
-    // Add cellular automata grid data
-    json gridData;
-    gridData["width"] = m_cellularAutomata.getWidth();
-    gridData["height"] = m_cellularAutomata.getHeight();
-    gridData["cellSize"] = m_cellularAutomata.getCellSize();
-    gridData["cells"] = json::array();
-    
-    const auto& grid = m_cellularAutomata.getGrid();
-    for (int y = 0; y < m_cellularAutomata.getHeight(); ++y) {
-        json row = json::array();
-        for (int x = 0; x < m_cellularAutomata.getWidth(); ++x) {
-            row.push_back(static_cast<int>(grid[y][x]));
+BinaryProtocol::Quantization GameWorld::getQuantization() const {
+    // Positions are quantized over the terrain grid, which spans the whole map
+    BinaryProtocol::Quantization q;
+    q.maxX = m_cellularAutomata.getWidth() * m_cellularAutomata.getCellSize();
+    q.maxY = m_cellularAutomata.getHeight() * m_cellularAutomata.getCellSize();
+    return q;
+}
+
+void GameWorld::captureSnapshot(WorldSnapshot& snapshot) {
+    PROFILE_SCOPE(Phase::Capture, getMatchId());
+    snapshot.ready = true;
+    snapshot.header = getStateHeader();
+    snapshot.objectCount = m_objects.size();
+    snapshot.updateMs = m_updateMs;
+    snapshot.tickMs = m_tickMs;
+    snapshot.base = m_objects.empty() ? Vec2d(0, 0) : m_objects[0]->position;
+
+    snapshot.terrainChanged = m_terrainChanged;
+    m_terrainChanged = false;
+    if (snapshot.terrainVersion != m_terrainVersion) {
+        snapshot.terrain = m_cellularAutomata;
+        snapshot.terrainVersion = m_terrainVersion;
+    }
+    snapshot.fieldChanged = m_fieldChanged;
+    m_fieldChanged = false;
+    if (snapshot.fieldVersion != m_fieldVersion) {
+        snapshot.field = m_physicsEngine.getField();
+        snapshot.fieldVersion = m_fieldVersion;
+    }
+
+    // Events are batched to the default snapshot rate; clients render far
+    // enough behind that a spawn still arrives before it is drawn
+    snapshot.projectileSpawns.clear();
+    snapshot.projectileRemovals.clear();
+    if (m_tick % (SIM_RATE / SNAPSHOT_RATE) == 0) {
+        snapshot.projectileSpawns.swap(m_projectileSpawns);
+        snapshot.projectileRemovals.swap(m_projectileRemovals);
+    }
+
+    // Clients that connect before this is published start on the next one
+    snapshot.hasClients = m_webSocketServer.clientCount() > 0;
+    snapshot.entities.clear();
+    snapshot.inFlight.clear();
+    if (!snapshot.hasClients) {
+        return;
+    }
+    captureEntityStates(snapshot.entities);
+    for (const auto& obj : m_objects) {
+        if (obj->type == GameObjectType::Projectile && obj->alive) {
+            snapshot.inFlight.push_back({obj->id, m_tick, obj->position, obj->velocity});
         }
-        gridData["cells"].push_back(row);
     }
-    
-    state["terrain"] = gridData;
-    
-    return state;
-}
-
-void GameWorld::handleClientMessage(const std::string& message) {
-    try {
-        json msg = json::parse(message);
-
-        std::string action;
-        try {
-            action = msg["action"].get_string();
-        } catch (const std::exception& e) {
-            std::cerr << "Ignoring client message with invalid action: " << e.what() << std::endl;
-            return;
-        }
-
-        // Handle build_tower action
-        if (action == "build_tower") {
-            try {
-                double x = msg["position"]["x"].get_double();
-                double y = msg["position"]["y"].get_double();
-                Vec2d pos(x, y);
-
-                // Extract tower type (default to Basic if not specified)
-                int towerType = 0;
-                try {
-                    towerType = msg["towerType"].get_int();
-                } catch (const std::exception&) {
-                    // Keep default when missing or invalid
-                }
+}
 
-                std::cout << "\nAttempting to place tower type " << towerType
-                          << " at (" << pos.x << ", " << pos.y << ")" << std::endl;
+void GameWorld::publishSnapshot() {
+    WorldSnapshot& snapshot = *m_front;
+    if (!snapshot.ready) {
+        return;
+    }
+    snapshot.ready = false;
+    if (!snapshot.hasClients) {
+        return;
+    }
+    PROFILE_SCOPE(Phase::Publish, getMatchId());
+    auto start = std::chrono::high_resolution_clock::now();
 
-                if (placeTower(pos, towerType)) {
-                    std::cout << "Tower placed successfully!" << std::endl;
-                } else {
-                    std::cout << "Failed to place tower (insufficient resources or invalid location)" << std::endl;
-                }
-            } catch (const std::exception& e) {
-                std::cerr << "Invalid build_tower message: " << e.what() << std::endl;
-                return;
+    uint32_t tick = snapshot.header.tick;
+    m_webSocketServer.beginTick(tick, snapshot.terrainChanged);
+    broadcastProjectiles(snapshot);
+    broadcastObjects(snapshot);
+    broadcastTerrain(snapshot);
+    broadcastStats(snapshot);
+
+    // Round trips feed the latency histograms reported on the stats channel
+    if (tick % SIM_RATE == 0) {
+        m_webSocketServer.pingClients();
+    }
+
+    std::chrono::duration<double, std::milli> publishTime =
+        std::chrono::high_resolution_clock::now() - start;
+    m_publishMs += (publishTime.count() - m_publishMs) * 0.05;
+}
+
+void GameWorld::broadcastProjectiles(const WorldSnapshot& snapshot) {
+    PROFILE_SCOPE(Phase::PublishProjectiles, getMatchId());
+    // Clients that just subscribed get the field and every projectile in
+    // flight, as if it had been fired this tick
+    uint32_t tick = snapshot.header.tick;
+    for (const JoiningClient& client : m_webSocketServer.joiningTargets()) {
+        // A changed field goes to everyone below
+        if (!snapshot.fieldChanged) {
+            JsonProtocol::encodeField(m_jsonBuffer, tick, SIM_RATE, snapshot.field);
+            m_webSocketServer.sendTo(client.hdl, m_jsonBuffer, Channel::Reliable, WireFormat::Json);
+        }
+        if (snapshot.inFlight.empty()) {
+            continue;
+        }
+        if (client.format == WireFormat::Json) {
+            JsonProtocol::encodeProjectileEvents(m_jsonBuffer, tick, snapshot.inFlight, m_noRemovals);
+            m_webSocketServer.sendTo(client.hdl, m_jsonBuffer, Channel::Reliable, WireFormat::Json);
+        } else {
+            BinaryProtocol::encodeProjectileEvents(m_binaryBuffer, tick, snapshot.inFlight, m_noRemovals);
+            m_webSocketServer.sendTo(client.hdl, m_binaryBuffer, Channel::Reliable, client.format);
+        }
+    }
+
+    // A new tower changes the field from this tick on
+    if (snapshot.fieldChanged) {
+        JsonProtocol::encodeField(m_jsonBuffer, tick, SIM_RATE, snapshot.field);
+        m_webSocketServer.publishText(m_jsonBuffer, Channel::Reliable);
+    }
+
+    if (snapshot.projectileSpawns.empty() && snapshot.projectileRemovals.empty()) {
+        return;
+    }
+    if (m_webSocketServer.hasTargets(Channel::Reliable, WireFormat::Json)) {
+        JsonProtocol::encodeProjectileEvents(m_jsonBuffer, tick, snapshot.projectileSpawns,
+                                             snapshot.projectileRemovals);
+        m_webSocketServer.publish(m_jsonBuffer, Channel::Reliable, WireFormat::Json);
+    }
+    bool wantsBinary = m_webSocketServer.hasTargets(Channel::Reliable, WireFormat::Binary);
+    bool wantsQuantized = m_webSocketServer.hasTargets(Channel::Reliable, WireFormat::BinaryQuantized);
+    if (wantsBinary || wantsQuantized) {
+        BinaryProtocol::encodeProjectileEvents(m_binaryBuffer, tick, snapshot.projectileSpawns,
+                                               snapshot.projectileRemovals);
+        m_webSocketServer.publish(m_binaryBuffer, Channel::Reliable, WireFormat::Binary);
+        m_webSocketServer.publish(m_binaryBuffer, Channel::Reliable, WireFormat::BinaryQuantized);
+    }
+}
+
+void GameWorld::broadcastObjects(const WorldSnapshot& snapshot) {
+    PROFILE_SCOPE(Phase::PublishObjects, getMatchId());
+    // Forget clients that left or dropped their viewport
+    m_webSocketServer.takeDepartedClients(m_departedClients);
+    for (int clientId : m_departedClients) {
+        m_clientViews.erase(clientId);
+    }
+
+    // Only encode the formats somebody is due to receive this tick
+    bool wantsJson = m_webSocketServer.hasTargets(Channel::Objects, WireFormat::Json);
+    bool wantsBinary = m_webSocketServer.hasTargets(Channel::Objects, WireFormat::Binary);
+    bool wantsQuantized = m_webSocketServer.hasTargets(Channel::Objects, WireFormat::BinaryQuantized);
+    bool wantsDedicated = !m_webSocketServer.snapshotTargets().empty();
+    if (!wantsJson && !wantsBinary && !wantsQuantized && !wantsDedicated) {
+        return;
+    }
+
+    const StateHeader& header = snapshot.header;
+    if (wantsJson) {
+        JsonProtocol::encodeState(m_jsonBuffer, header, snapshot.entities, nullptr);
+        m_webSocketServer.publish(m_jsonBuffer, Channel::Objects, WireFormat::Json);
+    }
+
+    if (wantsBinary) {
+        BinaryProtocol::encodeState(m_binaryBuffer, header, snapshot.entities, nullptr, nullptr);
+        m_webSocketServer.publish(m_binaryBuffer, Channel::Objects, WireFormat::Binary);
+    }
+    if (wantsQuantized) {
+        BinaryProtocol::Quantization quantization = getQuantization();
+        BinaryProtocol::encodeState(m_binaryBuffer, header, snapshot.entities, nullptr, &quantization);
+        m_webSocketServer.publish(m_binaryBuffer, Channel::Objects, WireFormat::BinaryQuantized);
+    }
+
+    if (wantsDedicated) {
+        sendDedicatedObjects(snapshot);
+    }
+}
+
+void GameWorld::sendDedicatedObjects(const WorldSnapshot& snapshot) {
+    PROFILE_SCOPE(Phase::PublishClients, getMatchId());
+    const StateHeader& header = snapshot.header;
+    m_spatialGrid.build(snapshot.entities);
+
+    // Ids still in the world, to tell leaving the viewport apart from dying
+    m_worldIds.clear();
+    for (const auto& entity : snapshot.entities) {
+        m_worldIds.push_back(entity.id);
+    }
+    std::sort(m_worldIds.begin(), m_worldIds.end());
+
+    BinaryProtocol::Quantization quantization = getQuantization();
+    for (const SnapshotClient& client : m_webSocketServer.snapshotTargets()) {
+        ClientView& view = m_clientViews[client.hdl.id];
+
+        // Candidates are the viewport plus margin, or everything
+        const std::vector<EntityState>* candidates = &snapshot.entities;
+        if (client.culled) {
+            const Viewport& box = client.viewport;
+            m_spatialGrid.query(box.minX - INTEREST_MARGIN, box.minY - INTEREST_MARGIN,
+                                box.maxX + INTEREST_MARGIN, box.maxY + INTEREST_MARGIN,
+                                m_queryIndices);
+            m_culledStates.clear();
+            for (uint32_t index : m_queryIndices) {
+                m_culledStates.push_back(snapshot.entities[index]);
             }
+            candidates = &m_culledStates;
+        }
+        m_visibleIds.clear();
+        for (const auto& entity : *candidates) {
+            m_visibleIds.push_back(entity.id);
         }
-        // Handle tower upgrade action
-        else if (action == "upgrade_tower") {
-            try {
-                int towerId = msg["towerId"].get_int();
-                upgradeTower(towerId);
-            } catch (const std::exception& e) {
-                std::cerr << "Invalid upgrade_tower message: " << e.what() << std::endl;
-                return;
+        std::sort(m_visibleIds.begin(), m_visibleIds.end());
+
+        // Enter/leave go out reliably ahead of the snapshot, since a
+        // latest-wins snapshot may be replaced before it is sent
+        if (client.culled) {
+            m_enteredIds.clear();
+            m_leftIds.clear();
+            std::set_difference(m_visibleIds.begin(), m_visibleIds.end(),
+                                view.visibleIds.begin(), view.visibleIds.end(),
+                                std::back_inserter(m_enteredIds));
+            for (int id : view.visibleIds) {
+                if (!std::binary_search(m_visibleIds.begin(), m_visibleIds.end(), id) &&
+                    std::binary_search(m_worldIds.begin(), m_worldIds.end(), id)) {
+                    m_leftIds.push_back(id);
+                }
+            }
+            if (!m_enteredIds.empty() || !m_leftIds.empty()) {
+                JsonProtocol::encodeInterest(m_jsonBuffer, header.tick, m_enteredIds, m_leftIds);
+                m_webSocketServer.sendTo(client.hdl, m_jsonBuffer, Channel::Reliable, WireFormat::Json);
             }
         }
-        // Handle special abilities
-        else if (action == "special_ability") {
-            try {
-                std::string abilityType = msg["abilityType"].get_string();
-                activateSpecialAbility(abilityType);
-            } catch (const std::exception& e) {
-                std::cerr << "Invalid special_ability message: " << e.what() << std::endl;
-                return;
+
+        // Removals and the first snapshot's reset go out reliably too.
+        // Partial snapshots only add to what the client holds, so losing
+        // one to a newer one costs nothing but freshness.
+        bool partial = client.budget > 0;
+        if (partial) {
+            bool reset = !view.synced;
+            selectWithinBudget(snapshot, client, view, *candidates);
+            if (reset || !m_removedIds.empty()) {
+                JsonProtocol::encodeRemoved(m_jsonBuffer, header.tick, m_removedIds, reset);
+                m_webSocketServer.sendTo(client.hdl, m_jsonBuffer, Channel::Reliable, WireFormat::Json);
             }
+            candidates = &m_selectedStates;
+        }
+        view.visibleIds.swap(m_visibleIds);
+
+        if (client.format == WireFormat::Json) {
+            JsonProtocol::encodeState(m_jsonBuffer, header, *candidates, nullptr, partial);
+            m_webSocketServer.sendTo(client.hdl, m_jsonBuffer, Channel::Objects, WireFormat::Json);
+        } else {
+            const BinaryProtocol::Quantization* quant =
+                client.format == WireFormat::BinaryQuantized ? &quantization : nullptr;
+            BinaryProtocol::encodeState(m_binaryBuffer, header, *candidates, nullptr, quant, partial);
+            m_webSocketServer.sendTo(client.hdl, m_binaryBuffer, Channel::Objects, client.format);
+        }
+    }
+}
+
+void GameWorld::selectWithinBudget(const WorldSnapshot& snapshot, const SnapshotClient& client,
+                                   ClientView& view, const std::vector<EntityState>& candidates) {
+    // m_visibleIds holds the sorted candidate ids. Anything the client holds
+    // that is no longer a candidate is left in m_removedIds for the caller
+    // to remove on its side.
+    if (!view.synced) {
+        view.knownIds.clear();
+        view.priority.clear();
+    }
+    m_removedIds.clear();
+    std::set_difference(view.knownIds.begin(), view.knownIds.end(),
+                        m_visibleIds.begin(), m_visibleIds.end(),
+                        std::back_inserter(m_removedIds));
+    for (int id : m_removedIds) {
+        view.priority.erase(id);
+    }
+
+    // Every candidate gains priority each snapshot until it is sent, so
+    // nothing starves; objects the client has never seen jump the queue
+    Vec2d focus = snapshot.base;
+    if (client.culled) {
+        focus = Vec2d((client.viewport.minX + client.viewport.maxX) / 2,
+                      (client.viewport.minY + client.viewport.maxY) / 2);
+    }
+    m_ranked.clear();
+    for (uint32_t i = 0; i < candidates.size(); ++i) {
+        const EntityState& entity = candidates[i];
+        double& priority = view.priority[entity.id];
+        priority += sendPriority(entity, focus, snapshot.base);
+        if (!std::binary_search(view.knownIds.begin(), view.knownIds.end(), entity.id)) {
+            priority += 1000.0;
+        }
+        m_ranked.emplace_back(priority, i);
+    }
+    std::sort(m_ranked.begin(), m_ranked.end(),
+              [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    // Size of the snapshot with no objects, then fill highest priority first
+    const StateHeader& header = snapshot.header;
+    BinaryProtocol::Quantization quantization = getQuantization();
+    const BinaryProtocol::Quantization* quant =
+        client.format == WireFormat::BinaryQuantized ? &quantization : nullptr;
+    m_selectedStates.clear();
+    size_t used;
+    if (client.format == WireFormat::Json) {
+        JsonProtocol::encodeState(m_jsonBuffer, header, m_selectedStates, nullptr, true);
+        used = m_jsonBuffer.size();
+    } else {
+        BinaryProtocol::encodeState(m_binaryBuffer, header, m_selectedStates, nullptr, quant, true);
+        used = m_binaryBuffer.size();
+    }
+
+    size_t budget = static_cast<size_t>(client.budget);
+    m_selectedIndices.clear();
+    for (const auto& ranked : m_ranked) {
+        if (used + 16 > budget) {
+            break;  // No object is smaller than this
+        }
+        const EntityState& entity = candidates[ranked.second];
+        size_t size = (client.format == WireFormat::Json)
+            ? JsonProtocol::entitySize(entity)
+            : BinaryProtocol::entitySize(entity, quant);
+        if (used + size > budget) {
+            continue;  // A smaller object further down may still fit
+        }
+        used += size;
+        m_selectedIndices.push_back(ranked.second);
+        view.priority[entity.id] = 0;
+    }
+    std::sort(m_selectedIndices.begin(), m_selectedIndices.end());
+    for (uint32_t index : m_selectedIndices) {
+        m_selectedStates.push_back(candidates[index]);
+    }
+
+    // The client now holds what it had, minus removals, plus what was sent
+    m_mergedIds.clear();
+    std::set_difference(view.knownIds.begin(), view.knownIds.end(),
+                        m_removedIds.begin(), m_removedIds.end(),
+                        std::back_inserter(m_mergedIds));
+    for (const auto& entity : m_selectedStates) {
+        m_mergedIds.push_back(entity.id);
+    }
+    std::sort(m_mergedIds.begin(), m_mergedIds.end());
+    m_mergedIds.erase(std::unique(m_mergedIds.begin(), m_mergedIds.end()), m_mergedIds.end());
+    view.knownIds.swap(m_mergedIds);
+    view.synced = true;
+}
+
+double GameWorld::sendPriority(const EntityState& entity, const Vec2d& focus, const Vec2d& base) const {
+    // Enemies matter most, bosses and enemies closing on the base more so;
+    // static objects rarely need refreshing
+    double importance = 0.25;
+    switch (static_cast<GameObjectType>(entity.type)) {
+    case GameObjectType::Enemy: {
+        importance = entity.has(FIELD_IS_BOSS) ? 8.0 : 2.0;
+        double toBase = (entity.position - base).length();
+        if (toBase < 200.0) {
+            importance += 3.0 * (1.0 - toBase / 200.0);
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Error handling message: " << e.what() << std::endl;
+        break;
+    }
+    case GameObjectType::Tower:
+        importance = 0.5;
+        break;
+    default:
+        break;
+    }
+    double distance = (entity.position - focus).length();
+    return importance / (1.0 + distance / 400.0);
+}
+
+void GameWorld::broadcastTerrain(const WorldSnapshot& snapshot) {
+    PROFILE_SCOPE(Phase::PublishTerrain, getMatchId());
+    if (m_webSocketServer.hasTargets(Channel::Terrain, WireFormat::Json)) {
+        JsonProtocol::encodeTerrainMessage(m_jsonBuffer, snapshot.header.tick, snapshot.terrain);
+        m_webSocketServer.publish(m_jsonBuffer, Channel::Terrain, WireFormat::Json);
+    }
+
+    // Both binary formats carry the same terrain block
+    bool wantsBinary = m_webSocketServer.hasTargets(Channel::Terrain, WireFormat::Binary);
+    bool wantsQuantized = m_webSocketServer.hasTargets(Channel::Terrain, WireFormat::BinaryQuantized);
+    if (wantsBinary || wantsQuantized) {
+        BinaryProtocol::encodeTerrainMessage(m_binaryBuffer, snapshot.header.tick, snapshot.terrain);
+        m_webSocketServer.publish(m_binaryBuffer, Channel::Terrain, WireFormat::Binary);
+        m_webSocketServer.publish(m_binaryBuffer, Channel::Terrain, WireFormat::BinaryQuantized);
     }
 }
 
-void GameWorld::activateSpecialAbility(const std::string& abilityType) {
+void GameWorld::broadcastStats(const WorldSnapshot& snapshot) {
+    PROFILE_SCOPE(Phase::PublishStats, getMatchId());
+    if (!m_webSocketServer.hasTargets(Channel::Stats, WireFormat::Json)) {
+        return;
+    }
+
+    websocket::QueueStats queues = m_webSocketServer.queueStats();
+    LatencyHistogram rtt;
+    LatencyHistogram jitter;
+    m_webSocketServer.latencyStats(rtt, jitter);
+    m_jsonBuffer.clear();
+    JsonWriter writer(m_jsonBuffer);
+    writer.beginObject();
+    writer.field(JSON_KEY("clients"), static_cast<uint64_t>(m_webSocketServer.clientCount()));
+    writer.field(JSON_KEY("jitterP99Ms"), jitter.percentile(0.99) / 1000.0);
+    writer.field(JSON_KEY("match"), getMatchId());
+    writer.field(JSON_KEY("objects"), static_cast<uint64_t>(snapshot.objectCount));
+    writer.field(JSON_KEY("publishMs"), m_publishMs);
+    writer.field(JSON_KEY("queuedBytes"), static_cast<uint64_t>(queues.queued_bytes));
+    writer.field(JSON_KEY("rttP50Ms"), rtt.percentile(0.5) / 1000.0);
+    writer.field(JSON_KEY("rttP99Ms"), rtt.percentile(0.99) / 1000.0);
+    writer.field(JSON_KEY("skippedSnapshots"), static_cast<uint64_t>(queues.coalesced_frames));
+    writer.field(JSON_KEY("tick"), snapshot.header.tick);
+    writer.field(JSON_KEY("tickMs"), snapshot.tickMs);
+    writer.field(JSON_KEY("tickRate"), SIM_RATE);
+    writer.field(JSON_KEY("time"), snapshot.header.time);
+    writer.field(JSON_KEY("type"), "stats");
+    writer.field(JSON_KEY("updateMs"), snapshot.updateMs);
+    writer.endObject();
+    m_webSocketServer.publish(m_jsonBuffer, Channel::Stats, WireFormat::Json);
+}
+
+void GameWorld::enqueueClientMessage(int clientId, const JsonValue& msg) {
+    // Network thread: decode here so the tick only sees plain commands
+    // Commands that never reach the tick are acknowledged from here
+    Command command;
+    std::string ack;
+    if (!Command::decode(msg, clientId, command)) {
+        JsonProtocol::encodeAck(ack, command.seq, CommandResult::Invalid, 0, 0);
+        m_webSocketServer.sendTo(websocket::ConnectionHandle(clientId), ack,
+                                 Channel::Reliable, WireFormat::Json);
+        return;
+    }
+    if (!submitCommand(command)) {
+        uint64_t dropped = ++m_droppedCommands;
+        Metrics::add(Metrics::commandsDropped);
+        LOG_LIMITED(LogLevel::Warn, 5, "Command queue full, dropped command")
+            .field("match", getMatchId()).field("client", clientId).field("total", dropped);
+        JsonProtocol::encodeAck(ack, command.seq, CommandResult::Dropped, 0, 0);
+        m_webSocketServer.sendTo(websocket::ConnectionHandle(clientId), ack,
+                                 Channel::Reliable, WireFormat::Json);
+    }
+}
+
+void GameWorld::processCommands() {
+    PROFILE_SCOPE(Phase::Commands, getMatchId());
+    Command command;
+    while (m_commands.tryPop(command)) {
+        if (m_recorder) {
+            m_recorder->command(m_tick, command);
+        }
+        // Input that arrives after the game has ended is discarded
+        if (m_gameState == GameState::Playing) {
+            applyCommand(command);
+        } else {
+            sendAck(command, CommandResult::Rejected, 0);
+        }
+    }
+
+    // Several placements in one tick share a single obstacle rebuild
+    if (m_obstaclesDirty) {
+        m_pathfinding.updateObstacles(m_objects);
+        if (m_physicsEngine.updateField(m_objects)) {
+            m_fieldChanged = true;
+            ++m_fieldVersion;
+        }
+        m_obstaclesDirty = false;
+    }
+}
+
+void GameWorld::applyCommand(const Command& command) {
+    bool applied = false;
+    int objectId = 0;
+    switch (command.type) {
+    case CommandType::BuildTower:
+        applied = placeTower(command.position, command.towerType);
+        if (applied) {
+            objectId = m_objects.back()->id;
+            LOG_INFO("Tower placed").field("match", getMatchId()).field("tower", objectId)
+                .field("type", command.towerType).field("x", command.position.x)
+                .field("y", command.position.y);
+        }
+        break;
+    case CommandType::UpgradeTower:
+        applied = upgradeTower(command.towerId);
+        objectId = applied ? command.towerId : 0;
+        break;
+    case CommandType::SpecialAbility:
+        applied = activateSpecialAbility(command.ability);
+        break;
+    }
+    sendAck(command, applied ? CommandResult::Applied : CommandResult::Rejected, objectId);
+}
+
+void GameWorld::sendAck(const Command& command, CommandResult result, int objectId) {
+    // Commands submitted by the server itself have nobody to tell
+    if (command.clientId == 0) {
+        return;
+    }
+    // Goes out ahead of this tick's snapshot, so a client can confirm or
+    // roll back what it showed optimistically
+    JsonProtocol::encodeAck(m_ackBuffer, command.seq, result, m_tick, objectId);
+    m_webSocketServer.sendTo(websocket::ConnectionHandle(command.clientId), m_ackBuffer,
+                             Channel::Reliable, WireFormat::Json);
+}
+
+bool GameWorld::activateSpecialAbility(AbilityType abilityType) {
     int cost = 0;
 
-    if (abilityType == "meteorStrike") {
+    if (abilityType == AbilityType::MeteorStrike) {
         cost = 100;
         if (m_playerResources >= cost) {
             m_playerResources -= cost;
-            std::cout << "\n*** METEOR STRIKE ACTIVATED ***" << std::endl;
-
             // Deal area damage to all enemies
             for (auto& obj : m_objects) {
                 if (obj->type == GameObjectType::Enemy && obj->alive) {
@@ -487,17 +1060,18 @@ void GameWorld::activateSpecialAbility(const std::string& abilityType) {
                 }
             }
 
-            std::cout << "Meteor strike dealt 50 damage to all enemies!" << std::endl;
+            LOG_INFO("Meteor strike").field("match", getMatchId()).field("damage", 50);
+            return true;
         } else {
-            std::cout << "Insufficient resources for Meteor Strike!" << std::endl;
+            LOG_LIMITED(LogLevel::Debug, 10, "Meteor strike rejected, insufficient resources")
+                .field("match", getMatchId());
+            return false;
         }
     }
-    else if (abilityType == "freezeWave") {
+    else if (abilityType == AbilityType::FreezeWave) {
         cost = 150;
         if (m_playerResources >= cost) {
             m_playerResources -= cost;
-            std::cout << "\n*** FREEZE WAVE ACTIVATED ***" << std::endl;
-
             // Apply slow to all enemies
             for (auto& obj : m_objects) {
                 if (obj->type == GameObjectType::Enemy && obj->alive) {
@@ -506,24 +1080,29 @@ void GameWorld::activateSpecialAbility(const std::string& abilityType) {
                 }
             }
 
-            std::cout << "All enemies slowed by 70% for 5 seconds!" << std::endl;
+            LOG_INFO("Freeze wave").field("match", getMatchId()).field("slow", 0.7).field("seconds", 5.0);
+            return true;
         } else {
-            std::cout << "Insufficient resources for Freeze Wave!" << std::endl;
+            LOG_LIMITED(LogLevel::Debug, 10, "Freeze wave rejected, insufficient resources")
+                .field("match", getMatchId());
+            return false;
         }
     }
-    else if (abilityType == "repair") {
+    else if (abilityType == AbilityType::Repair) {
         cost = 200;
         if (m_playerResources >= cost) {
             m_playerResources -= cost;
-            std::cout << "\n*** REPAIR ACTIVATED ***" << std::endl;
-
             // Restore health
             int healAmount = 30;
             m_playerHealth = std::min(100, m_playerHealth + healAmount);
 
-            std::cout << "Base repaired! Restored " << healAmount << " health" << std::endl;
+            LOG_INFO("Repair").field("match", getMatchId()).field("health", healAmount);
+            return true;
         } else {
-            std::cout << "Insufficient resources for Repair!" << std::endl;
+            LOG_LIMITED(LogLevel::Debug, 10, "Repair rejected, insufficient resources")
+                .field("match", getMatchId());
+            return false;
         }
     }
-}
\ No newline at end of file
+    return false;
+}
@@ -0,0 +1,148 @@
+#include "InputLog.h"
+#include "JsonReader.h"
+#include "JsonWriter.h"
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+
+namespace {
+
+constexpr int LOG_VERSION = 1;
+
+} // namespace
+
+InputRecorder::InputRecorder(const std::string& path, uint32_t seed, int matchId) : m_out(path) {
+    if (!m_out) {
+        throw std::runtime_error("Cannot create input log " + path);
+    }
+    JsonWriter writer(m_line);
+    writer.beginObject();
+    writer.field(JSON_KEY("matchId"), matchId);
+    writer.field(JSON_KEY("seed"), seed);
+    writer.field(JSON_KEY("type"), "match");
+    writer.field(JSON_KEY("version"), LOG_VERSION);
+    writer.endObject();
+    m_out << m_line << '\n';
+}
+
+void InputRecorder::command(uint32_t tick, const Command& command) {
+    // Positions are written exactly; everything else is an integer
+    m_line.clear();
+    JsonWriter writer(m_line);
+    writer.beginObject();
+    writer.field(JSON_KEY("ability"), static_cast<int>(command.ability));
+    writer.field(JSON_KEY("client"), command.clientId);
+    writer.field(JSON_KEY("command"), static_cast<int>(command.type));
+    writer.field(JSON_KEY("seq"), command.seq);
+    writer.field(JSON_KEY("tick"), tick);
+    writer.field(JSON_KEY("towerId"), command.towerId);
+    writer.field(JSON_KEY("towerType"), command.towerType);
+    writer.field(JSON_KEY("type"), "command");
+    writer.key(JSON_KEY("x"));
+    writer.exactValue(command.position.x);
+    writer.key(JSON_KEY("y"));
+    writer.exactValue(command.position.y);
+    writer.endObject();
+    m_out << m_line << '\n';
+}
+
+void InputRecorder::checkpoint(uint32_t tick, uint64_t stateHash) {
+    writeHash("check", tick, stateHash);
+    // A log cut short by a crash is still good up to here
+    m_out.flush();
+}
+
+void InputRecorder::end(uint32_t tick, uint64_t stateHash) {
+    writeHash("end", tick, stateHash);
+    m_out.flush();
+}
+
+void InputRecorder::writeHash(const char* type, uint32_t tick, uint64_t stateHash) {
+    // Hex, since JSON numbers don't hold 64 bits
+    char hex[16];
+    std::fill(hex, hex + sizeof(hex), '0');
+    auto result = std::to_chars(hex, hex + sizeof(hex), stateHash, 16);
+    std::rotate(hex, result.ptr, hex + sizeof(hex));
+
+    m_line.clear();
+    JsonWriter writer(m_line);
+    writer.beginObject();
+    writer.key(JSON_KEY("hash"));
+    writer.rawValue("\"" + std::string(hex, sizeof(hex)) + "\"");
+    writer.field(JSON_KEY("tick"), tick);
+    writer.key(JSON_KEY("type"));
+    writer.rawValue("\"" + std::string(type) + "\"");
+    writer.endObject();
+    m_out << m_line << '\n';
+}
+
+uint32_t InputLog::lastTick() const {
+    uint32_t last = endTick;
+    if (!checkpoints.empty()) {
+        last = std::max(last, checkpoints.back().tick);
+    }
+    if (!commands.empty()) {
+        last = std::max(last, commands.back().tick);
+    }
+    return last;
+}
+
+InputLog InputLog::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Cannot read input log " + path);
+    }
+
+    InputLog log;
+    JsonDocument document;
+    std::string line;
+    int lineNumber = 0;
+    bool sawHeader = false;
+    while (std::getline(in, line)) {
+        ++lineNumber;
+        if (line.empty()) {
+            continue;
+        }
+        try {
+            JsonValue entry = document.parse(line);
+            std::string_view type = entry["type"].getString();
+            if (type == "match") {
+                if (entry["version"].getInt() != LOG_VERSION) {
+                    throw std::runtime_error("unsupported version");
+                }
+                log.seed = static_cast<uint32_t>(entry["seed"].getDouble());
+                log.matchId = entry["matchId"].getInt();
+                sawHeader = true;
+            } else if (type == "command") {
+                Entry command;
+                command.tick = static_cast<uint32_t>(entry["tick"].getDouble());
+                command.command.type = static_cast<CommandType>(entry["command"].getInt());
+                command.command.clientId = entry["client"].getInt();
+                command.command.seq = static_cast<uint32_t>(entry["seq"].getDouble());
+                command.command.position = Vec2d(entry["x"].getDouble(), entry["y"].getDouble());
+                command.command.towerType = entry["towerType"].getInt();
+                command.command.towerId = entry["towerId"].getInt();
+                command.command.ability = static_cast<AbilityType>(entry["ability"].getInt());
+                log.commands.push_back(command);
+            } else if (type == "check" || type == "end") {
+                Checkpoint checkpoint;
+                checkpoint.tick = static_cast<uint32_t>(entry["tick"].getDouble());
+                std::string_view hex = entry["hash"].getString();
+                auto result = std::from_chars(hex.data(), hex.data() + hex.size(), checkpoint.hash, 16);
+                if (result.ec != std::errc() || result.ptr != hex.data() + hex.size()) {
+                    throw std::runtime_error("bad hash");
+                }
+                log.checkpoints.push_back(checkpoint);
+                if (type == "end") {
+                    log.endTick = checkpoint.tick;
+                }
+            }
+        } catch (const std::exception& e) {
+            throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": " + e.what());
+        }
+    }
+    if (!sawHeader) {
+        throw std::runtime_error(path + " is not an input log");
+    }
+    return log;
+}
@@ -0,0 +1,256 @@
+#include "JobSystem.h"
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+// Which pool, and which of its queues, the current thread owns
+thread_local const JobSystem* t_system = nullptr;
+thread_local size_t t_queue = 0;
+
+// Chunks per thread a parallelFor is cut into at most: enough for idle
+// threads to balance uneven chunks, few enough to keep queue traffic low
+constexpr size_t CHUNKS_PER_THREAD = 4;
+// Failed attempts to find work before a worker goes to sleep
+constexpr int SPINS_BEFORE_SLEEP = 64;
+
+} // namespace
+
+TaskGraph::TaskId TaskGraph::add(std::function<void()> task) {
+    m_tasks.push_back({std::move(task), {}, 0});
+    return m_tasks.size() - 1;
+}
+
+void TaskGraph::precede(TaskId before, TaskId after) {
+    m_tasks[before].successors.push_back(after);
+    ++m_tasks[after].predecessors;
+}
+
+JobSystem::JobSystem(size_t workers) {
+    for (size_t i = 0; i <= workers; ++i) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    m_threads.reserve(workers);
+    for (size_t i = 0; i < workers; ++i) {
+        m_threads.emplace_back([this, i]() { work(i); });
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stopping = true;
+    }
+    m_sleep.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+size_t JobSystem::queueIndex() const {
+    return t_system == this ? t_queue : m_threads.size();
+}
+
+size_t JobSystem::chunkCount(size_t count, size_t grain) const {
+    if (m_threads.empty()) {
+        return 1;
+    }
+    size_t chunks = (count + std::max<size_t>(grain, 1) - 1) / std::max<size_t>(grain, 1);
+    return std::min(chunks, concurrency() * CHUNKS_PER_THREAD);
+}
+
+void JobSystem::runChunks(JobFunction function, void* context, size_t begin, size_t count, size_t chunks) {
+    JobGroup group(chunks);
+    size_t size = count / chunks;
+    size_t extra = count % chunks;
+    auto chunkBegin = [&](size_t chunk) { return begin + chunk * size + std::min(chunk, extra); };
+
+    // The rest go on our own queue for idle threads to steal; the first one
+    // we run straight away. The queued chunks point at group and the caller's
+    // body, so we wait for them even if ours throws.
+    for (size_t chunk = 1; chunk < chunks; ++chunk) {
+        push({function, context, chunkBegin(chunk), chunkBegin(chunk + 1), &group});
+    }
+    wake(chunks - 1);
+    execute({function, context, chunkBegin(0), chunkBegin(1), &group});
+    wait(group);
+}
+
+void JobSystem::run(TaskGraph& graph) {
+    size_t tasks = graph.m_tasks.size();
+    if (tasks == 0) {
+        return;
+    }
+    if (graph.m_remainingSize != tasks) {
+        graph.m_remaining = std::make_unique<std::atomic<int>[]>(tasks);
+        graph.m_remainingSize = tasks;
+    }
+    JobGroup group(tasks);
+    graph.m_system = this;
+    graph.m_group = &group;
+
+    size_t roots = 0;
+    for (size_t i = 0; i < tasks; ++i) {
+        graph.m_remaining[i].store(graph.m_tasks[i].predecessors, std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < tasks; ++i) {
+        if (graph.m_tasks[i].predecessors == 0) {
+            push({&JobSystem::runTask, &graph, i, i + 1, &group});
+            ++roots;
+        }
+    }
+    wake(roots);
+    try {
+        wait(group);
+    } catch (...) {
+        graph.m_group = nullptr;
+        throw;
+    }
+    graph.m_group = nullptr;
+}
+
+void JobSystem::runTask(void* context, size_t task, size_t) {
+    TaskGraph& graph = *static_cast<TaskGraph*>(context);
+    // After a failure the remaining tasks are skipped but still finish, so
+    // the run's pending count reaches zero
+    if (!graph.m_group->failed.load(std::memory_order_acquire)) {
+        try {
+            graph.m_tasks[task].run();
+        } catch (...) {
+            graph.m_group->fail(std::current_exception());
+        }
+    }
+    graph.m_system->finishTask(graph, task);
+}
+
+void JobSystem::finishTask(TaskGraph& graph, size_t task) {
+    // Successors are queued before this task counts as done, so run() can't
+    // return with work still to start
+    for (TaskGraph::TaskId next : graph.m_tasks[task].successors) {
+        if (graph.m_remaining[next].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            push({&JobSystem::runTask, &graph, next, next + 1, graph.m_group});
+            wake(1);
+        }
+    }
+}
+
+void JobSystem::push(const Job& job) {
+    Queue& queue = *m_queues[queueIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(job);
+    }
+    m_queued.fetch_add(1, std::memory_order_release);
+}
+
+bool JobSystem::pop(Job& job, const JobGroup* group) {
+    // Newest first: it is the most likely to still be in cache
+    Queue& queue = *m_queues[queueIndex()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    for (auto it = queue.jobs.rbegin(); it != queue.jobs.rend(); ++it) {
+        if (!group || it->group == group) {
+            job = *it;
+            queue.jobs.erase(std::next(it).base());
+            m_queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JobSystem::steal(Job& job, const JobGroup* group) {
+    // Oldest first: usually the biggest piece of work left
+    size_t own = queueIndex();
+    for (size_t i = 1; i < m_queues.size(); ++i) {
+        Queue& queue = *m_queues[(own + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        for (auto it = queue.jobs.begin(); it != queue.jobs.end(); ++it) {
+            if (!group || it->group == group) {
+                job = *it;
+                queue.jobs.erase(it);
+                m_queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool JobSystem::runOne(const JobGroup* group) {
+    if (m_queued.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+    Job job;
+    if (pop(job, group) || steal(job, group)) {
+        execute(job);
+        return true;
+    }
+    return false;
+}
+
+void JobSystem::execute(const Job& job) {
+    try {
+        job.function(job.context, job.begin, job.end);
+    } catch (...) {
+        job.group->fail(std::current_exception());
+    }
+    job.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::wait(JobGroup& group) {
+    // Help with the group's own jobs instead of blocking; what is left may
+    // be running elsewhere
+    while (group.pending.load(std::memory_order_acquire) != 0) {
+        if (!runOne(&group)) {
+            std::this_thread::yield();
+        }
+    }
+    if (group.error) {
+        std::rethrow_exception(group.error);
+    }
+}
+
+void JobSystem::wake(size_t jobs) {
+    if (jobs == 0 || m_threads.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+    if (m_sleeping == 0) {
+        return;
+    }
+    if (jobs >= m_sleeping) {
+        m_sleep.notify_all();
+    } else {
+        for (size_t i = 0; i < jobs; ++i) {
+            m_sleep.notify_one();
+        }
+    }
+}
+
+void JobSystem::work(size_t index) {
+    t_system = this;
+    t_queue = index;
+    int idle = 0;
+    while (true) {
+        if (runOne(nullptr)) {
+            idle = 0;
+            continue;
+        }
+        if (++idle < SPINS_BEFORE_SLEEP) {
+            std::this_thread::yield();
+            continue;
+        }
+        idle = 0;
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        ++m_sleeping;
+        // push() counts a job before wake() takes this lock, so checking
+        // under it can't miss one
+        m_sleep.wait(lock, [this]() {
+            return m_stopping || m_queued.load(std::memory_order_acquire) > 0;
+        });
+        --m_sleeping;
+        if (m_stopping) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,256 @@
+#include "JsonProtocol.h"
+#include "CellularAutomata.h"
+
+void JsonProtocol::encodeState(std::string& out,
+                               const StateHeader& header,
+                               const std::vector<EntityState>& entities,
+                               const CellularAutomata* terrain,
+                               bool partial) {
+    out.clear();
+    JsonWriter writer(out);
+
+    // Keys must stay in alphabetical order to match the old output
+    writer.beginObject();
+    writer.field(JSON_KEY("currentWave"), header.currentWave);
+
+    writer.key(JSON_KEY("gameState"));
+    if (header.gameState == 1) {
+        writer.value("victory");
+    } else if (header.gameState == 2) {
+        writer.value("gameOver");
+    } else {
+        writer.value("playing");
+    }
+
+    writer.field(JSON_KEY("maxWaves"), header.maxWaves);
+
+    writer.key(JSON_KEY("objects"));
+    writer.beginArray();
+    for (const auto& entity : entities) {
+        encodeEntity(writer, entity);
+    }
+    writer.endArray();
+
+    if (partial) {
+        writer.field(JSON_KEY("partial"), true);
+    }
+    writer.field(JSON_KEY("playerHealth"), header.playerHealth);
+    writer.field(JSON_KEY("playerResources"), header.playerResources);
+
+    if (terrain) {
+        writer.key(JSON_KEY("terrain"));
+        encodeTerrain(writer, *terrain);
+    }
+    writer.field(JSON_KEY("tick"), header.tick);
+    writer.field(JSON_KEY("time"), header.time);
+    writer.endObject();
+}
+
+size_t JsonProtocol::entitySize(const EntityState& entity) {
+    thread_local std::string scratch;
+    scratch.clear();
+    JsonWriter writer(scratch);
+    encodeEntity(writer, entity);
+    return scratch.size() + 1;
+}
+
+void JsonProtocol::encodeTerrainMessage(std::string& out, uint32_t tick,
+                                        const CellularAutomata& terrain) {
+    out.clear();
+    JsonWriter writer(out);
+    writer.beginObject();
+    writer.key(JSON_KEY("terrain"));
+    encodeTerrain(writer, terrain);
+    writer.field(JSON_KEY("tick"), tick);
+    writer.field(JSON_KEY("type"), "terrain");
+    writer.endObject();
+}
+
+void JsonProtocol::encodeInterest(std::string& out, uint32_t tick,
+                                  const std::vector<int>& entered,
+                                  const std::vector<int>& left) {
+    out.clear();
+    JsonWriter writer(out);
+    writer.beginObject();
+    writer.key(JSON_KEY("entered"));
+    writer.beginArray();
+    for (int id : entered) {
+        writer.value(id);
+    }
+    writer.endArray();
+    writer.key(JSON_KEY("left"));
+    writer.beginArray();
+    for (int id : left) {
+        writer.value(id);
+    }
+    writer.endArray();
+    writer.field(JSON_KEY("tick"), tick);
+    writer.field(JSON_KEY("type"), "interest");
+    writer.endObject();
+}
+
+void JsonProtocol::encodeRemoved(std::string& out, uint32_t tick,
+                                 const std::vector<int>& ids, bool reset) {
+    out.clear();
+    JsonWriter writer(out);
+    writer.beginObject();
+    writer.key(JSON_KEY("ids"));
+    writer.beginArray();
+    for (int id : ids) {
+        writer.value(id);
+    }
+    writer.endArray();
+    if (reset) {
+        writer.field(JSON_KEY("reset"), true);
+    }
+    writer.field(JSON_KEY("tick"), tick);
+    writer.field(JSON_KEY("type"), "removed");
+    writer.endObject();
+}
+
+void JsonProtocol::encodeAck(std::string& out, uint32_t seq, CommandResult result,
+                             uint32_t tick, int objectId) {
+    out.clear();
+    JsonWriter writer(out);
+    writer.beginObject();
+    if (objectId != 0) {
+        writer.field(JSON_KEY("id"), objectId);
+    }
+    switch (result) {
+    case CommandResult::Applied:
+        writer.field(JSON_KEY("result"), "applied");
+        break;
+    case CommandResult::Rejected:
+        writer.field(JSON_KEY("result"), "rejected");
+        break;
+    case CommandResult::Invalid:
+        writer.field(JSON_KEY("result"), "invalid");
+        break;
+    case CommandResult::Dropped:
+        writer.field(JSON_KEY("result"), "dropped");
+        break;
+    }
+    writer.field(JSON_KEY("seq"), seq);
+    if (tick != 0) {
+        writer.field(JSON_KEY("tick"), tick);
+    }
+    writer.field(JSON_KEY("type"), "ack");
+    writer.endObject();
+}
+
+void JsonProtocol::encodeProjectileEvents(std::string& out, uint32_t tick,
+                                          const std::vector<ProjectileSpawn>& spawns,
+                                          const std::vector<ProjectileRemoval>& removals) {
+    out.clear();
+    JsonWriter writer(out);
+    writer.beginObject();
+    writer.key(JSON_KEY("removed"));
+    writer.beginArray();
+    for (const ProjectileRemoval& removal : removals) {
+        writer.beginArray();
+        writer.value(removal.id);
+        writer.value(removal.tick);
+        writer.value(removal.hit);
+        writer.endArray();
+    }
+    writer.endArray();
+    // The client integrates from these values, so they must not be rounded
+    writer.key(JSON_KEY("spawned"));
+    writer.beginArray();
+    for (const ProjectileSpawn& spawn : spawns) {
+        writer.beginArray();
+        writer.value(spawn.id);
+        writer.value(spawn.tick);
+        writer.exactValue(spawn.position.x);
+        writer.exactValue(spawn.position.y);
+        writer.exactValue(spawn.velocity.x);
+        writer.exactValue(spawn.velocity.y);
+        writer.endArray();
+    }
+    writer.endArray();
+    writer.field(JSON_KEY("tick"), tick);
+    writer.field(JSON_KEY("type"), "projectiles");
+    writer.endObject();
+}
+
+void JsonProtocol::encodeField(std::string& out, uint32_t tick, int tickRate,
+                               const std::vector<FieldBody>& bodies) {
+    out.clear();
+    JsonWriter writer(out);
+    writer.beginObject();
+    writer.key(JSON_KEY("bodies"));
+    writer.beginArray();
+    for (const FieldBody& body : bodies) {
+        writer.beginArray();
+        writer.exactValue(body.position.x);
+        writer.exactValue(body.position.y);
+        writer.exactValue(body.mass);
+        writer.endArray();
+    }
+    writer.endArray();
+    writer.key(JSON_KEY("gravity"));
+    writer.exactValue(PhysicsEngine::GRAVITATIONAL_CONSTANT);
+    writer.field(JSON_KEY("tick"), tick);
+    writer.field(JSON_KEY("tickRate"), tickRate);
+    writer.field(JSON_KEY("type"), "field");
+    writer.endObject();
+}
+
+void JsonProtocol::encodeEntity(JsonWriter& writer, const EntityState& entity) {
+    // Keys must stay in alphabetical order to match the old output
+    writer.beginObject();
+    if (entity.has(FIELD_DAMAGE)) writer.field(JSON_KEY("damage"), entity.damage);
+    if (entity.has(FIELD_ENEMY_TYPE)) writer.field(JSON_KEY("enemyType"), entity.enemyType);
+    if (entity.has(FIELD_FIRE_RATE)) writer.field(JSON_KEY("fireRate"), entity.fireRate);
+    if (entity.has(FIELD_GRAVITY_STRENGTH)) writer.field(JSON_KEY("gravityStrength"), entity.gravityStrength);
+    if (entity.has(FIELD_HAS_PATH)) writer.field(JSON_KEY("hasPath"), true);
+    if (entity.has(FIELD_HEALTH)) writer.field(JSON_KEY("health"), entity.health);
+    writer.field(JSON_KEY("id"), entity.id);
+    if (entity.has(FIELD_IS_BOSS)) writer.field(JSON_KEY("isBoss"), true);
+    if (entity.has(FIELD_IS_SLOWED)) writer.field(JSON_KEY("isSlowed"), true);
+    if (entity.has(FIELD_MAX_HEALTH)) writer.field(JSON_KEY("maxHealth"), entity.maxHealth);
+    if (entity.has(FIELD_OWNER)) writer.field(JSON_KEY("owner"), entity.owner);
+    if (entity.has(FIELD_PATH_LENGTH)) writer.field(JSON_KEY("pathLength"), entity.pathLength);
+    writer.key(JSON_KEY("position"));
+    encodeVec2d(writer, entity.position);
+    if (entity.has(FIELD_RADIUS)) writer.field(JSON_KEY("radius"), entity.radius);
+    if (entity.has(FIELD_RANGE)) writer.field(JSON_KEY("range"), entity.range);
+    if (entity.has(FIELD_SLOW_FACTOR)) writer.field(JSON_KEY("slowFactor"), entity.slowFactor);
+    if (entity.has(FIELD_SPEED)) writer.field(JSON_KEY("speed"), entity.speed);
+    if (entity.has(FIELD_SPLASH_RADIUS)) writer.field(JSON_KEY("splashRadius"), entity.splashRadius);
+    if (entity.has(FIELD_TOWER_TYPE)) writer.field(JSON_KEY("towerType"), entity.towerType);
+    writer.field(JSON_KEY("type"), entity.type);
+    if (entity.has(FIELD_UPGRADE_COST)) writer.field(JSON_KEY("upgradeCost"), entity.upgradeCost);
+    if (entity.has(FIELD_UPGRADE_LEVEL)) writer.field(JSON_KEY("upgradeLevel"), entity.upgradeLevel);
+    writer.key(JSON_KEY("velocity"));
+    encodeVec2d(writer, entity.velocity);
+    writer.endObject();
+}
+
+void JsonProtocol::encodeVec2d(JsonWriter& writer, const Vec2d& v) {
+    writer.beginObject();
+    writer.field(JSON_KEY("x"), v.x);
+    writer.field(JSON_KEY("y"), v.y);
+    writer.endObject();
+}
+
+void JsonProtocol::encodeTerrain(JsonWriter& writer, const CellularAutomata& terrain) {
+    writer.beginObject();
+    writer.field(JSON_KEY("cellSize"), terrain.getCellSize());
+
+    writer.key(JSON_KEY("cells"));
+    writer.beginArray();
+    const auto& grid = terrain.getGrid();
+    for (int y = 0; y < terrain.getHeight(); ++y) {
+        writer.beginArray();
+        for (int x = 0; x < terrain.getWidth(); ++x) {
+            writer.value(static_cast<int>(grid[y][x]));
+        }
+        writer.endArray();
+    }
+    writer.endArray();
+
+    writer.field(JSON_KEY("height"), terrain.getHeight());
+    writer.field(JSON_KEY("width"), terrain.getWidth());
+    writer.endObject();
+}
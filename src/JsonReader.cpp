@@ -0,0 +1,539 @@
+#include "JsonReader.h"
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const JsonNode kNullNode;
+
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+void appendUtf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// JsonValue
+
+const JsonNode* JsonValue::node() const {
+    if (!m_document || m_index >= m_document->m_nodes.size()) {
+        return &kNullNode;
+    }
+    return &m_document->m_nodes[m_index];
+}
+
+JsonType JsonValue::type() const {
+    return node()->type;
+}
+
+JsonValue JsonValue::operator[](std::string_view key) const {
+    const JsonNode* n = node();
+    if (n->type != JsonType::Object) {
+        return JsonValue();
+    }
+    const auto& nodes = m_document->m_nodes;
+    uint32_t index = m_index + 1;
+    for (uint32_t i = 0; i < n->count; ++i) {
+        uint32_t valueIndex = index + 1;
+        if (nodes[index].text == key) {
+            return JsonValue(m_document, valueIndex);
+        }
+        index = nodes[valueIndex].end;
+    }
+    return JsonValue();
+}
+
+JsonValue JsonValue::at(size_t position) const {
+    const JsonNode* n = node();
+    if (n->type != JsonType::Array || position >= n->count) {
+        return JsonValue();
+    }
+    const auto& nodes = m_document->m_nodes;
+    uint32_t index = m_index + 1;
+    for (size_t i = 0; i < position; ++i) {
+        index = nodes[index].end;
+    }
+    return JsonValue(m_document, index);
+}
+
+size_t JsonValue::size() const {
+    const JsonNode* n = node();
+    return (n->type == JsonType::Array || n->type == JsonType::Object) ? n->count : 0;
+}
+
+std::string_view JsonValue::getString() const {
+    const JsonNode* n = node();
+    if (n->type != JsonType::String) {
+        throw std::runtime_error("json value is not a string");
+    }
+    return n->text;
+}
+
+bool JsonValue::getBool() const {
+    const JsonNode* n = node();
+    if (n->type != JsonType::Bool) {
+        throw std::runtime_error("json value is not a bool");
+    }
+    return n->boolean;
+}
+
+double JsonValue::getDouble() const {
+    const JsonNode* n = node();
+    if (n->type != JsonType::Number) {
+        throw std::runtime_error("json value is not a number");
+    }
+    return n->number;
+}
+
+int JsonValue::getInt() const {
+    double value = getDouble();
+    if (!(value > static_cast<double>(std::numeric_limits<int>::min()) - 1.0 &&
+          value < static_cast<double>(std::numeric_limits<int>::max()) + 1.0)) {
+        throw std::runtime_error("json number out of int range");
+    }
+    return static_cast<int>(value);
+}
+
+std::string_view JsonValue::raw() const {
+    if (!m_document || m_index >= m_document->m_nodes.size()) {
+        return std::string_view();
+    }
+    const JsonNode& n = m_document->m_nodes[m_index];
+    return m_document->m_input.substr(n.rawOffset, n.rawLength);
+}
+
+// ---------------------------------------------------------------------------
+// JsonDocument
+
+JsonValue JsonDocument::parse(std::string_view input) {
+    if (input.size() >= std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("json input too large");
+    }
+
+    m_input = input;
+    m_pos = 0;
+    m_nodes.clear();
+    m_strings.clear();
+    // Decoded strings are never longer than their source, so this keeps
+    // every view into m_strings valid for the whole parse
+    m_strings.reserve(input.size());
+
+    // Open containers, innermost last
+    uint32_t stack[MAX_DEPTH];
+    int depth = 0;
+    bool expectKey = false;
+
+    for (;;) {
+        skipWhitespace();
+
+        if (expectKey) {
+            if (m_pos >= m_input.size() || m_input[m_pos] != '"') {
+                fail("expected object key");
+            }
+            uint32_t keyIndex = addNode(JsonType::String, m_pos);
+            parseString(m_nodes[keyIndex]);
+            skipWhitespace();
+            if (m_pos >= m_input.size() || m_input[m_pos] != ':') {
+                fail("expected ':' after object key");
+            }
+            ++m_pos;
+            skipWhitespace();
+            expectKey = false;
+        }
+
+        // Parse one value
+        if (m_pos >= m_input.size()) {
+            fail("unexpected end of input");
+        }
+        char c = m_input[m_pos];
+        if (c == '{' || c == '[') {
+            if (depth == MAX_DEPTH) {
+                fail("json nested too deeply");
+            }
+            bool isObject = (c == '{');
+            uint32_t index = addNode(isObject ? JsonType::Object : JsonType::Array, m_pos);
+            ++m_pos;
+            skipWhitespace();
+            char close = isObject ? '}' : ']';
+            if (m_pos < m_input.size() && m_input[m_pos] == close) {
+                ++m_pos;
+                JsonNode& n = m_nodes[index];
+                n.end = static_cast<uint32_t>(m_nodes.size());
+                n.rawLength = static_cast<uint32_t>(m_pos - n.rawOffset);
+            } else {
+                stack[depth++] = index;
+                expectKey = isObject;
+                continue;
+            }
+        } else if (c == '"') {
+            uint32_t index = addNode(JsonType::String, m_pos);
+            parseString(m_nodes[index]);
+        } else if (c == '-' || isDigit(c)) {
+            uint32_t index = addNode(JsonType::Number, m_pos);
+            parseNumber(m_nodes[index]);
+        } else if (c == 't') {
+            uint32_t index = addNode(JsonType::Bool, m_pos);
+            parseLiteral("true");
+            m_nodes[index].boolean = true;
+            m_nodes[index].rawLength = 4;
+        } else if (c == 'f') {
+            uint32_t index = addNode(JsonType::Bool, m_pos);
+            parseLiteral("false");
+            m_nodes[index].rawLength = 5;
+        } else if (c == 'n') {
+            uint32_t index = addNode(JsonType::Null, m_pos);
+            parseLiteral("null");
+            m_nodes[index].rawLength = 4;
+        } else {
+            fail("invalid json value");
+        }
+
+        // After a value: separators and closing brackets
+        for (;;) {
+            if (depth == 0) {
+                skipWhitespace();
+                if (m_pos != m_input.size()) {
+                    fail("trailing characters in json");
+                }
+                return root();
+            }
+
+            JsonNode& parent = m_nodes[stack[depth - 1]];
+            parent.count++;
+            skipWhitespace();
+            if (m_pos >= m_input.size()) {
+                fail("unexpected end of input");
+            }
+
+            bool isObject = parent.type == JsonType::Object;
+            char sep = m_input[m_pos++];
+            if (sep == ',') {
+                expectKey = isObject;
+                break;
+            }
+            if (sep != (isObject ? '}' : ']')) {
+                fail(isObject ? "expected ',' or '}'" : "expected ',' or ']'");
+            }
+            parent.end = static_cast<uint32_t>(m_nodes.size());
+            parent.rawLength = static_cast<uint32_t>(m_pos - parent.rawOffset);
+            --depth;
+        }
+    }
+}
+
+void JsonDocument::skipWhitespace() {
+    while (m_pos < m_input.size()) {
+        char c = m_input[m_pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            break;
+        }
+        ++m_pos;
+    }
+}
+
+uint32_t JsonDocument::addNode(JsonType type, size_t start) {
+    JsonNode node;
+    node.type = type;
+    node.rawOffset = static_cast<uint32_t>(start);
+    m_nodes.push_back(node);
+    uint32_t index = static_cast<uint32_t>(m_nodes.size() - 1);
+    m_nodes[index].end = index + 1;
+    return index;
+}
+
+size_t JsonDocument::skipPlainChars(size_t pos) const {
+    // Plain characters are printable ASCII other than '"' and '\'
+    const char* data = m_input.data();
+    size_t size = m_input.size();
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(0x20);
+    while (pos + 16 <= size) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        // Signed compare flags both control characters and bytes >= 0x80
+        __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_cmplt_epi8(chunk, space));
+        int mask = _mm_movemask_epi8(special);
+        if (mask != 0) {
+            return pos + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+        pos += 16;
+    }
+#endif
+    while (pos < size) {
+        unsigned char c = static_cast<unsigned char>(data[pos]);
+        if (c == '"' || c == '\\' || c < 0x20 || c >= 0x80) {
+            break;
+        }
+        ++pos;
+    }
+    return pos;
+}
+
+size_t JsonDocument::validateUtf8(size_t pos) const {
+    auto byteAt = [&](size_t i) -> unsigned {
+        if (i >= m_input.size()) fail("truncated utf-8 sequence");
+        return static_cast<unsigned char>(m_input[i]);
+    };
+    auto continuation = [&](size_t i) {
+        if ((byteAt(i) & 0xC0) != 0x80) fail("invalid utf-8 sequence");
+    };
+
+    unsigned lead = byteAt(pos);
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        continuation(pos + 1);
+        return pos + 2;
+    }
+    if (lead >= 0xE0 && lead <= 0xEF) {
+        unsigned second = byteAt(pos + 1);
+        // Reject overlong encodings and UTF-16 surrogates
+        if ((lead == 0xE0 && second < 0xA0) || (lead == 0xED && second > 0x9F)) {
+            fail("invalid utf-8 sequence");
+        }
+        continuation(pos + 1);
+        continuation(pos + 2);
+        return pos + 3;
+    }
+    if (lead >= 0xF0 && lead <= 0xF4) {
+        unsigned second = byteAt(pos + 1);
+        // Reject overlong encodings and code points above U+10FFFF
+        if ((lead == 0xF0 && second < 0x90) || (lead == 0xF4 && second > 0x8F)) {
+            fail("invalid utf-8 sequence");
+        }
+        continuation(pos + 1);
+        continuation(pos + 2);
+        continuation(pos + 3);
+        return pos + 4;
+    }
+    fail("invalid utf-8 sequence");
+}
+
+size_t JsonDocument::validateEscape(size_t pos) const {
+    // pos is at the backslash
+    if (pos + 1 >= m_input.size()) {
+        fail("unterminated string");
+    }
+    switch (m_input[pos + 1]) {
+        case '"': case '\\': case '/': case 'b':
+        case 'f': case 'n': case 'r': case 't':
+            return pos + 2;
+        case 'u':
+            if (pos + 6 > m_input.size()) {
+                fail("truncated unicode escape");
+            }
+            for (size_t i = pos + 2; i < pos + 6; ++i) {
+                if (hexValue(m_input[i]) < 0) {
+                    fail("invalid unicode escape");
+                }
+            }
+            return pos + 6;
+        default:
+            fail("invalid escape sequence");
+    }
+}
+
+void JsonDocument::parseString(JsonNode& node) {
+    // m_pos is at the opening quote
+    size_t begin = ++m_pos;
+    bool hasEscapes = false;
+
+    for (;;) {
+        m_pos = skipPlainChars(m_pos);
+        if (m_pos >= m_input.size()) {
+            fail("unterminated string");
+        }
+        unsigned char c = static_cast<unsigned char>(m_input[m_pos]);
+        if (c == '"') {
+            break;
+        }
+        if (c == '\\') {
+            hasEscapes = true;
+            m_pos = validateEscape(m_pos);
+        } else if (c < 0x20) {
+            fail("control character in string");
+        } else {
+            m_pos = validateUtf8(m_pos);
+        }
+    }
+
+    size_t end = m_pos++;
+    node.rawLength = static_cast<uint32_t>(m_pos - node.rawOffset);
+    if (hasEscapes) {
+        decodeString(begin, end, node);
+    } else {
+        node.text = m_input.substr(begin, end - begin);
+    }
+}
+
+void JsonDocument::decodeString(size_t begin, size_t end, JsonNode& node) {
+    // Escapes were validated by parseString
+    size_t start = m_strings.size();
+    size_t pos = begin;
+    while (pos < end) {
+        char c = m_input[pos];
+        if (c != '\\') {
+            m_strings.push_back(c);
+            ++pos;
+            continue;
+        }
+        char e = m_input[pos + 1];
+        pos += 2;
+        switch (e) {
+            case 'b': m_strings.push_back('\b'); break;
+            case 'f': m_strings.push_back('\f'); break;
+            case 'n': m_strings.push_back('\n'); break;
+            case 'r': m_strings.push_back('\r'); break;
+            case 't': m_strings.push_back('\t'); break;
+            case 'u': {
+                auto readHex = [&](size_t at) {
+                    uint32_t v = 0;
+                    for (size_t i = at; i < at + 4; ++i) {
+                        v = (v << 4) | static_cast<uint32_t>(hexValue(m_input[i]));
+                    }
+                    return v;
+                };
+                uint32_t cp = readHex(pos);
+                pos += 4;
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    // Combine a surrogate pair; a lone half becomes U+FFFD
+                    if (pos + 6 <= end && m_input[pos] == '\\' && m_input[pos + 1] == 'u') {
+                        uint32_t low = readHex(pos + 2);
+                        if (low >= 0xDC00 && low <= 0xDFFF) {
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                            pos += 6;
+                        } else {
+                            cp = 0xFFFD;
+                        }
+                    } else {
+                        cp = 0xFFFD;
+                    }
+                } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                    cp = 0xFFFD;
+                }
+                appendUtf8(m_strings, cp);
+                break;
+            }
+            default: m_strings.push_back(e); break;  // " \ /
+        }
+    }
+    node.text = std::string_view(m_strings.data() + start, m_strings.size() - start);
+}
+
+void JsonDocument::parseNumber(JsonNode& node) {
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    size_t start = m_pos;
+    size_t size = m_input.size();
+    // Where the digits are, to tell overflow from underflow below
+    size_t integerStart = 0;
+    size_t integerEnd = 0;
+    size_t fractionStart = 0;
+    size_t fractionEnd = 0;
+    size_t exponentStart = 0;
+    bool negativeExponent = false;
+
+    if (m_input[m_pos] == '-') ++m_pos;
+    if (m_pos >= size || !isDigit(m_input[m_pos])) {
+        fail("invalid number");
+    }
+    integerStart = m_pos;
+    if (m_input[m_pos] == '0') {
+        ++m_pos;
+    } else {
+        while (m_pos < size && isDigit(m_input[m_pos])) ++m_pos;
+    }
+    integerEnd = fractionStart = fractionEnd = m_pos;
+    if (m_pos < size && m_input[m_pos] == '.') {
+        ++m_pos;
+        if (m_pos >= size || !isDigit(m_input[m_pos])) {
+            fail("invalid number");
+        }
+        fractionStart = m_pos;
+        while (m_pos < size && isDigit(m_input[m_pos])) ++m_pos;
+        fractionEnd = m_pos;
+    }
+    if (m_pos < size && (m_input[m_pos] == 'e' || m_input[m_pos] == 'E')) {
+        ++m_pos;
+        if (m_pos < size && (m_input[m_pos] == '+' || m_input[m_pos] == '-')) {
+            negativeExponent = m_input[m_pos] == '-';
+            ++m_pos;
+        }
+        if (m_pos >= size || !isDigit(m_input[m_pos])) {
+            fail("invalid number");
+        }
+        exponentStart = m_pos;
+        while (m_pos < size && isDigit(m_input[m_pos])) ++m_pos;
+    }
+
+    node.rawLength = static_cast<uint32_t>(m_pos - start);
+    const char* first = m_input.data() + start;
+    const char* last = m_input.data() + m_pos;
+    auto result = std::from_chars(first, last, node.number);
+    if (result.ec == std::errc::result_out_of_range) {
+        // Valid JSON, just not representable: saturate like strtod. The
+        // power of ten of the first significant digit says which way; out
+        // of range it is beyond 308 or below -324, never near 0.
+        int64_t magnitude = 0;
+        if (exponentStart != 0) {
+            for (size_t i = exponentStart; i < m_pos && magnitude < 1000000; ++i) {
+                magnitude = magnitude * 10 + (m_input[i] - '0');
+            }
+            if (negativeExponent) {
+                magnitude = -magnitude;
+            }
+        }
+        if (m_input[integerStart] != '0') {
+            magnitude += static_cast<int64_t>(integerEnd - integerStart) - 1;
+        } else {
+            size_t digit = fractionStart;
+            while (digit < fractionEnd && m_input[digit] == '0') ++digit;
+            magnitude -= static_cast<int64_t>(digit - fractionStart) + 1;
+        }
+        bool negative = *first == '-';
+        node.number = magnitude < 0 ? (negative ? -0.0 : 0.0)
+                                    : (negative ? -HUGE_VAL : HUGE_VAL);
+    } else if (result.ec != std::errc() || result.ptr != last) {
+        fail("invalid number");
+    }
+}
+
+void JsonDocument::parseLiteral(std::string_view literal) {
+    if (m_input.compare(m_pos, literal.size(), literal) != 0) {
+        fail("invalid json value");
+    }
+    m_pos += literal.size();
+}
+
+void JsonDocument::fail(const char* message) const {
+    throw std::runtime_error(std::string(message) + " at offset " + std::to_string(m_pos));
+}
@@ -0,0 +1,257 @@
+#include "Log.h"
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+std::atomic<LogLevel> Log::s_level{LogLevel::Info};
+
+namespace {
+
+// How long a line can wait before the writer picks it up
+constexpr auto WRITE_INTERVAL = std::chrono::milliseconds(5);
+
+struct Entry {
+    int64_t timeUs;
+    LogLevel level;
+    uint8_t size;
+    char text[Log::LINE_SIZE];
+};
+static_assert(Log::LINE_SIZE <= UINT8_MAX, "Entry sizes are stored in a byte");
+
+// Single producer, single consumer: the thread that owns it writes, the
+// writer thread reads. Indices only grow; the slot is the index mod size.
+struct Ring {
+    Entry entries[Log::RING_SIZE];
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    bool owned = false;     // Under Logger::m_mutex
+};
+
+class Logger {
+public:
+    Logger() : m_writer([this]() { writeLoop(); }) {}
+
+    ~Logger() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        m_writer.join();
+    }
+
+    // A ring for the calling thread; rings of threads that have exited are
+    // reused, anything still in them is written first as usual
+    Ring* acquire() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& ring : m_rings) {
+            if (!ring->owned) {
+                ring->owned = true;
+                return ring.get();
+            }
+        }
+        m_rings.push_back(std::make_unique<Ring>());
+        m_rings.back()->owned = true;
+        return m_rings.back().get();
+    }
+
+    void release(Ring* ring) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ring->owned = false;
+    }
+
+    void push(Ring& ring, LogLevel level, const char* text, size_t size) {
+        uint64_t head = ring.head.load(std::memory_order_relaxed);
+        if (head - ring.tail.load(std::memory_order_acquire) == Log::RING_SIZE) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Entry& entry = ring.entries[head % Log::RING_SIZE];
+        entry.timeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        entry.level = level;
+        entry.size = static_cast<uint8_t>(std::min(size, Log::LINE_SIZE));
+        std::memcpy(entry.text, text, entry.size);
+        ring.head.store(head + 1, std::memory_order_release);
+    }
+
+    void flush() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        std::vector<std::pair<Ring*, uint64_t>> targets;
+        for (auto& ring : m_rings) {
+            targets.emplace_back(ring.get(), ring->head.load(std::memory_order_acquire));
+        }
+        m_flushRequested = true;
+        m_wake.notify_all();
+        m_drained.wait(lock, [&targets]() {
+            for (auto& [ring, head] : targets) {
+                if (ring->tail.load(std::memory_order_acquire) < head) {
+                    return false;
+                }
+            }
+            return true;
+        });
+    }
+
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    void writeLoop() {
+        std::vector<Ring*> rings;
+        bool stopping = false;
+        while (!stopping) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait_for(lock, WRITE_INTERVAL, [this]() { return m_stopping || m_flushRequested; });
+                stopping = m_stopping;
+                m_flushRequested = false;
+                rings.clear();
+                for (auto& ring : m_rings) {
+                    rings.push_back(ring.get());
+                }
+            }
+            drain(rings);
+            {
+                // Taken so a flush() between checking and waiting can't miss it
+                std::lock_guard<std::mutex> lock(m_mutex);
+            }
+            m_drained.notify_all();
+        }
+    }
+
+    // Writes everything queued so far, merging the rings in time order
+    void drain(const std::vector<Ring*>& rings) {
+        m_heads.resize(rings.size());
+        for (size_t i = 0; i < rings.size(); ++i) {
+            m_heads[i] = rings[i]->head.load(std::memory_order_acquire);
+        }
+        while (true) {
+            Ring* next = nullptr;
+            const Entry* oldest = nullptr;
+            for (size_t i = 0; i < rings.size(); ++i) {
+                uint64_t tail = rings[i]->tail.load(std::memory_order_relaxed);
+                if (tail == m_heads[i]) {
+                    continue;
+                }
+                const Entry& entry = rings[i]->entries[tail % Log::RING_SIZE];
+                if (!oldest || entry.timeUs < oldest->timeUs) {
+                    next = rings[i];
+                    oldest = &entry;
+                }
+            }
+            if (!next) {
+                break;
+            }
+            format(*oldest);
+            next->tail.fetch_add(1, std::memory_order_release);
+        }
+
+        uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+        if (dropped != m_reportedDropped) {
+            char line[64];
+            int size = std::snprintf(line, sizeof(line), "Log dropped %llu lines, writer fell behind\n",
+                                     static_cast<unsigned long long>(dropped - m_reportedDropped));
+            m_err.append(line, static_cast<size_t>(size));
+            m_reportedDropped = dropped;
+        }
+        if (!m_out.empty()) {
+            std::fwrite(m_out.data(), 1, m_out.size(), stdout);
+            std::fflush(stdout);
+            m_out.clear();
+        }
+        if (!m_err.empty()) {
+            std::fwrite(m_err.data(), 1, m_err.size(), stderr);
+            std::fflush(stderr);
+            m_err.clear();
+        }
+    }
+
+    void format(const Entry& entry) {
+        static const char* const LEVELS[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+        int64_t seconds = entry.timeUs / 1000000;
+        if (seconds != m_clockSecond) {
+            std::time_t time = static_cast<std::time_t>(seconds);
+            std::tm local{};
+            localtime_r(&time, &local);
+            std::strftime(m_clock, sizeof(m_clock), "%H:%M:%S", &local);
+            m_clockSecond = seconds;
+        }
+        char prefix[32];
+        int size = std::snprintf(prefix, sizeof(prefix), "%s.%03d %s ", m_clock,
+                                 static_cast<int>(entry.timeUs / 1000 % 1000),
+                                 LEVELS[static_cast<int>(entry.level)]);
+        std::string& out = entry.level >= LogLevel::Warn ? m_err : m_out;
+        out.append(prefix, static_cast<size_t>(size));
+        out.append(entry.text, entry.size);
+        out.push_back('\n');
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_drained;
+    std::vector<std::unique_ptr<Ring>> m_rings;     // Under m_mutex; never shrinks
+    bool m_stopping = false;        // Under m_mutex
+    bool m_flushRequested = false;  // Under m_mutex
+    std::atomic<uint64_t> m_dropped{0};
+    // Writer thread only
+    std::vector<uint64_t> m_heads;
+    std::string m_out;
+    std::string m_err;
+    uint64_t m_reportedDropped = 0;
+    int64_t m_clockSecond = -1;
+    char m_clock[16] = {};
+    std::thread m_writer;
+};
+
+Logger& logger() {
+    static Logger instance;
+    return instance;
+}
+
+// Hands the thread's ring back when the thread exits
+struct ThreadRing {
+    Ring* ring = nullptr;
+    ~ThreadRing() {
+        if (ring) {
+            logger().release(ring);
+        }
+    }
+};
+
+thread_local ThreadRing t_ring;
+
+} // namespace
+
+void Log::write(LogLevel level, const char* text, size_t size) {
+    Logger& log = logger();
+    if (!t_ring.ring) {
+        t_ring.ring = log.acquire();
+    }
+    log.push(*t_ring.ring, level, text, size);
+}
+
+bool Log::parseLevel(std::string_view name, LogLevel& level) {
+    static const std::pair<std::string_view, LogLevel> NAMES[] = {
+        {"debug", LogLevel::Debug}, {"info", LogLevel::Info}, {"warn", LogLevel::Warn}, {"error", LogLevel::Error}};
+    for (const auto& [levelName, value] : NAMES) {
+        if (name == levelName) {
+            level = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Log::flush() {
+    logger().flush();
+}
+
+uint64_t Log::dropped() {
+    return logger().dropped();
+}
@@ -0,0 +1,563 @@
+#include "MatchHost.h"
+#include "Allocations.h"
+#include "Log.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+namespace {
+
+// Reports between logged phase times, about ten seconds
+constexpr int PHASE_REPORT_INTERVAL = 10;
+
+} // namespace
+
+MatchHost::MatchHost(const MatchHostOptions& options)
+    : m_options(options), m_jobs(static_cast<size_t>(std::max(0, options.workers))) {
+    Profiler::enable(m_options.profile);
+    if (m_options.stress.enabled() && !m_options.recordDir.empty()) {
+        LOG_WARN("Stressed matches are recorded without their synthetic load and won't replay");
+    }
+    m_options.matches = std::max(1, m_options.matches);
+    m_matches.resize(m_options.matches);
+    for (int i = 0; i < m_options.matches; ++i) {
+        m_matches[i].world = createMatch(i);
+    }
+
+    m_server.set_validate_handler(
+        [this](websocket::ConnectionHandle hdl, const std::string& path) { return this->route(hdl, path); });
+    m_server.set_open_handler(
+        [this](websocket::ConnectionHandle hdl) { this->on_open(hdl); });
+    m_server.set_close_handler(
+        [this](websocket::ConnectionHandle hdl) { this->on_close(hdl); });
+    m_server.set_message_handler(
+        [this](websocket::ConnectionHandle hdl, const std::string& msg) { this->on_message(hdl, msg); });
+    m_server.set_pong_handler(
+        [this](websocket::ConnectionHandle hdl, const std::string& payload) { this->on_pong(hdl, payload); });
+    m_server.set_error_handler([](const std::string& error) { LOG_WARN(error); });
+    m_server.set_http_handler([this](const std::string& target, std::string& contentType, std::string& body) {
+        if (target.substr(0, target.find('?')) != "/metrics") {
+            return false;
+        }
+        contentType = PrometheusWriter::CONTENT_TYPE;
+        this->renderMetrics(body);
+        return true;
+    });
+}
+
+MatchHost::~MatchHost() {
+    {
+        std::lock_guard<std::mutex> lock(m_publishMutex);
+        m_publishStopping = true;
+    }
+    m_publishSignal.notify_all();
+    if (m_publishThread.joinable()) {
+        m_publishThread.join();
+    }
+    m_server.stop();
+    if (m_serverThread.joinable()) {
+        m_serverThread.join();
+    }
+    if (m_traceThread.joinable()) {
+        m_traceThread.join();
+    }
+}
+
+int MatchHost::parseMatchPath(const std::string& path, int matches) {
+    std::string target = path.substr(0, path.find('?'));
+    if (target == "/") {
+        return 0;
+    }
+    static const std::string prefix = "/match/";
+    if (target.compare(0, prefix.size(), prefix) != 0) {
+        return -1;
+    }
+    const char* begin = target.data() + prefix.size();
+    const char* end = target.data() + target.size();
+    int match = -1;
+    auto parsed = std::from_chars(begin, end, match);
+    if (parsed.ec != std::errc() || parsed.ptr != end || match < 0 || match >= matches) {
+        return -1;
+    }
+    return match;
+}
+
+std::unique_ptr<GameWorld> MatchHost::createMatch(int matchId) {
+    auto world = std::make_unique<GameWorld>(m_server, m_jobs, matchId);
+    uint32_t seed = nextSeed();
+    world->seed(seed);
+    if (m_options.stress.enabled()) {
+        world->stress(std::make_unique<StressScenario>(m_options.stress, seed));
+    }
+    if (!m_options.recordDir.empty()) {
+        std::string path = m_options.recordDir + "/match-" + std::to_string(matchId) +
+                           "-seed-" + std::to_string(seed) + ".jsonl";
+        try {
+            world->record(std::make_unique<InputRecorder>(path, seed, matchId));
+        } catch (const std::exception& e) {
+            LOG_ERROR("Not recording match").field("match", matchId).field("error", e.what());
+        }
+    }
+    world->init();
+    return world;
+}
+
+uint32_t MatchHost::nextSeed() {
+    // Random seeds are still known, so any match can be recorded
+    if (m_options.seed == 0) {
+        return std::random_device{}();
+    }
+    return m_options.seed + m_seedsUsed++;
+}
+
+void MatchHost::run() {
+    bool headless = m_options.headless;
+    Profiler::nameThread("frame");
+    if (headless) {
+        std::cout << "Running " << m_matches.size() << " matches headless on " << m_jobs.concurrency()
+                  << " threads" << std::endl;
+    } else {
+        m_server.listen(m_options.port);
+        m_serverThread = std::thread([this]() {
+            Profiler::nameThread("network");
+            m_server.run();
+        });
+        m_publishThread = std::thread([this]() {
+            Profiler::nameThread("publish");
+            publishLoop();
+        });
+        std::cout << "Hosting " << m_matches.size() << " matches on " << m_jobs.concurrency()
+                  << " threads, WebSocket server on port " << m_options.port << std::endl;
+    }
+
+    // Every tick advances the simulation by one period, whenever it
+    // actually runs, so the simulation doesn't depend on the wall clock
+    const double deltaTime = 1.0 / GameWorld::SIM_RATE;
+    TickScheduler scheduler(std::chrono::nanoseconds(1000000000 / GameWorld::SIM_RATE), !headless);
+    auto started = std::chrono::steady_clock::now();
+    auto lastReport = started;
+
+    while (!m_stopRequested.load()) {
+        if (m_options.ticks != 0 && scheduler.ticks() == m_options.ticks) {
+            break;
+        }
+        scheduler.waitForTick();
+        auto currentTime = std::chrono::high_resolution_clock::now();
+
+        // Matches are independent, and each is only ever ticked by one
+        // thread at a time
+        {
+            PROFILE_SCOPE(Phase::Frame);
+            m_jobs.parallelFor(0, m_matches.size(), 1, [this, deltaTime](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    tickMatch(m_matches[i], deltaTime);
+                }
+            });
+        }
+
+        auto ticked = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> frameTime = ticked - currentTime;
+        m_frameMs += (frameTime.count() - m_frameMs) * 0.05;
+
+        // Last frame's snapshots are normally long gone by now; if not, the
+        // publishing thread is the bottleneck and the tick rate gives way
+        if (!headless) {
+            PROFILE_SCOPE(Phase::PublishWait);
+            waitForPublish();
+            std::chrono::duration<double, std::milli> waitTime =
+                std::chrono::high_resolution_clock::now() - ticked;
+            m_publishWaitMs += (waitTime.count() - m_publishWaitMs) * 0.05;
+        }
+
+        for (size_t i = 0; i < m_matches.size(); ++i) {
+            m_tickTimes.record(m_matches[i].tickUs);
+            if (!m_matches[i].running) {
+                restartMatch(static_cast<int>(i));
+            }
+            if (!headless) {
+                m_matches[i].world->swapSnapshots();
+            }
+        }
+        if (!headless) {
+            {
+                std::lock_guard<std::mutex> lock(m_publishMutex);
+                m_publishPending = true;
+            }
+            m_publishSignal.notify_all();
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::duration<double> sinceReport = now - lastReport;
+        if (sinceReport.count() >= 1.0) {
+            report(scheduler, sinceReport.count());
+            scheduler.resetStats();
+            lastReport = now;
+        }
+        if (m_traceRequested.exchange(false)) {
+            startTrace();
+        }
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+    LOG_INFO("Stopped").field("ticks", scheduler.ticks()).field("matches", m_matches.size())
+        .field("seconds", elapsed.count()).field("ticksPerSecond", scheduler.ticks() / elapsed.count());
+    if (Profiler::enabled()) {
+        reportPhases();
+    }
+    if (m_traceThread.joinable()) {
+        m_traceThread.join();
+    }
+    if (!headless) {
+        {
+            std::lock_guard<std::mutex> lock(m_publishMutex);
+            m_publishStopping = true;
+        }
+        m_publishSignal.notify_all();
+        m_publishThread.join();
+        m_server.stop();
+        m_serverThread.join();
+    }
+}
+
+void MatchHost::publishLoop() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_publishMutex);
+            m_publishSignal.wait(lock, [this]() { return m_publishPending || m_publishStopping; });
+            if (m_publishStopping) {
+                return;
+            }
+        }
+        // The frame thread leaves the matches alone until we are done
+        for (Match& match : m_matches) {
+            try {
+                match.world->publishSnapshot();
+            } catch (const std::exception& e) {
+                LOG_LIMITED(LogLevel::Error, 5, "Match failed to publish")
+                    .field("match", match.world->getMatchId()).field("error", e.what());
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_publishMutex);
+            m_publishPending = false;
+        }
+        m_publishSignal.notify_all();
+    }
+}
+
+void MatchHost::waitForPublish() {
+    std::unique_lock<std::mutex> lock(m_publishMutex);
+    m_publishSignal.wait(lock, [this]() { return !m_publishPending; });
+}
+
+void MatchHost::tickMatch(Match& match, double deltaTime) {
+    auto start = std::chrono::steady_clock::now();
+    try {
+        match.running = match.world->tick(deltaTime);
+    } catch (const std::exception& e) {
+        LOG_ERROR("Match failed").field("match", match.world->getMatchId()).field("error", e.what());
+        match.running = false;
+    }
+    match.tickUs = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+void MatchHost::restartMatch(int matchId) {
+    // The old game goes away with everyone in it; they reconnect to play
+    // the next one
+    std::unique_ptr<GameWorld> fresh = createMatch(matchId);
+    std::vector<int> players;
+    {
+        std::lock_guard<std::mutex> lock(m_routesMutex);
+        for (auto it = m_routes.begin(); it != m_routes.end();) {
+            if (it->second == matchId) {
+                players.push_back(it->first);
+                it = m_routes.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        std::swap(m_matches[matchId].world, fresh);
+    }
+    m_matches[matchId].running = true;
+    for (int id : players) {
+        m_server.close(websocket::ConnectionHandle(id), websocket::close_code::going_away);
+    }
+    ++m_restarts;
+    LOG_INFO("Match restarted").field("match", matchId).field("disconnected", players.size());
+}
+
+void MatchHost::report(const TickScheduler& scheduler, double seconds) {
+    size_t clients = 0;
+    const Match* slowest = &m_matches[0];
+    for (const Match& match : m_matches) {
+        clients += match.world->getWebSocketServer().clientCount();
+        if (match.world->getTickMs() > slowest->world->getTickMs()) {
+            slowest = &match;
+        }
+    }
+    // Simulated seconds per wall clock second: 1 when keeping up in real time
+    double speed = (scheduler.ticks() - m_reportedTicks) / (seconds * GameWorld::SIM_RATE);
+    m_reportedTicks = scheduler.ticks();
+
+    // One record per report, so it never lands in the middle of other lines
+    if (Log::enabled(LogLevel::Info)) {
+        LogRecord record(LogLevel::Info, "Status");
+        record.field("matches", m_matches.size());
+        if (!m_options.headless) {
+            websocket::QueueStats queues = m_server.queue_stats();
+            record.field("clients", clients).field("queuedKiB", queues.queued_bytes / 1024)
+                .field("skipped", queues.coalesced_frames);
+        }
+        record.field("speed", speed).field("frameMs", m_frameMs);
+        if (scheduler.realTime()) {
+            record.field("waitMs", m_publishWaitMs).field("overruns", scheduler.overruns())
+                .field("lateP99Ms", scheduler.lateness().percentile(0.99) / 1000.0)
+                .field("dropped", scheduler.dropped());
+        }
+        record.field("p50Ms", m_tickTimes.percentile(0.5) / 1000.0)
+            .field("p99Ms", m_tickTimes.percentile(0.99) / 1000.0)
+            .field("slowest", slowest->world->getMatchId()).field("slowestMs", slowest->world->getTickMs())
+            .field("restarts", m_restarts);
+    }
+    publishMetrics(scheduler);
+    m_tickTimes = LatencyHistogram();
+
+    if (Profiler::enabled() && ++m_reportsSincePhases >= PHASE_REPORT_INTERVAL) {
+        reportPhases();
+    }
+}
+
+void MatchHost::reportPhases() {
+    m_reportsSincePhases = 0;
+    Profiler::PhaseStats stats = Profiler::takeStats();
+    Allocations::ByPhase allocations = Allocations::byPhase();
+    for (size_t i = 0; i < PHASE_COUNT; ++i) {
+        const LatencyHistogram& times = stats[i];
+        if (times.count() == 0) {
+            continue;
+        }
+        uint64_t allocated = allocations[i].count - m_phaseAllocations[i].count;
+        uint64_t bytes = allocations[i].bytes - m_phaseAllocations[i].bytes;
+        LOG_INFO("Phase times").field("phase", Profiler::phaseName(static_cast<Phase>(i)))
+            .field("count", times.count()).field("meanUs", static_cast<double>(times.sum()) / times.count())
+            .field("p50Us", times.percentile(0.5)).field("p99Us", times.percentile(0.99))
+            .field("maxUs", times.max())
+            .field("meanAllocations", static_cast<double>(allocated) / times.count())
+            .field("meanAllocatedBytes", static_cast<double>(bytes) / times.count());
+    }
+    m_phaseAllocations = allocations;
+}
+
+void MatchHost::publishMetrics(const TickScheduler& scheduler) {
+    std::array<uint64_t, 5> objects{};
+    for (const Match& match : m_matches) {
+        for (const auto& object : match.world->getObjects()) {
+            if (object->alive) {
+                ++objects[static_cast<size_t>(object->type)];
+            }
+        }
+    }
+    for (size_t type = 0; type < objects.size(); ++type) {
+        m_metrics.objects[type].store(objects[type], std::memory_order_relaxed);
+    }
+    m_metrics.tickP50Us.store(m_tickTimes.percentile(0.5), std::memory_order_relaxed);
+    m_metrics.tickP99Us.store(m_tickTimes.percentile(0.99), std::memory_order_relaxed);
+    m_metrics.tickMaxUs.store(m_tickTimes.max(), std::memory_order_relaxed);
+    m_metrics.ticks.fetch_add(m_tickTimes.count(), std::memory_order_relaxed);
+    m_metrics.tickMicros.fetch_add(m_tickTimes.sum(), std::memory_order_relaxed);
+    m_metrics.frameMs.store(m_frameMs, std::memory_order_relaxed);
+    m_metrics.publishWaitMs.store(m_publishWaitMs, std::memory_order_relaxed);
+    // The scheduler's counters start again after every report
+    m_metrics.overruns.fetch_add(scheduler.overruns(), std::memory_order_relaxed);
+    m_metrics.droppedTicks.fetch_add(scheduler.dropped(), std::memory_order_relaxed);
+    m_metrics.restarts.store(m_restarts, std::memory_order_relaxed);
+}
+
+void MatchHost::renderMetrics(std::string& out) {
+    auto load = [](const auto& value) { return value.load(std::memory_order_relaxed); };
+    auto seconds = [](uint64_t micros) { return static_cast<double>(micros) / 1e6; };
+    PrometheusWriter metrics(out);
+
+    metrics.family("celestial_tick_seconds", "summary",
+                   "Time to tick one match, quantiles over the last second");
+    metrics.sample("celestial_tick_seconds", seconds(load(m_metrics.tickP50Us)), "quantile=\"0.5\"");
+    metrics.sample("celestial_tick_seconds", seconds(load(m_metrics.tickP99Us)), "quantile=\"0.99\"");
+    metrics.sample("celestial_tick_seconds_sum", seconds(load(m_metrics.tickMicros)));
+    metrics.sample("celestial_tick_seconds_count", load(m_metrics.ticks));
+    metrics.family("celestial_tick_max_seconds", "gauge", "Slowest match tick in the last second");
+    metrics.sample("celestial_tick_max_seconds", seconds(load(m_metrics.tickMaxUs)));
+    metrics.family("celestial_frame_seconds", "gauge", "Smoothed time to tick every match once");
+    metrics.sample("celestial_frame_seconds", load(m_metrics.frameMs) / 1000.0);
+    metrics.family("celestial_publish_wait_seconds", "gauge",
+                   "Smoothed time a frame waited for the last one to be sent");
+    metrics.sample("celestial_publish_wait_seconds", load(m_metrics.publishWaitMs) / 1000.0);
+    metrics.family("celestial_tick_overruns_total", "counter", "Frames that started after their deadline");
+    metrics.sample("celestial_tick_overruns_total", load(m_metrics.overruns));
+    metrics.family("celestial_ticks_dropped_total", "counter", "Frames skipped to recover from a stall");
+    metrics.sample("celestial_ticks_dropped_total", load(m_metrics.droppedTicks));
+
+    metrics.family("celestial_matches", "gauge", "Matches hosted");
+    metrics.sample("celestial_matches", static_cast<uint64_t>(m_matches.size()));
+    metrics.family("celestial_match_restarts_total", "counter", "Matches that ended and were replaced");
+    metrics.sample("celestial_match_restarts_total", load(m_metrics.restarts));
+    metrics.family("celestial_objects", "gauge", "Living objects in every match, by type");
+    static const char* const TYPES[] = {"type=\"planet\"", "type=\"enemy\"", "type=\"tower\"",
+                                        "type=\"projectile\""};
+    for (size_t i = 0; i < 4; ++i) {
+        metrics.sample("celestial_objects", load(m_metrics.objects[i + 1]), TYPES[i]);
+    }
+
+    metrics.family("celestial_path_searches_total", "counter", "A* searches run");
+    metrics.sample("celestial_path_searches_total", load(Metrics::pathSearches));
+    metrics.family("celestial_path_nodes_expanded_total", "counter", "Nodes A* searches expanded");
+    metrics.sample("celestial_path_nodes_expanded_total", load(Metrics::pathNodesExpanded));
+    metrics.family("celestial_terrain_generation_seconds", "summary", "Time to run one terrain generation");
+    metrics.sample("celestial_terrain_generation_seconds_sum", seconds(load(Metrics::terrainMicros)));
+    metrics.sample("celestial_terrain_generation_seconds_count", load(Metrics::terrainGenerations));
+    metrics.family("celestial_commands_dropped_total", "counter", "Client commands dropped on a full queue");
+    metrics.sample("celestial_commands_dropped_total", load(Metrics::commandsDropped));
+
+    // Per client, labelled with the match it is in
+    std::vector<websocket::ConnectionStats> connections = m_server.connection_stats();
+    std::vector<std::string> labels;
+    {
+        std::lock_guard<std::mutex> lock(m_routesMutex);
+        for (const websocket::ConnectionStats& connection : connections) {
+            auto route = m_routes.find(connection.id);
+            std::string match = route == m_routes.end() ? "none" : std::to_string(route->second);
+            labels.push_back("client=\"" + std::to_string(connection.id) + "\",match=\"" + match + "\"");
+        }
+    }
+    websocket::QueueStats queues = m_server.queue_stats();
+    metrics.family("celestial_clients", "gauge", "Connected clients");
+    metrics.sample("celestial_clients", static_cast<uint64_t>(connections.size()));
+    metrics.family("celestial_sent_messages_total", "counter", "Messages written to every client");
+    metrics.sample("celestial_sent_messages_total", queues.sent_frames);
+    metrics.family("celestial_sent_bytes_total", "counter", "Bytes written to every client");
+    metrics.sample("celestial_sent_bytes_total", queues.sent_bytes);
+    metrics.family("celestial_client_sent_messages_total", "counter", "Messages written to the client");
+    for (size_t i = 0; i < connections.size(); ++i) {
+        metrics.sample("celestial_client_sent_messages_total", connections[i].sent_frames, labels[i]);
+    }
+    metrics.family("celestial_client_sent_bytes_total", "counter", "Bytes written to the client");
+    for (size_t i = 0; i < connections.size(); ++i) {
+        metrics.sample("celestial_client_sent_bytes_total", connections[i].sent_bytes, labels[i]);
+    }
+    metrics.family("celestial_client_queued_messages", "gauge", "Messages waiting in the client's send queue");
+    for (size_t i = 0; i < connections.size(); ++i) {
+        metrics.sample("celestial_client_queued_messages", static_cast<uint64_t>(connections[i].queued_frames),
+                       labels[i]);
+    }
+    metrics.family("celestial_client_queued_bytes", "gauge", "Bytes waiting in the client's send queue");
+    for (size_t i = 0; i < connections.size(); ++i) {
+        metrics.sample("celestial_client_queued_bytes", static_cast<uint64_t>(connections[i].queued_bytes),
+                       labels[i]);
+    }
+    metrics.family("celestial_coalesced_messages_total", "counter",
+                   "Snapshots replaced by a newer one before being sent");
+    metrics.sample("celestial_coalesced_messages_total", queues.coalesced_frames);
+    metrics.family("celestial_disconnects_total", "counter", "Clients disconnected for falling behind");
+    metrics.sample("celestial_disconnects_total", queues.overflow_disconnects, "reason=\"overflow\"");
+    metrics.sample("celestial_disconnects_total", queues.stall_disconnects, "reason=\"stall\"");
+
+    metrics.family("celestial_allocations_total", "counter", "Heap allocations on every thread");
+    metrics.sample("celestial_allocations_total", Allocations::count());
+    metrics.family("celestial_allocated_bytes_total", "counter", "Bytes allocated on every thread");
+    metrics.sample("celestial_allocated_bytes_total", Allocations::bytes());
+    Allocations::ByPhase phases = Allocations::byPhase();
+    std::vector<std::string> phaseLabels(PHASE_COUNT);
+    for (size_t i = 0; i < PHASE_COUNT; ++i) {
+        phaseLabels[i] = std::string("phase=\"") + Profiler::phaseName(static_cast<Phase>(i)) + "\"";
+    }
+    metrics.family("celestial_phase_allocations_total", "counter",
+                   "Heap allocations made in each tick and publish phase, counted with --profile");
+    for (size_t i = 0; i < PHASE_COUNT; ++i) {
+        metrics.sample("celestial_phase_allocations_total", phases[i].count, phaseLabels[i]);
+    }
+    metrics.family("celestial_phase_allocated_bytes_total", "counter",
+                   "Bytes allocated in each tick and publish phase, counted with --profile");
+    for (size_t i = 0; i < PHASE_COUNT; ++i) {
+        metrics.sample("celestial_phase_allocated_bytes_total", phases[i].bytes, phaseLabels[i]);
+    }
+    metrics.family("celestial_log_dropped_total", "counter", "Log lines dropped because the writer fell behind");
+    metrics.sample("celestial_log_dropped_total", Log::dropped());
+}
+
+void MatchHost::startTrace() {
+    if (!Profiler::enabled()) {
+        LOG_WARN("Trace requested, but profiling is off (start with --profile)");
+        return;
+    }
+    if (m_tracing.load()) {
+        LOG_WARN("Trace requested while the last one is still being written");
+        return;
+    }
+    if (m_traceThread.joinable()) {
+        m_traceThread.join();
+    }
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    std::string path = m_options.traceDir + "/trace-" +
+                       std::to_string(std::chrono::duration_cast<std::chrono::seconds>(now).count()) + ".json";
+    double seconds = m_options.traceSeconds;
+    m_tracing.store(true);
+    m_traceThread = std::thread([this, path, seconds]() {
+        try {
+            size_t phases = Profiler::writeTrace(path, seconds);
+            LOG_INFO("Trace written").field("path", path).field("phases", phases);
+        } catch (const std::exception& e) {
+            LOG_ERROR("Trace failed").field("error", e.what());
+        }
+        m_tracing.store(false);
+    });
+}
+
+bool MatchHost::route(websocket::ConnectionHandle hdl, const std::string& path) {
+    int match = parseMatchPath(path, static_cast<int>(m_matches.size()));
+    if (match < 0) {
+        LOG_LIMITED(LogLevel::Warn, 5, "Rejected connection for unknown match")
+            .field("client", hdl.id).field("path", path);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_routesMutex);
+    m_routes[hdl.id] = match;
+    return true;
+}
+
+WebSocketServer* MatchHost::clientsOf(websocket::ConnectionHandle hdl) {
+    // Connections of a replaced match are no longer routed
+    auto it = m_routes.find(hdl.id);
+    return it == m_routes.end() ? nullptr : &m_matches[it->second].world->getWebSocketServer();
+}
+
+void MatchHost::on_open(websocket::ConnectionHandle hdl) {
+    std::lock_guard<std::mutex> lock(m_routesMutex);
+    if (WebSocketServer* clients = clientsOf(hdl)) {
+        clients->on_open(hdl);
+    }
+}
+
+void MatchHost::on_close(websocket::ConnectionHandle hdl) {
+    std::lock_guard<std::mutex> lock(m_routesMutex);
+    if (WebSocketServer* clients = clientsOf(hdl)) {
+        clients->on_close(hdl);
+    }
+    m_routes.erase(hdl.id);
+}
+
+void MatchHost::on_message(websocket::ConnectionHandle hdl, const std::string& msg) {
+    std::lock_guard<std::mutex> lock(m_routesMutex);
+    if (WebSocketServer* clients = clientsOf(hdl)) {
+        clients->on_message(hdl, msg);
+    }
+}
+
+void MatchHost::on_pong(websocket::ConnectionHandle hdl, const std::string& payload) {
+    std::lock_guard<std::mutex> lock(m_routesMutex);
+    if (WebSocketServer* clients = clientsOf(hdl)) {
+        clients->on_pong(hdl, payload);
+    }
+}
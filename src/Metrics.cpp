@@ -0,0 +1,44 @@
+#include "Metrics.h"
+#include <charconv>
+#include <cmath>
+
+std::atomic<uint64_t> Metrics::pathSearches{0};
+std::atomic<uint64_t> Metrics::pathNodesExpanded{0};
+std::atomic<uint64_t> Metrics::terrainGenerations{0};
+std::atomic<uint64_t> Metrics::terrainMicros{0};
+std::atomic<uint64_t> Metrics::commandsDropped{0};
+
+void PrometheusWriter::family(std::string_view name, std::string_view type, std::string_view help) {
+    m_out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    m_out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void PrometheusWriter::beginSample(std::string_view name, std::string_view labels) {
+    m_out.append(name);
+    if (!labels.empty()) {
+        m_out.append("{").append(labels).append("}");
+    }
+    m_out.push_back(' ');
+}
+
+void PrometheusWriter::sample(std::string_view name, double value, std::string_view labels) {
+    beginSample(name, labels);
+    if (std::isnan(value)) {
+        m_out.append("NaN");
+    } else if (std::isinf(value)) {
+        m_out.append(value > 0 ? "+Inf" : "-Inf");
+    } else {
+        char buffer[32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        m_out.append(buffer, result.ptr);
+    }
+    m_out.push_back('\n');
+}
+
+void PrometheusWriter::sample(std::string_view name, uint64_t value, std::string_view labels) {
+    beginSample(name, labels);
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    m_out.append(buffer, result.ptr);
+    m_out.push_back('\n');
+}
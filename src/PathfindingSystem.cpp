@@ -1,4 +1,5 @@
 #include "PathfindingSystem.h"
+#include "Metrics.h"
 #include "Planet.h"
 #include <algorithm>
 #include <limits>
@@ -11,7 +12,7 @@ std::vector<Vec2d> PathfindingSystem::findPath(
     const Vec2d& start, 
     const Vec2d& end,
     const std::vector<std::unique_ptr<GameObject>>& objects,
-    const PhysicsEngine& physics) {
+    const PhysicsEngine& physics) const {
     
     auto startGrid = worldToGrid(start);
     auto endGrid = worldToGrid(end);
@@ -21,6 +22,7 @@ std::vector<Vec2d> PathfindingSystem::findPath(
         !isWalkable(endGrid.first, endGrid.second)) {
         return {}; // No path possible
     }
+    Metrics::add(Metrics::pathSearches);
     
     // A* algorithm with gravity-aware cost
     std::priority_queue<PathNode, std::vector<PathNode>, std::greater<PathNode>> openSet;
@@ -37,6 +39,7 @@ std::vector<Vec2d> PathfindingSystem::findPath(
     
     openSet.push(startNode);
     gScore[startGrid] = 0;
+    uint64_t expanded = 0;
     
     while (!openSet.empty()) {
         PathNode current = openSet.top();
@@ -46,6 +49,7 @@ std::vector<Vec2d> PathfindingSystem::findPath(
         
         // Check if we reached the goal
         if (currentGrid == endGrid) {
+            Metrics::add(Metrics::pathNodesExpanded, expanded);
             return reconstructPath(cameFrom, currentGrid);
         }
         
@@ -55,6 +59,7 @@ std::vector<Vec2d> PathfindingSystem::findPath(
         }
         
         closedSet.insert(currentGrid);
+        ++expanded;
         
         // Check all neighbors
         for (const auto& neighborGrid : getNeighbors(current.x, current.y)) {
@@ -88,6 +93,7 @@ std::vector<Vec2d> PathfindingSystem::findPath(
         }
     }
     
+    Metrics::add(Metrics::pathNodesExpanded, expanded);
     return {}; // No path found
 }
 
@@ -1,47 +1,108 @@
 #include "PhysicsEngine.h"
+#include "Projectile.h"
 #include <cmath>
 
-void PhysicsEngine::update(std::vector<std::unique_ptr<GameObject>>& objects, double deltaTime) {
-    // Step 1: Clear all force accumulators
-    for (auto& obj : objects) {
-        obj->forceAccumulator = Vec2d(0, 0);
-    }
-    
-    // Step 2: Calculate gravitational forces between all objects
-    for (size_t i = 0; i < objects.size(); ++i) {
-        for (size_t j = i + 1; j < objects.size(); ++j) {
-            auto& obj1 = objects[i];
-            auto& obj2 = objects[j];
-            
-            // Skip if either object has no mass
-            if (obj1->mass <= 0 || obj2->mass <= 0) continue;
-            
-            Vec2d force = calculateGravitationalForce(*obj1, *obj2);
-            
-            // Apply Newton's third law
-            obj1->forceAccumulator = obj1->forceAccumulator + force;
-            obj2->forceAccumulator = obj2->forceAccumulator - force;
+void PhysicsEngine::update(std::vector<std::unique_ptr<GameObject>>& objects, double deltaTime, JobSystem& jobs) {
+    // Step 1: Sum the gravitational forces on every enemy. Pairs are
+    // evaluated with the lower index first and added up in index order, as
+    // a serial pass over all pairs would. Only enemies move, so nothing
+    // else needs its forces.
+    jobs.parallelFor(0, objects.size(), 8, [&objects, this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            GameObject& obj = *objects[i];
+            obj.forceAccumulator = Vec2d(0, 0);
+            if (obj.type != GameObjectType::Enemy || obj.isStatic || !obj.alive) continue;
+
+            for (size_t j = 0; j < objects.size(); ++j) {
+                const GameObject& other = *objects[j];
+                if (j == i) continue;
+                // Skip if either object has no mass
+                if (obj.mass <= 0 || other.mass <= 0) continue;
+                // Projectiles only feel the static field, see stepProjectiles()
+                if (other.type == GameObjectType::Projectile) continue;
+
+                // The pair's force points from the lower index to the
+                // higher; Newton's third law gives the other side
+                if (j < i) {
+                    obj.forceAccumulator = obj.forceAccumulator - calculateGravitationalForce(other, obj);
+                } else {
+                    obj.forceAccumulator = obj.forceAccumulator + calculateGravitationalForce(obj, other);
+                }
+            }
         }
-    }
-    
-    // Step 3: Update velocity and position based on forces
-    for (auto& obj : objects) {
-        // Skip static objects (planets, towers)
-        if (obj->isStatic || !obj->alive) continue;
-        
-        // Special handling for projectiles - they're affected by gravity
-        // This creates beautiful curved trajectories
-        if (obj->type == GameObjectType::Projectile || obj->type == GameObjectType::Enemy) {
-            // F = ma, so a = F/m
-            Vec2d acceleration = obj->forceAccumulator * (1.0 / obj->mass);
-            
-            // Update velocity: v = v0 + a*t
-            obj->velocity = obj->velocity + acceleration * deltaTime;
-            
-            // Update position: x = x0 + v*t
-            obj->position = obj->position + obj->velocity * deltaTime;
+    });
+
+    // Step 2: Update velocity and position based on forces, once every
+    // force has been read
+    jobs.parallelFor(0, objects.size(), 256, [&objects, deltaTime](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            GameObject& obj = *objects[i];
+            // Skip static objects (planets, towers)
+            if (obj.isStatic || !obj.alive) continue;
+
+            if (obj.type == GameObjectType::Enemy) {
+                // F = ma, so a = F/m
+                Vec2d acceleration = obj.forceAccumulator * (1.0 / obj.mass);
+
+                // Update velocity: v = v0 + a*t
+                obj.velocity = obj.velocity + acceleration * deltaTime;
+
+                // Update position: x = x0 + v*t
+                obj.position = obj.position + obj.velocity * deltaTime;
+            }
+        }
+    });
+}
+
+void PhysicsEngine::stepProjectiles(std::vector<std::unique_ptr<GameObject>>& objects, double step,
+                                    JobSystem& jobs) const {
+    jobs.parallelFor(0, objects.size(), 64, [&objects, step, this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            GameObject& obj = *objects[i];
+            if (obj.type != GameObjectType::Projectile || !obj.alive) continue;
+
+            // Semi-implicit Euler, like update(), but with a fixed step.
+            // Gravity still bends the path into a curve.
+            Vec2d acceleration = fieldAt(obj.position);
+            obj.velocity = obj.velocity + acceleration * step;
+            obj.position = obj.position + obj.velocity * step;
+
+            Projectile& projectile = static_cast<Projectile&>(obj);
+            projectile.lifetime -= step;
+            if (projectile.lifetime <= 0) {
+                projectile.alive = false;
+            }
+        }
+    });
+}
+
+bool PhysicsEngine::updateField(const std::vector<std::unique_ptr<GameObject>>& objects) {
+    m_nextField.clear();
+    for (const auto& obj : objects) {
+        if (obj->alive && obj->isStatic && obj->mass > 0) {
+            m_nextField.push_back({obj->position, obj->mass});
         }
     }
+    if (m_nextField == m_field) {
+        return false;
+    }
+    m_field.swap(m_nextField);
+    return true;
+}
+
+Vec2d PhysicsEngine::fieldAt(const Vec2d& position) const {
+    Vec2d acceleration(0, 0);
+    for (const FieldBody& body : m_field) {
+        Vec2d direction = body.position - position;
+        double distance = direction.length();
+        double distanceSq = distance * distance;
+        if (distanceSq < 1.0) distanceSq = 1.0;
+
+        // a = G * m / r^2 towards the body
+        double magnitude = (GRAVITATIONAL_CONSTANT * body.mass) / distanceSq;
+        acceleration += direction.normalized() * magnitude;
+    }
+    return acceleration;
 }
 
 Vec2d PhysicsEngine::calculateGravitationalForce(const GameObject& obj1, const GameObject& obj2) const {
@@ -0,0 +1,229 @@
+#include "Profiler.h"
+#include "JsonWriter.h"
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+std::atomic<bool> Profiler::s_enabled{false};
+thread_local Phase Profiler::s_phase = Phase::Count;
+
+namespace {
+
+struct TraceEvent {
+    int64_t startNs;
+    int64_t endNs;
+    int32_t match;
+    Phase phase;
+};
+
+// One per thread that has recorded a phase. The owner takes the mutex for
+// every phase, which is uncontended unless stats or a trace are being read.
+struct ThreadProfile {
+    std::mutex mutex;
+    Profiler::PhaseStats stats;
+    std::vector<TraceEvent> events;     // Ring, allocated on first use
+    uint64_t recorded = 0;
+    int id = 0;
+    std::string name;
+    bool owned = false;     // Under Registry::mutex
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadProfile>> threads;    // Never shrinks
+
+    // Threads that have exited leave their profile, and their recent
+    // phases, to the next new thread
+    ThreadProfile* acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& thread : threads) {
+            if (!thread->owned) {
+                thread->owned = true;
+                return thread.get();
+            }
+        }
+        threads.push_back(std::make_unique<ThreadProfile>());
+        ThreadProfile* thread = threads.back().get();
+        thread->id = static_cast<int>(threads.size());
+        thread->name = "thread " + std::to_string(thread->id);
+        thread->owned = true;
+        return thread;
+    }
+
+    void release(ThreadProfile* thread) {
+        std::lock_guard<std::mutex> lock(mutex);
+        thread->owned = false;
+    }
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+struct ThreadHandle {
+    ThreadProfile* profile = nullptr;
+    ~ThreadHandle() {
+        if (profile) {
+            registry().release(profile);
+        }
+    }
+};
+
+thread_local ThreadHandle t_thread;
+
+ThreadProfile& threadProfile() {
+    if (!t_thread.profile) {
+        t_thread.profile = registry().acquire();
+    }
+    return *t_thread.profile;
+}
+
+const char* const PHASE_NAMES[PHASE_COUNT] = {
+    "frame",
+    "frame.publishWait",
+    "tick",
+    "tick.commands",
+    "tick.physics",
+    "tick.pathing",
+    "tick.objects",
+    "tick.terrain",
+    "tick.spawn",
+    "tick.targeting",
+    "tick.collisions",
+    "tick.cleanup",
+    "tick.capture",
+    "publish",
+    "publish.projectiles",
+    "publish.objects",
+    "publish.clients",
+    "publish.terrain",
+    "publish.stats",
+};
+
+} // namespace
+
+const char* Profiler::phaseName(Phase phase) {
+    return PHASE_NAMES[static_cast<size_t>(phase)];
+}
+
+void Profiler::nameThread(std::string_view name) {
+    ThreadProfile& thread = threadProfile();
+    std::lock_guard<std::mutex> lock(thread.mutex);
+    thread.name = name;
+}
+
+void Profiler::record(Phase phase, int match, int64_t startNs, int64_t endNs) {
+    ThreadProfile& thread = threadProfile();
+    std::lock_guard<std::mutex> lock(thread.mutex);
+    int64_t micros = std::max<int64_t>(0, (endNs - startNs) / 1000);
+    thread.stats[static_cast<size_t>(phase)].record(static_cast<uint32_t>(std::min<int64_t>(micros, UINT32_MAX)));
+    if (thread.events.empty()) {
+        thread.events.resize(EVENTS_PER_THREAD);
+    }
+    thread.events[thread.recorded % EVENTS_PER_THREAD] = {startNs, endNs, match, phase};
+    ++thread.recorded;
+}
+
+Profiler::PhaseStats Profiler::takeStats() {
+    PhaseStats total;
+    Registry& all = registry();
+    std::lock_guard<std::mutex> lock(all.mutex);
+    for (auto& thread : all.threads) {
+        std::lock_guard<std::mutex> threadLock(thread->mutex);
+        for (size_t i = 0; i < PHASE_COUNT; ++i) {
+            total[i].merge(thread->stats[i]);
+            thread->stats[i] = LatencyHistogram();
+        }
+    }
+    return total;
+}
+
+size_t Profiler::writeTrace(const std::string& path, double seconds) {
+    struct Named {
+        int id;
+        std::string name;
+    };
+    std::vector<std::pair<int, TraceEvent>> events;
+    std::vector<Named> threads;
+    int64_t until = now();
+    int64_t since = until - static_cast<int64_t>(seconds * 1e9);
+    {
+        Registry& all = registry();
+        std::lock_guard<std::mutex> lock(all.mutex);
+        for (auto& thread : all.threads) {
+            std::lock_guard<std::mutex> threadLock(thread->mutex);
+            uint64_t kept = std::min<uint64_t>(thread->recorded, EVENTS_PER_THREAD);
+            for (uint64_t i = thread->recorded - kept; i < thread->recorded; ++i) {
+                const TraceEvent& event = thread->events[i % EVENTS_PER_THREAD];
+                if (event.startNs >= since) {
+                    events.emplace_back(thread->id, event);
+                }
+            }
+            threads.push_back({thread->id, thread->name});
+        }
+    }
+    std::sort(events.begin(), events.end(), [](const auto& a, const auto& b) {
+        return a.second.startNs < b.second.startNs;
+    });
+
+    // Complete ("X") events in microseconds from the first phase, and a
+    // name for every thread
+    int64_t origin = events.empty() ? until : events.front().second.startNs;
+    std::string json;
+    JsonWriter writer(json);
+    writer.beginObject();
+    writer.field(JSON_KEY("displayTimeUnit"), "ms");
+    writer.key(JSON_KEY("traceEvents"));
+    writer.beginArray();
+    for (const Named& thread : threads) {
+        writer.beginObject();
+        writer.key(JSON_KEY("args"));
+        writer.beginObject();
+        writer.key(JSON_KEY("name"));
+        writer.rawValue("\"" + thread.name + "\"");
+        writer.endObject();
+        writer.field(JSON_KEY("name"), "thread_name");
+        writer.field(JSON_KEY("ph"), "M");
+        writer.field(JSON_KEY("pid"), 1);
+        writer.field(JSON_KEY("tid"), thread.id);
+        writer.endObject();
+    }
+    std::string name;
+    for (const auto& [threadId, event] : events) {
+        writer.beginObject();
+        if (event.match >= 0) {
+            writer.key(JSON_KEY("args"));
+            writer.beginObject();
+            writer.field(JSON_KEY("match"), event.match);
+            writer.endObject();
+        }
+        writer.field(JSON_KEY("cat"), "celestial");
+        writer.key(JSON_KEY("dur"));
+        writer.exactValue((event.endNs - event.startNs) / 1000.0);
+        name.assign("\"").append(phaseName(event.phase)).append("\"");
+        writer.key(JSON_KEY("name"));
+        writer.rawValue(name);
+        writer.field(JSON_KEY("ph"), "X");
+        writer.field(JSON_KEY("pid"), 1);
+        writer.field(JSON_KEY("tid"), threadId);
+        writer.key(JSON_KEY("ts"));
+        writer.exactValue((event.startNs - origin) / 1000.0);
+        writer.endObject();
+    }
+    writer.endArray();
+    writer.endObject();
+
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("cannot write trace " + path);
+    }
+    file << json << '\n';
+    if (!file) {
+        throw std::runtime_error("failed writing trace " + path);
+    }
+    return events.size();
+}
@@ -0,0 +1,66 @@
+#include "SpatialGrid.h"
+#include <algorithm>
+#include <cmath>
+
+SpatialGrid::SpatialGrid(double width, double height, double cellSize)
+    : m_columns(std::max(1, static_cast<int>(std::ceil(width / cellSize)))),
+      m_rows(std::max(1, static_cast<int>(std::ceil(height / cellSize)))),
+      m_cellSize(cellSize),
+      m_cellStart(static_cast<size_t>(m_columns) * m_rows + 1, 0) {}
+
+// Clamped in floating point so far-off positions can't overflow the cast
+int SpatialGrid::column(double x) const {
+    return static_cast<int>(std::clamp(std::floor(x / m_cellSize), 0.0, m_columns - 1.0));
+}
+
+int SpatialGrid::row(double y) const {
+    return static_cast<int>(std::clamp(std::floor(y / m_cellSize), 0.0, m_rows - 1.0));
+}
+
+void SpatialGrid::build(const std::vector<EntityState>& entities) {
+    m_entities = &entities;
+    std::fill(m_cellStart.begin(), m_cellStart.end(), 0);
+    m_entityCell.resize(entities.size());
+    m_entries.resize(entities.size());
+
+    // Count per cell, prefix-sum into offsets, then scatter
+    for (size_t i = 0; i < entities.size(); ++i) {
+        const Vec2d& p = entities[i].position;
+        uint32_t cell = static_cast<uint32_t>(row(p.y) * m_columns + column(p.x));
+        m_entityCell[i] = cell;
+        ++m_cellStart[cell + 1];
+    }
+    for (size_t c = 1; c < m_cellStart.size(); ++c) {
+        m_cellStart[c] += m_cellStart[c - 1];
+    }
+    m_cursor.assign(m_cellStart.begin(), m_cellStart.end() - 1);
+    for (size_t i = 0; i < entities.size(); ++i) {
+        m_entries[m_cursor[m_entityCell[i]]++] = static_cast<uint32_t>(i);
+    }
+}
+
+void SpatialGrid::query(double minX, double minY, double maxX, double maxY,
+                        std::vector<uint32_t>& out) const {
+    out.clear();
+    if (!m_entities || minX > maxX || minY > maxY) {
+        return;
+    }
+
+    const std::vector<EntityState>& entities = *m_entities;
+    int firstColumn = column(minX);
+    int lastColumn = column(maxX);
+    int lastRow = row(maxY);
+    for (int r = row(minY); r <= lastRow; ++r) {
+        for (int c = firstColumn; c <= lastColumn; ++c) {
+            size_t cell = static_cast<size_t>(r) * m_columns + c;
+            for (uint32_t e = m_cellStart[cell]; e < m_cellStart[cell + 1]; ++e) {
+                uint32_t index = m_entries[e];
+                const Vec2d& p = entities[index].position;
+                if (p.x >= minX && p.x <= maxX && p.y >= minY && p.y <= maxY) {
+                    out.push_back(index);
+                }
+            }
+        }
+    }
+    std::sort(out.begin(), out.end());
+}
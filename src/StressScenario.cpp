@@ -0,0 +1,93 @@
+#include "StressScenario.h"
+#include "GameWorld.h"
+#include <cmath>
+#include <vector>
+
+namespace {
+
+const Vec2d BASE(400, 300);
+
+} // namespace
+
+StressScenario::StressScenario(const StressOptions& options, uint32_t seed)
+    : m_options(options), m_rng(seed) {}
+
+void StressScenario::apply(GameWorld& world, double deltaTime) {
+    if (!m_built) {
+        buildTowers(world);
+        m_built = true;
+    }
+
+    int enemies = 0;
+    for (const auto& object : world.getObjects()) {
+        if (object->type == GameObjectType::Enemy && object->alive) {
+            ++enemies;
+        }
+    }
+    if (enemies < m_options.enemies) {
+        spawnEnemies(world, m_options.enemies - enemies);
+    }
+
+    m_projectilesOwed += m_options.projectileRate * deltaTime;
+    int projectiles = static_cast<int>(m_projectilesOwed);
+    if (projectiles > 0) {
+        m_projectilesOwed -= projectiles;
+        fireProjectiles(world, projectiles);
+    }
+
+    world.setPlayerHealth(100);
+}
+
+void StressScenario::buildTowers(GameWorld& world) {
+    // Cells the base covers stay free
+    double width = (m_options.towerColumns - 1) * m_options.towerSpacing;
+    double height = (m_options.towerRows - 1) * m_options.towerSpacing;
+    for (int row = 0; row < m_options.towerRows; ++row) {
+        for (int column = 0; column < m_options.towerColumns; ++column) {
+            Vec2d position(BASE.x - width / 2 + column * m_options.towerSpacing,
+                           BASE.y - height / 2 + row * m_options.towerSpacing);
+            if ((position - BASE).length() < 60) {
+                continue;
+            }
+            auto type = static_cast<TowerType>((row + column) % 4);
+            world.addObject(createTower(type, position));
+        }
+    }
+}
+
+void StressScenario::spawnEnemies(GameWorld& world, int count) {
+    // On a ring around the base, like the waves, with some depth
+    static const EnemyType TYPES[] = {EnemyType::Basic, EnemyType::Fast, EnemyType::Basic, EnemyType::Tank};
+    std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+    std::uniform_real_distribution<double> radius(280, 380);
+    std::uniform_int_distribution<int> type(0, 3);
+    for (int i = 0; i < count; ++i) {
+        double a = angle(m_rng);
+        double r = radius(m_rng);
+        auto enemy = createEnemy(TYPES[type(m_rng)], BASE + Vec2d(std::cos(a) * r, std::sin(a) * r));
+        enemy->setTarget(BASE);
+        world.addObject(std::move(enemy));
+    }
+}
+
+void StressScenario::fireProjectiles(GameWorld& world, int count) {
+    // From the base's edge at random living enemies, or outwards if there
+    // are none
+    const auto& objects = world.getObjects();
+    std::vector<Vec2d> targets;
+    for (const auto& object : objects) {
+        if (object->type == GameObjectType::Enemy && object->alive) {
+            targets.push_back(object->position);
+        }
+    }
+    std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+    for (int i = 0; i < count; ++i) {
+        double a = angle(m_rng);
+        Vec2d from = BASE + Vec2d(std::cos(a) * 60, std::sin(a) * 60);
+        Vec2d to = from + Vec2d(std::cos(a), std::sin(a));
+        if (!targets.empty()) {
+            to = targets[std::uniform_int_distribution<size_t>(0, targets.size() - 1)(m_rng)];
+        }
+        world.spawnProjectile(from, to, 20);
+    }
+}
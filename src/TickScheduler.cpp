@@ -0,0 +1,39 @@
+#include "TickScheduler.h"
+#include <thread>
+
+TickScheduler::TickScheduler(Clock::duration period, bool realTime)
+    : m_period(period), m_realTime(realTime) {}
+
+void TickScheduler::waitForTick() {
+    ++m_ticks;
+    if (!m_realTime) {
+        return;
+    }
+    Clock::time_point now = Clock::now();
+    if (!m_started) {
+        m_started = true;
+        m_deadline = now + m_period;
+        return;
+    }
+
+    if (now < m_deadline) {
+        std::this_thread::sleep_until(m_deadline);
+    } else {
+        ++m_overruns;
+        Clock::duration late = now - m_deadline;
+        m_lateness.record(static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(late).count()));
+        // Too far behind to catch up without a burst clients would notice
+        if (late > m_period * MAX_CATCH_UP) {
+            m_dropped += static_cast<uint64_t>(late / m_period);
+            m_deadline = now;
+        }
+    }
+    m_deadline += m_period;
+}
+
+void TickScheduler::resetStats() {
+    m_overruns = 0;
+    m_dropped = 0;
+    m_lateness = LatencyHistogram();
+}
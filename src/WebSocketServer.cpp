@@ -1,75 +1,410 @@
 #include "WebSocketServer.h"
-#include <iostream>
+#include "BinaryProtocol.h"
+#include "JsonWriter.h"
+#include "Log.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
 
-WebSocketServer::WebSocketServer() {
-    // Set up message handlers
-    m_server.set_open_handler(
-        [this](websocket::ConnectionHandle hdl) { this->on_open(hdl); });
-    m_server.set_close_handler(
-        [this](websocket::ConnectionHandle hdl) { this->on_close(hdl); });
-    m_server.set_message_handler(
-        [this](websocket::ConnectionHandle hdl, const std::string& msg) { 
-            this->on_message(hdl, msg); 
-        });
+namespace {
+
+int64_t steadyMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+WebSocketServer::WebSocketServer(websocket::Server& server, int matchId)
+    : m_server(server), m_match_id(matchId) {}
+
+size_t WebSocketServer::clientCount() const {
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    return m_clients.size();
+}
+
+void WebSocketServer::broadcast(const std::string& message, WireFormat format, Channel channel) {
+    websocket::Opcode opcode = (format == WireFormat::Json)
+        ? websocket::Opcode::Text : websocket::Opcode::Binary;
+
+    m_broadcast_targets.clear();
+    {
+        std::lock_guard<std::mutex> lock(m_clients_mutex);
+        for (const auto& client : m_clients) {
+            if (client.second.format == format) {
+                m_broadcast_targets.emplace_back(client.first);
+            }
+        }
+    }
+    if (!m_broadcast_targets.empty()) {
+        // Frame (and compress) once; every matching connection queues a
+        // reference to the same buffer
+        websocket::PreparedMessage prepared = m_server.prepare(message, opcode);
+        m_server.send_prepared(m_broadcast_targets, prepared, static_cast<websocket::CoalesceKey>(channel));
+    }
+}
+
+bool WebSocketServer::hasClients(WireFormat format) const {
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    for (const auto& client : m_clients) {
+        if (client.second.format == format) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void WebSocketServer::setRates(int simRate, int defaultSnapshotRate) {
+    m_sim_rate = std::max(1, simRate);
+    m_default_objects_interval = rateToInterval(defaultSnapshotRate);
+}
+
+int WebSocketServer::rateToInterval(double rate) const {
+    if (!(rate > 0)) {
+        return 0;
+    }
+    // Never faster than the simulation itself
+    double ticks = std::round(m_sim_rate / rate);
+    return static_cast<int>(std::clamp(ticks, 1.0, static_cast<double>(m_sim_rate) * 60));
+}
+
+void WebSocketServer::beginTick(uint32_t tick, bool terrainChanged) {
+    for (auto& channel : m_tick_targets) {
+        for (auto& targets : channel) {
+            targets.clear();
+        }
+    }
+    m_snapshot_targets.clear();
+    m_joining_targets.clear();
+
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    for (auto& client : m_clients) {
+        ClientSubscription& sub = client.second;
+        size_t format = static_cast<size_t>(sub.format);
+        websocket::ConnectionHandle hdl(client.first);
+        if (sub.objectsInterval > 0 && tick % sub.objectsInterval == 0) {
+            if (sub.dedicated()) {
+                m_snapshot_targets.push_back({hdl, sub.format, sub.culled, sub.viewport, sub.budget});
+            } else {
+                m_tick_targets[static_cast<size_t>(Channel::Objects)][format].push_back(hdl);
+            }
+        }
+        if (sub.objectsInterval > 0) {
+            m_tick_targets[static_cast<size_t>(Channel::Reliable)][format].push_back(hdl);
+            if (sub.needsProjectiles) {
+                m_joining_targets.push_back({hdl, sub.format});
+                sub.needsProjectiles = false;
+            }
+        } else {
+            sub.needsProjectiles = true;
+        }
+        if (sub.terrain && (terrainChanged || sub.needsTerrain)) {
+            m_tick_targets[static_cast<size_t>(Channel::Terrain)][format].push_back(hdl);
+            sub.needsTerrain = false;
+        }
+        // Stats are always JSON text
+        if (sub.statsInterval > 0 && tick % sub.statsInterval == 0) {
+            m_tick_targets[static_cast<size_t>(Channel::Stats)][0].push_back(hdl);
+        }
+    }
 }
 
-WebSocketServer::~WebSocketServer() {
-    stop();
+bool WebSocketServer::hasTargets(Channel channel, WireFormat format) const {
+    return !m_tick_targets[static_cast<size_t>(channel)][static_cast<size_t>(format)].empty();
 }
 
-void WebSocketServer::run(int port) {
-    m_server.listen(port);
-    m_server_thread = std::thread([this]() {
-        m_server.run();
-    });
+void WebSocketServer::publish(const std::string& message, Channel channel, WireFormat format) {
+    const auto& targets = m_tick_targets[static_cast<size_t>(channel)][static_cast<size_t>(format)];
+    if (targets.empty()) {
+        return;
+    }
+    websocket::Opcode opcode = (format == WireFormat::Json)
+        ? websocket::Opcode::Text : websocket::Opcode::Binary;
+    websocket::PreparedMessage prepared = m_server.prepare(message, opcode);
+    m_server.send_prepared(targets, prepared, static_cast<websocket::CoalesceKey>(channel));
 }
 
-void WebSocketServer::stop() {
-    m_server.stop();
-    if (m_server_thread.joinable()) {
-        m_server_thread.join();
+void WebSocketServer::publishText(const std::string& message, Channel channel) {
+    m_broadcast_targets.clear();
+    for (const auto& targets : m_tick_targets[static_cast<size_t>(channel)]) {
+        m_broadcast_targets.insert(m_broadcast_targets.end(), targets.begin(), targets.end());
+    }
+    if (m_broadcast_targets.empty()) {
+        return;
     }
+    websocket::PreparedMessage prepared = m_server.prepare(message, websocket::Opcode::Text);
+    m_server.send_prepared(m_broadcast_targets, prepared, static_cast<websocket::CoalesceKey>(channel));
 }
 
-void WebSocketServer::broadcast(const std::string& message) {
-    m_server.broadcast(message);
+void WebSocketServer::sendTo(websocket::ConnectionHandle hdl, const std::string& message,
+                             Channel channel, WireFormat format) {
+    websocket::Opcode opcode = (format == WireFormat::Json)
+        ? websocket::Opcode::Text : websocket::Opcode::Binary;
+    m_server.send_prepared(hdl, m_server.prepare(message, opcode),
+                           static_cast<websocket::CoalesceKey>(channel));
+}
+
+void WebSocketServer::takeDepartedClients(std::vector<int>& out) {
+    out.clear();
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    out.swap(m_departed);
+}
+
+websocket::QueueStats WebSocketServer::queueStats() const {
+    return m_server.queue_stats();
+}
+
+void WebSocketServer::pingClients() {
+    m_broadcast_targets.clear();
+    {
+        std::lock_guard<std::mutex> lock(m_clients_mutex);
+        for (const auto& client : m_clients) {
+            m_broadcast_targets.emplace_back(client.first);
+        }
+    }
+    if (!m_broadcast_targets.empty()) {
+        std::string stamp = std::to_string(steadyMicros());
+        m_server.send_prepared(m_broadcast_targets, m_server.prepare(stamp, websocket::Opcode::Ping));
+    }
+}
+
+void WebSocketServer::latencyStats(LatencyHistogram& rtt, LatencyHistogram& jitter) const {
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    rtt = m_all_rtt;
+    jitter = m_all_jitter;
+}
+
+bool WebSocketServer::clientLatency(int clientId, ClientLatency& out) const {
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    auto it = m_latency.find(clientId);
+    if (it == m_latency.end()) {
+        return false;
+    }
+    out = it->second;
+    return true;
 }
 
-void WebSocketServer::setOnMessageCallback(std::function<void(const std::string&)> callback) {
+void WebSocketServer::setOnMessageCallback(std::function<void(int, const JsonValue&)> callback) {
     m_on_message_callback = callback;
 }
 
 void WebSocketServer::on_open(websocket::ConnectionHandle hdl) {
-    std::cout << "Client connected: " << hdl.id << std::endl;
+    LOG_INFO("Client connected").field("match", m_match_id).field("client", hdl.id);
+    {
+        std::lock_guard<std::mutex> lock(m_clients_mutex);
+        ClientSubscription& sub = m_clients[hdl.id];
+        sub.objectsInterval = m_default_objects_interval;
+    }
     
     // Send initial game state to new client
-    json welcome;
-    welcome["type"] = "welcome";
-    welcome["message"] = "Connected to Celestial Siege server";
-    m_server.send(hdl, welcome.dump());
+    std::string welcome;
+    JsonWriter writer(welcome);
+    writer.beginObject();
+    writer.field(JSON_KEY("match"), m_match_id);
+    writer.field(JSON_KEY("message"), "Connected to Celestial Siege server");
+    writer.field(JSON_KEY("type"), "welcome");
+    writer.endObject();
+    m_server.send(hdl, welcome);
 }
 
 void WebSocketServer::on_close(websocket::ConnectionHandle hdl) {
-    std::cout << "Client disconnected: " << hdl.id << std::endl;
+    LOG_INFO("Client disconnected").field("match", m_match_id).field("client", hdl.id);
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    auto it = m_clients.find(hdl.id);
+    if (it != m_clients.end()) {
+        if (it->second.dedicated()) {
+            m_departed.push_back(hdl.id);
+        }
+        m_clients.erase(it);
+    }
+    m_latency.erase(hdl.id);
 }
 
 void WebSocketServer::on_message(websocket::ConnectionHandle hdl, const std::string& msg) {
-    std::cout << "Message from client " << hdl.id << ": " << msg << std::endl;
-    
+    LOG_DEBUG("Message").field("match", m_match_id).field("client", hdl.id).field("text", msg);
+
     try {
-        json message = json::parse(msg);
+        JsonValue message = m_document.parse(msg);
         
-        if (m_on_message_callback) {
-            m_on_message_callback(msg);
+        // Protocol negotiation, subscriptions and viewports are handled here
+        // and never reach the game
+        if (message["action"] == "negotiate") {
+            negotiate(hdl, message);
+            return;
+        }
+        if (message["action"] == "subscribe") {
+            subscribe(hdl, message);
+            return;
+        }
+        if (message["action"] == "viewport") {
+            setViewport(hdl, message);
+            return;
         }
         
-        // Echo back to confirm receipt
-        json response;
-        response["type"] = "ack";
-        response["original"] = message;
-        m_server.send(hdl, response.dump());
-        
+        // Game commands are acknowledged by the game once applied
+        if (m_on_message_callback) {
+            m_on_message_callback(hdl.id, message);
+        }
+    } catch (const std::exception& e) {
+        LOG_LIMITED(LogLevel::Warn, 5, "Unreadable message")
+            .field("client", hdl.id).field("error", e.what());
+    }
+}
+
+void WebSocketServer::on_pong(websocket::ConnectionHandle hdl, const std::string& payload) {
+    // Only pongs to pingClients() carry a timestamp
+    int64_t sent = 0;
+    auto parsed = std::from_chars(payload.data(), payload.data() + payload.size(), sent);
+    if (parsed.ec != std::errc() || parsed.ptr != payload.data() + payload.size()) {
+        return;
+    }
+    int64_t elapsed = steadyMicros() - sent;
+    if (elapsed < 0) {
+        return;
+    }
+    uint32_t rtt = static_cast<uint32_t>(std::min<int64_t>(elapsed, UINT32_MAX));
+
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    if (m_clients.find(hdl.id) == m_clients.end()) {
+        return;
+    }
+    ClientLatency& latency = m_latency[hdl.id];
+    if (latency.rtt.count() == 0) {
+        latency.smoothedRttUs = rtt;
+    } else {
+        uint32_t change = rtt > latency.lastRttUs ? rtt - latency.lastRttUs : latency.lastRttUs - rtt;
+        latency.jitterUs += (change - latency.jitterUs) / 16.0;
+        latency.smoothedRttUs += (rtt - latency.smoothedRttUs) / 8.0;
+        latency.jitter.record(change);
+        m_all_jitter.record(change);
+    }
+    latency.lastRttUs = rtt;
+    latency.rtt.record(rtt);
+    m_all_rtt.record(rtt);
+}
+
+void WebSocketServer::negotiate(websocket::ConnectionHandle hdl, const JsonValue& request) {
+    // Anything we don't understand falls back to JSON
+    WireFormat format = WireFormat::Json;
+    try {
+        if (request["protocol"] == "binary" &&
+            request["version"].getInt() == BinaryProtocol::SCHEMA_VERSION) {
+            bool quantize = !request["quantize"].isNull() && request["quantize"].getBool();
+            format = quantize ? WireFormat::BinaryQuantized : WireFormat::Binary;
+        }
     } catch (const std::exception& e) {
-        std::cerr << "Error parsing message: " << e.what() << std::endl;
+        LOG_LIMITED(LogLevel::Warn, 5, "Invalid negotiate message")
+            .field("client", hdl.id).field("error", e.what());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_clients_mutex);
+        ClientSubscription& sub = m_clients[hdl.id];
+        // The terrain the client has is in the old format
+        sub.needsTerrain = sub.needsTerrain || sub.format != format;
+        sub.format = format;
+    }
+
+    m_response.clear();
+    JsonWriter writer(m_response);
+    writer.beginObject();
+    writer.field(JSON_KEY("type"), "protocol");
+    if (format == WireFormat::Json) {
+        writer.field(JSON_KEY("protocol"), "json");
+    } else {
+        writer.field(JSON_KEY("protocol"), "binary");
+        writer.field(JSON_KEY("version"), static_cast<int>(BinaryProtocol::SCHEMA_VERSION));
+        writer.field(JSON_KEY("quantize"), format == WireFormat::BinaryQuantized);
+    }
+    writer.endObject();
+    m_server.send(hdl, m_response);
+}
+
+void WebSocketServer::subscribe(websocket::ConnectionHandle hdl, const JsonValue& request) {
+    // Rates are in Hz; a missing field leaves that channel unchanged
+    ClientSubscription sub;
+    {
+        std::lock_guard<std::mutex> lock(m_clients_mutex);
+        auto it = m_clients.find(hdl.id);
+        if (it == m_clients.end()) {
+            return;
+        }
+        try {
+            if (!request["objects"].isNull()) {
+                it->second.objectsInterval = rateToInterval(request["objects"].getDouble());
+            }
+            if (!request["stats"].isNull()) {
+                it->second.statsInterval = rateToInterval(request["stats"].getDouble());
+            }
+            if (!request["budget"].isNull()) {
+                // Anything smaller couldn't hold the header and a few objects
+                int budget = std::clamp(request["budget"].getInt(), 0, 1 << 20);
+                setDedicated(hdl.id, it->second, it->second.culled,
+                             budget > 0 ? std::max(budget, 256) : 0);
+            }
+            if (!request["terrain"].isNull()) {
+                bool terrain = request["terrain"].getBool();
+                it->second.needsTerrain = it->second.needsTerrain || (terrain && !it->second.terrain);
+                it->second.terrain = terrain;
+            }
+        } catch (const std::exception& e) {
+            LOG_LIMITED(LogLevel::Warn, 5, "Invalid subscribe message")
+                .field("client", hdl.id).field("error", e.what());
+        }
+        sub = it->second;
     }
-}
\ No newline at end of file
+
+    // Reply with the effective rates after rounding to whole ticks
+    auto effectiveRate = [this](int interval) {
+        return interval > 0 ? static_cast<double>(m_sim_rate) / interval : 0.0;
+    };
+    m_response.clear();
+    JsonWriter writer(m_response);
+    writer.beginObject();
+    writer.field(JSON_KEY("budget"), sub.budget);
+    writer.field(JSON_KEY("objects"), effectiveRate(sub.objectsInterval));
+    writer.field(JSON_KEY("stats"), effectiveRate(sub.statsInterval));
+    writer.field(JSON_KEY("terrain"), sub.terrain);
+    writer.field(JSON_KEY("tickRate"), m_sim_rate);
+    writer.field(JSON_KEY("type"), "subscribed");
+    writer.endObject();
+    m_server.send(hdl, m_response);
+}
+
+void WebSocketServer::setViewport(websocket::ConnectionHandle hdl, const JsonValue& request) {
+    // No reply: clients may send this every frame while panning. A missing
+    // or empty rectangle goes back to receiving the whole world.
+    Viewport viewport;
+    bool culled = false;
+    try {
+        if (!request["width"].isNull() && !request["height"].isNull()) {
+            viewport.minX = request["x"].getDouble();
+            viewport.minY = request["y"].getDouble();
+            viewport.maxX = viewport.minX + request["width"].getDouble();
+            viewport.maxY = viewport.minY + request["height"].getDouble();
+            culled = viewport.maxX > viewport.minX && viewport.maxY > viewport.minY;
+        }
+    } catch (const std::exception& e) {
+        LOG_LIMITED(LogLevel::Warn, 5, "Invalid viewport message")
+            .field("client", hdl.id).field("error", e.what());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    auto it = m_clients.find(hdl.id);
+    if (it == m_clients.end()) {
+        return;
+    }
+    it->second.viewport = viewport;
+    setDedicated(hdl.id, it->second, culled, it->second.budget);
+}
+
+void WebSocketServer::setDedicated(int clientId, ClientSubscription& sub, bool culled, int budget) {
+    // Per-client snapshot state only stays valid while the mode is unchanged
+    if (sub.dedicated() && (sub.culled != culled || (sub.budget > 0) != (budget > 0))) {
+        m_departed.push_back(clientId);
+    }
+    sub.culled = culled;
+    sub.budget = budget;
+}
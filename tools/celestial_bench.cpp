@@ -0,0 +1,504 @@
+// Benchmarks of the simulation's hot paths, from single systems up to a
+// whole late-game tick. Each benchmark runs at a few sizes and reports time
+// and heap allocations per operation, one row per benchmark and size, so
+// results can be kept and compared between builds.
+//
+// Usage: celestial_bench [--filter TEXT] [--min-time S] [--threads N]
+//                        [--format csv|json] [--out FILE] [--list]
+//
+// --filter runs only the benchmarks whose name contains TEXT. Each one is
+// repeated until it has run for at least --min-time seconds (default 0.25).
+// --threads sets the threads of the JobSystem the parallel phases use; the
+// default of 1 keeps numbers comparable between machines.
+
+#include "Allocations.h"
+#include "GameWorld.h"
+#include "JobSystem.h"
+#include "JsonReader.h"
+#include "JsonWriter.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr double DELTA = 1.0 / GameWorld::SIM_RATE;
+// Benchmarks whose operation changes the scene rebuild it this often, so
+// every run measures the same kind of scene
+constexpr uint64_t TICKS_PER_SCENE = GameWorld::SIM_RATE;
+
+struct Options {
+    std::string filter;
+    double minTime = 0.25;
+    int threads = 1;
+    bool json = false;
+    std::string out;        // Empty for stdout
+    bool list = false;
+};
+
+// Passed to a benchmark, which runs its operation iterations() times. Setup
+// between pause() and resume() is neither timed nor counted.
+class BenchState {
+public:
+    explicit BenchState(uint64_t iterations) : m_iterations(iterations) {}
+
+    uint64_t iterations() const { return m_iterations; }
+
+    // Heap allocations anywhere in the process count while timed
+    void resume() {
+        m_allocations -= Allocations::count();
+        m_bytes -= Allocations::bytes();
+        m_started = Clock::now();
+    }
+    void pause() {
+        m_elapsed += Clock::now() - m_started;
+        m_allocations += Allocations::count();
+        m_bytes += Allocations::bytes();
+    }
+
+    double seconds() const { return std::chrono::duration<double>(m_elapsed).count(); }
+    uint64_t allocations() const { return m_allocations; }
+    uint64_t bytes() const { return m_bytes; }
+
+private:
+    uint64_t m_iterations;
+    Clock::time_point m_started;
+    Clock::duration m_elapsed{0};
+    uint64_t m_allocations = 0;
+    uint64_t m_bytes = 0;
+};
+
+struct Benchmark {
+    std::string name;
+    std::string params;     // "key=value" pairs, space separated
+    std::function<void(BenchState&)> run;
+};
+
+struct Result {
+    const Benchmark* benchmark;
+    uint64_t iterations;
+    double nsPerOp;
+    double allocsPerOp;
+    double bytesPerOp;
+};
+
+void usage(const char* program) {
+    std::cerr << "Usage: " << program << " [--filter TEXT] [--min-time S] [--threads N]"
+              << " [--format csv|json] [--out FILE] [--list]" << std::endl;
+    std::exit(2);
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--filter" && hasValue) {
+            options.filter = argv[++i];
+        } else if (arg == "--min-time" && hasValue) {
+            options.minTime = std::max(0.0, std::atof(argv[++i]));
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--format" && hasValue) {
+            std::string format = argv[++i];
+            if (format != "csv" && format != "json") {
+                usage(argv[0]);
+            }
+            options.json = format == "json";
+        } else if (arg == "--out" && hasValue) {
+            options.out = argv[++i];
+        } else if (arg == "--list") {
+            options.list = true;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    return options;
+}
+
+// Scenes. Everything is drawn from fixed seeds, so a benchmark sees the
+// same scene in every run and every build.
+
+// The four planets of GameWorld::init(), scaled to a world of the given size
+void addPlanets(std::vector<std::unique_ptr<GameObject>>& objects, double width, double height) {
+    double sx = width / 800.0;
+    double sy = height / 600.0;
+    objects.push_back(std::make_unique<Planet>(Vec2d(400 * sx, 300 * sy), 50 * sx, 8000.0, 1));
+    objects.push_back(std::make_unique<Planet>(Vec2d(150 * sx, 150 * sy), 30 * sx, 3000.0, 0));
+    objects.push_back(std::make_unique<Planet>(Vec2d(650 * sx, 450 * sy), 25 * sx, 2500.0, 0));
+    objects.push_back(std::make_unique<Planet>(Vec2d(200 * sx, 450 * sy), 20 * sx, 2000.0, -1));
+}
+
+EnemyType enemyType(size_t i) {
+    static const EnemyType TYPES[] = {EnemyType::Basic, EnemyType::Fast, EnemyType::Basic, EnemyType::Tank};
+    return TYPES[i % 4];
+}
+
+// Enemies scattered over the world, moving
+std::vector<std::unique_ptr<GameObject>> physicsScene(int bodies) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> x(0, 800), y(0, 600), v(-40, 40);
+    std::vector<std::unique_ptr<GameObject>> objects;
+    addPlanets(objects, 800, 600);
+    for (int i = 0; i < bodies; ++i) {
+        auto enemy = createEnemy(enemyType(i), Vec2d(x(rng), y(rng)));
+        enemy->velocity = Vec2d(v(rng), v(rng));
+        objects.push_back(std::move(enemy));
+    }
+    return objects;
+}
+
+// Planets plus towers on the given share of the grid's cells, keeping the
+// corners free for the path's ends
+std::vector<std::unique_ptr<GameObject>> pathScene(int width, int height, double density) {
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<double> chance(0, 1);
+    std::vector<std::unique_ptr<GameObject>> objects;
+    addPlanets(objects, width * 10.0, height * 10.0);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            bool corner = (x < 4 && y < 4) || (x >= width - 4 && y >= height - 4);
+            if (!corner && chance(rng) < density) {
+                objects.push_back(createTower(TowerType::Basic, Vec2d(x * 10 + 5, y * 10 + 5)));
+            }
+        }
+    }
+    return objects;
+}
+
+std::unique_ptr<GameWorld> makeWorld(websocket::Server& server, JobSystem& jobs) {
+    auto world = std::make_unique<GameWorld>(server, jobs, 0);
+    world->seed(1);
+    world->init();
+    return world;
+}
+
+// Towers in the bottom left and enemies in the top right, out of each
+// other's range: every tower looks at every object and finds nothing, so
+// nothing changes between iterations
+std::unique_ptr<GameWorld> targetingScene(websocket::Server& server, JobSystem& jobs, int towers, int enemies) {
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> towerX(20, 280), towerY(420, 580);
+    std::uniform_real_distribution<double> enemyX(520, 780), enemyY(20, 180);
+    auto world = makeWorld(server, jobs);
+    for (int i = 0; i < towers; ++i) {
+        world->addObject(createTower(static_cast<TowerType>(i % 4), Vec2d(towerX(rng), towerY(rng))));
+    }
+    for (int i = 0; i < enemies; ++i) {
+        world->addObject(createEnemy(enemyType(i), Vec2d(enemyX(rng), enemyY(rng))));
+    }
+    return world;
+}
+
+// Projectiles that miss: each is checked against every enemy
+std::unique_ptr<GameWorld> collisionScene(websocket::Server& server, JobSystem& jobs, int projectiles, int enemies) {
+    std::mt19937 rng(4);
+    std::uniform_real_distribution<double> shotX(20, 280), shotY(420, 580);
+    std::uniform_real_distribution<double> enemyX(520, 780), enemyY(20, 180);
+    auto world = makeWorld(server, jobs);
+    for (int i = 0; i < enemies; ++i) {
+        world->addObject(createEnemy(enemyType(i), Vec2d(enemyX(rng), enemyY(rng))));
+    }
+    for (int i = 0; i < projectiles; ++i) {
+        Vec2d from(shotX(rng), shotY(rng));
+        world->spawnProjectile(from, from + Vec2d(0, -10), 20);
+    }
+    return world;
+}
+
+// Rings of every tower type around the base and a wave closing in on it
+std::unique_ptr<GameWorld> lateGameScene(websocket::Server& server, JobSystem& jobs, int towers, int enemies) {
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> angle(0, 2 * M_PI), radius(250, 300);
+    auto world = makeWorld(server, jobs);
+    for (int i = 0; i < towers; ++i) {
+        int ring = i / 24;
+        double a = (i % 24) * 2 * M_PI / 24 + ring * 0.13;
+        double r = 90 + ring * 35;
+        world->addObject(createTower(static_cast<TowerType>(i % 4),
+                                     Vec2d(400 + std::cos(a) * r, 300 + std::sin(a) * r)));
+    }
+    for (int i = 0; i < enemies; ++i) {
+        double a = angle(rng);
+        double r = radius(rng);
+        auto enemy = createEnemy(enemyType(i), Vec2d(400 + std::cos(a) * r, 300 + std::sin(a) * r), 3.0);
+        enemy->setTarget(Vec2d(400, 300));
+        world->addObject(std::move(enemy));
+    }
+    return world;
+}
+
+std::string param(const char* key, int value) {
+    return std::string(key) + "=" + std::to_string(value);
+}
+
+std::vector<Benchmark> benchmarks(websocket::Server& server, JobSystem& jobs) {
+    std::vector<Benchmark> list;
+
+    for (int bodies : {16, 64, 256, 1024}) {
+        list.push_back({"physics.update", param("bodies", bodies), [bodies, &jobs](BenchState& state) {
+            PhysicsEngine physics;
+            std::vector<std::unique_ptr<GameObject>> objects;
+            for (uint64_t i = 0; i < state.iterations(); ++i) {
+                if (i % TICKS_PER_SCENE == 0) {
+                    state.pause();
+                    objects = physicsScene(bodies);
+                    state.resume();
+                }
+                physics.update(objects, DELTA, jobs);
+            }
+        }});
+    }
+
+    // Every step weighs the gravity of every object, towers included, so
+    // obstacles cost twice: in the search and in each step. The largest grid
+    // is kept sparse to stay within seconds.
+    struct PathSize { int width, height, percent; };
+    for (PathSize size : {PathSize{40, 30, 0}, {40, 30, 5}, {40, 30, 15}, {80, 60, 0}, {80, 60, 5},
+                          {80, 60, 15}, {160, 120, 0}, {160, 120, 5}}) {
+        std::string params = param("width", size.width) + " " + param("height", size.height) + " " +
+                             param("obstaclePercent", size.percent);
+        list.push_back({"pathfinding.findPath", params, [size](BenchState& state) {
+            state.pause();
+            auto objects = pathScene(size.width, size.height, size.percent / 100.0);
+            PathfindingSystem pathfinding(size.width, size.height, 10.0);
+            pathfinding.updateObstacles(objects);
+            PhysicsEngine physics;
+            state.resume();
+            Vec2d start(15, 15);
+            Vec2d end(size.width * 10 - 15, size.height * 10 - 15);
+            for (uint64_t i = 0; i < state.iterations(); ++i) {
+                pathfinding.findPath(start, end, objects, physics);
+            }
+        }});
+    }
+
+    for (auto [w, h] : {std::pair<int, int>(80, 60), {160, 120}, {320, 240}}) {
+        int width = w;
+        int height = h;
+        std::string params = param("width", width) + " " + param("height", height);
+        list.push_back({"terrain.update", params, [=](BenchState& state) {
+            state.pause();
+            CellularAutomata terrain(width, height, 10.0);
+            terrain.seed(1);
+            terrain.initialize(0.35);
+            state.resume();
+            for (uint64_t i = 0; i < state.iterations(); ++i) {
+                terrain.update();
+            }
+        }});
+    }
+
+    // What the old getStateAsJson() + dump() did: capture every object and
+    // write the state frame. Binary alongside for comparison.
+    for (int entities : {50, 200, 1000}) {
+        auto encode = [entities, &server, &jobs](BenchState& state, bool binary) {
+            state.pause();
+            auto world = targetingScene(server, jobs, entities / 5, entities - entities / 5);
+            std::vector<EntityState> states;
+            std::string out;
+            BinaryProtocol::Quantization quantization = world->getQuantization();
+            state.resume();
+            for (uint64_t i = 0; i < state.iterations(); ++i) {
+                world->captureEntityStates(states);
+                if (binary) {
+                    BinaryProtocol::encodeState(out, world->getStateHeader(), states, nullptr, &quantization);
+                } else {
+                    JsonProtocol::encodeState(out, world->getStateHeader(), states, nullptr);
+                }
+            }
+        };
+        list.push_back({"state.json", param("entities", entities),
+                        [encode](BenchState& state) { encode(state, false); }});
+        list.push_back({"state.binary", param("entities", entities),
+                        [encode](BenchState& state) { encode(state, true); }});
+    }
+
+    // Client messages as the server parses them, into one reused document
+    struct Message { const char* name; std::string text; };
+    std::string chat = "{\"action\":\"chat\",\"text\":\"";
+    for (int i = 0; i < 64; ++i) {
+        chat += "gg \\u00e9 well played, see you next wave \\\"tower rush\\\"\\n";
+    }
+    chat += "\",\"seq\":9}";
+    for (const Message& message : {
+             Message{"build_tower", R"({"action":"build_tower","position":{"x":412.5,"y":233},"towerType":2,"seq":17})"},
+             Message{"subscribe", R"({"action":"subscribe","objects":20,"stats":1,"budget":16384,"terrain":true})"},
+             Message{"escaped_text", chat}}) {
+        std::string text = message.text;
+        std::string params = std::string("message=") + message.name + " " +
+                             param("bytes", static_cast<int>(text.size()));
+        list.push_back({"json.parse", params, [text](BenchState& state) {
+            JsonDocument document;
+            for (uint64_t i = 0; i < state.iterations(); ++i) {
+                document.parse(text);
+            }
+        }});
+    }
+
+    for (int towers : {16, 64, 256}) {
+        for (int enemies : {100, 1000}) {
+            list.push_back({"combat.targeting", param("towers", towers) + " " + param("enemies", enemies),
+                            [=, &server, &jobs](BenchState& state) {
+                state.pause();
+                auto world = targetingScene(server, jobs, towers, enemies);
+                state.resume();
+                for (uint64_t i = 0; i < state.iterations(); ++i) {
+                    world->fireTowers();
+                }
+            }});
+        }
+    }
+
+    for (int projectiles : {64, 256, 1024}) {
+        for (int enemies : {100, 1000}) {
+            list.push_back({"combat.collisions", param("projectiles", projectiles) + " " + param("enemies", enemies),
+                            [=, &server, &jobs](BenchState& state) {
+                state.pause();
+                auto world = collisionScene(server, jobs, projectiles, enemies);
+                state.resume();
+                for (uint64_t i = 0; i < state.iterations(); ++i) {
+                    world->handleCollisions();
+                }
+            }});
+        }
+    }
+
+    for (auto [t, e] : {std::pair<int, int>(24, 100), {72, 300}, {144, 1000}}) {
+        int towers = t;
+        int enemies = e;
+        list.push_back({"world.tick", param("towers", towers) + " " + param("enemies", enemies),
+                        [=, &server, &jobs](BenchState& state) {
+            std::unique_ptr<GameWorld> world;
+            for (uint64_t i = 0; i < state.iterations(); ++i) {
+                if (i % TICKS_PER_SCENE == 0) {
+                    state.pause();
+                    world.reset();
+                    world = lateGameScene(server, jobs, towers, enemies);
+                    state.resume();
+                }
+                world->tick(DELTA);
+            }
+            state.pause();
+            world.reset();
+            state.resume();
+        }});
+    }
+
+    return list;
+}
+
+// Runs a benchmark with more and more iterations until one run takes at
+// least minTime
+Result measure(const Benchmark& benchmark, double minTime) {
+    uint64_t iterations = 1;
+    while (true) {
+        BenchState state(iterations);
+        state.resume();
+        benchmark.run(state);
+        state.pause();
+        double seconds = state.seconds();
+        if (seconds >= minTime || iterations >= 1000000000) {
+            return {&benchmark, iterations, seconds * 1e9 / iterations,
+                    static_cast<double>(state.allocations()) / iterations,
+                    static_cast<double>(state.bytes()) / iterations};
+        }
+        // Aim a little past minTime, growing at most 100x at once
+        double target = seconds > 0 ? minTime * 1.4 / seconds * iterations : iterations * 100.0;
+        iterations = static_cast<uint64_t>(std::clamp(target, iterations + 1.0, iterations * 100.0));
+    }
+}
+
+void writeCsv(std::ostream& out, const std::vector<Result>& results) {
+    out << "benchmark,params,iterations,nsPerOp,allocsPerOp,bytesPerOp\n";
+    for (const Result& r : results) {
+        out << r.benchmark->name << ',' << r.benchmark->params << ',' << r.iterations << ','
+            << r.nsPerOp << ',' << r.allocsPerOp << ',' << r.bytesPerOp << '\n';
+    }
+}
+
+void writeJson(std::ostream& out, const Options& options, const std::vector<Result>& results) {
+    std::string json;
+    JsonWriter writer(json);
+    writer.beginObject();
+    writer.key(JSON_KEY("results"));
+    writer.beginArray();
+    for (const Result& r : results) {
+        writer.beginObject();
+        writer.field(JSON_KEY("allocsPerOp"), r.allocsPerOp);
+        writer.key(JSON_KEY("benchmark"));
+        writer.rawValue("\"" + r.benchmark->name + "\"");
+        writer.field(JSON_KEY("bytesPerOp"), r.bytesPerOp);
+        writer.field(JSON_KEY("iterations"), r.iterations);
+        writer.field(JSON_KEY("nsPerOp"), r.nsPerOp);
+        writer.key(JSON_KEY("params"));
+        writer.rawValue("\"" + r.benchmark->params + "\"");
+        writer.endObject();
+    }
+    writer.endArray();
+    writer.field(JSON_KEY("threads"), options.threads);
+    writer.endObject();
+    out << json << '\n';
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options = parseOptions(argc, argv);
+    Log::setLevel(LogLevel::Warn);
+
+    websocket::Server server;
+    JobSystem jobs(static_cast<size_t>(options.threads - 1));
+    std::vector<Benchmark> all = benchmarks(server, jobs);
+    std::vector<const Benchmark*> selected;
+    for (const Benchmark& benchmark : all) {
+        if ((benchmark.name + " " + benchmark.params).find(options.filter) != std::string::npos) {
+            selected.push_back(&benchmark);
+        }
+    }
+    if (options.list) {
+        for (const Benchmark* benchmark : selected) {
+            std::cout << benchmark->name << ' ' << benchmark->params << '\n';
+        }
+        return 0;
+    }
+
+    std::ofstream file;
+    if (!options.out.empty()) {
+        file.open(options.out);
+        if (!file) {
+            std::cerr << "Cannot write " << options.out << std::endl;
+            return 1;
+        }
+    }
+
+    // Progress and a readable table on stderr; the results go to the output
+    std::vector<Result> results;
+    for (const Benchmark* benchmark : selected) {
+        Result result = measure(*benchmark, options.minTime);
+        results.push_back(result);
+        std::cerr << benchmark->name << ' ' << benchmark->params << ": " << result.nsPerOp << " ns/op, "
+                  << result.allocsPerOp << " allocs/op, " << result.bytesPerOp << " B/op ("
+                  << result.iterations << " iterations)" << std::endl;
+    }
+    Log::flush();
+
+    std::ostream& out = options.out.empty() ? std::cout : file;
+    if (options.json) {
+        writeJson(out, options, results);
+    } else {
+        writeCsv(out, results);
+    }
+    return 0;
+}
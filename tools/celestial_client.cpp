@@ -0,0 +1,523 @@
+// Loopback client for the game server: opens a number of WebSocket
+// connections from one thread, optionally negotiates the binary protocol
+// and channel rates, pings each connection once a second and reports what
+// came back. It can also play: each client sends a mix of build, upgrade
+// and ability commands and times their acks.
+//
+// Usage: celestial_client [--host H] [--port P] [--clients N] [--seconds S] [--binary] [--deflate]
+//                         [--objects HZ] [--stats HZ] [--budget BYTES] [--viewport X,Y,W,H]
+//                         [--matches M] [--commands HZ] [--ramp N] [--step S]
+//
+// With --ramp, clients connect N at a time, one batch every --step seconds
+// (default 5), up to --clients. After each step the server's /metrics are
+// read, and the ramp stops at the first step in which the server missed its
+// tick deadline.
+
+#include "../libs/websocket/websocket_client.hpp"
+#include "../include/LatencyHistogram.h"
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// A step in which more than this share of frames overran missed the deadline
+constexpr double OVERRUN_SHARE = 0.01;
+// Without the server's metrics, a step missed it when snapshots lagged this much
+constexpr uint32_t LAG_LIMIT_US = 100000;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 9002;
+    int clients = 1;
+    double seconds = 5.0;
+    bool binary = false;
+    bool deflate = false;
+    double objectsRate = -1;  // Negative keeps the server default
+    double statsRate = -1;
+    int budget = -1;
+    std::string viewport;  // "x,y,width,height", empty for the whole world
+    int matches = 0;       // Spread clients over matches 0..M-1; 0 connects to "/"
+    double commandRate = 0;  // Commands per second per client
+    int ramp = 0;          // Clients added per step, 0 to connect them all at once
+    double step = 5.0;
+};
+
+struct ClientStats {
+    uint64_t textMessages = 0;
+    uint64_t binaryMessages = 0;
+    uint64_t bytes = 0;
+    bool welcomed = false;
+    // Snapshot delay is the receive time minus the snapshot's server time;
+    // the smallest delay seen stands in for the clock offset
+    int64_t minDelayUs = INT64_MAX;
+    int64_t lastTimeMs = -1;
+    // Commands
+    uint32_t nextSeq = 1;
+    std::unordered_map<uint32_t, int64_t> pending;  // Send time by seq
+    std::vector<int> towers;    // Built by this client, for upgrades
+    double commandsOwed = 0;
+};
+
+// Figures for one step of a ramp, or the whole run
+struct Window {
+    uint64_t snapshots = 0;
+    uint64_t bytes = 0;
+    uint64_t commands = 0;
+    uint64_t applied = 0;
+    uint64_t rejected = 0;
+    uint64_t dropped = 0;
+    LatencyHistogram lag;       // Snapshot delay above the client's smallest
+    LatencyHistogram ackRtt;
+};
+
+// Read from the server's /metrics endpoint
+struct ServerMetrics {
+    double overruns = 0;
+    double droppedTicks = 0;
+    double frameSeconds = 0;
+    double tickP99Seconds = 0;
+};
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--host" && hasValue) {
+            options.host = argv[++i];
+        } else if (arg == "--port" && hasValue) {
+            options.port = std::atoi(argv[++i]);
+        } else if (arg == "--clients" && hasValue) {
+            options.clients = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--seconds" && hasValue) {
+            options.seconds = std::atof(argv[++i]);
+        } else if (arg == "--binary") {
+            options.binary = true;
+        } else if (arg == "--deflate") {
+            options.deflate = true;
+        } else if (arg == "--objects" && hasValue) {
+            options.objectsRate = std::atof(argv[++i]);
+        } else if (arg == "--stats" && hasValue) {
+            options.statsRate = std::atof(argv[++i]);
+        } else if (arg == "--budget" && hasValue) {
+            options.budget = std::atoi(argv[++i]);
+        } else if (arg == "--viewport" && hasValue) {
+            options.viewport = argv[++i];
+        } else if (arg == "--matches" && hasValue) {
+            options.matches = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--commands" && hasValue) {
+            options.commandRate = std::max(0.0, std::atof(argv[++i]));
+        } else if (arg == "--ramp" && hasValue) {
+            options.ramp = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--step" && hasValue) {
+            options.step = std::max(0.5, std::atof(argv[++i]));
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--host H] [--port P] [--clients N] [--seconds S] [--binary] [--deflate]"
+                      << " [--objects HZ] [--stats HZ] [--budget BYTES] [--viewport X,Y,W,H]"
+                      << " [--matches M] [--commands HZ] [--ramp N] [--step S]" << std::endl;
+            std::exit(2);
+        }
+    }
+    return options;
+}
+
+std::string subscribeMessage(const Options& options) {
+    std::string message = "{\"action\":\"subscribe\"";
+    if (options.objectsRate >= 0) {
+        message += ",\"objects\":" + std::to_string(options.objectsRate);
+    }
+    if (options.statsRate >= 0) {
+        message += ",\"stats\":" + std::to_string(options.statsRate);
+    }
+    if (options.budget >= 0) {
+        message += ",\"budget\":" + std::to_string(options.budget);
+    }
+    return message + "}";
+}
+
+std::string viewportMessage(const std::string& rect) {
+    double v[4] = {0, 0, 0, 0};
+    std::sscanf(rect.c_str(), "%lf,%lf,%lf,%lf", &v[0], &v[1], &v[2], &v[3]);
+    return "{\"action\":\"viewport\",\"x\":" + std::to_string(v[0]) +
+           ",\"y\":" + std::to_string(v[1]) + ",\"width\":" + std::to_string(v[2]) +
+           ",\"height\":" + std::to_string(v[3]) + "}";
+}
+
+int64_t nowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now().time_since_epoch()).count();
+}
+
+// The number after "key": at or after from, or -1
+int64_t jsonInteger(const std::string& message, const char* key, size_t from = 0) {
+    std::string pattern = std::string("\"") + key + "\":";
+    size_t at = message.find(pattern, from);
+    if (at == std::string::npos) {
+        return -1;
+    }
+    return std::strtoll(message.c_str() + at + pattern.size(), nullptr, 10);
+}
+
+// Server time in ms of an object snapshot, or -1 for any other message.
+// Keys are written in order, so JSON snapshots are the only messages that
+// end with time rather than type; binary ones carry time at byte 20.
+int64_t snapshotTime(const std::string& message, websocket::Opcode opcode) {
+    if (opcode == websocket::Opcode::Binary) {
+        if (message.size() < 24 || message[0] != 1) {
+            return -1;
+        }
+        uint32_t time = 0;
+        for (int i = 3; i >= 0; --i) {
+            time = (time << 8) | static_cast<unsigned char>(message[20 + i]);
+        }
+        return time;
+    }
+    size_t at = message.rfind("\"time\":");
+    if (at == std::string::npos) {
+        return -1;
+    }
+    char* end = nullptr;
+    int64_t time = std::strtoll(message.c_str() + at + 7, &end, 10);
+    return *end == '}' && end + 1 == message.c_str() + message.size() ? time : -1;
+}
+
+// Something a player would do: mostly building, then upgrading what it
+// built, now and then an ability. Many builds are rejected (terrain,
+// resources), as they are for people.
+std::string nextCommand(ClientStats& client, std::mt19937& rng) {
+    static const char* const ABILITIES[] = {"meteorStrike", "freezeWave", "repair"};
+    uint32_t seq = client.nextSeq++;
+    int roll = std::uniform_int_distribution<int>(0, 9)(rng);
+    std::string message;
+    if (roll >= 5 && roll < 8 && !client.towers.empty()) {
+        int tower = client.towers[std::uniform_int_distribution<size_t>(0, client.towers.size() - 1)(rng)];
+        message = "{\"action\":\"upgrade_tower\",\"towerId\":" + std::to_string(tower);
+    } else if (roll >= 8) {
+        message = std::string("{\"action\":\"special_ability\",\"abilityType\":\"") +
+                  ABILITIES[std::uniform_int_distribution<int>(0, 2)(rng)] + "\"";
+    } else {
+        int x = std::uniform_int_distribution<int>(20, 780)(rng);
+        int y = std::uniform_int_distribution<int>(20, 580)(rng);
+        message = "{\"action\":\"build_tower\",\"position\":{\"x\":" + std::to_string(x) +
+                  ",\"y\":" + std::to_string(y) + "},\"towerType\":" +
+                  std::to_string(std::uniform_int_distribution<int>(0, 3)(rng));
+    }
+    return message + ",\"seq\":" + std::to_string(seq) + "}";
+}
+
+// Blocking GET of the server's /metrics. Only answered on loopback.
+bool scrapeMetrics(const Options& options, ServerMetrics& out) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if (::getaddrinfo(options.host.c_str(), std::to_string(options.port).c_str(), &hints, &result) != 0) {
+        return false;
+    }
+    int fd = ::socket(result->ai_family, result->ai_socktype | SOCK_CLOEXEC, result->ai_protocol);
+    bool connected = fd >= 0 && ::connect(fd, result->ai_addr, result->ai_addrlen) == 0;
+    ::freeaddrinfo(result);
+    std::string response;
+    if (connected) {
+        std::string request = "GET /metrics HTTP/1.1\r\nHost: " + options.host + "\r\n\r\n";
+        if (::send(fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size())) {
+            char buffer[16384];
+            ssize_t n;
+            while ((n = ::recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+                response.append(buffer, static_cast<size_t>(n));
+            }
+        }
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    if (response.compare(0, 12, "HTTP/1.1 200") != 0) {
+        return false;
+    }
+
+    auto value = [&response](const char* sample) {
+        std::string line = std::string("\n") + sample + " ";
+        size_t at = response.find(line);
+        return at == std::string::npos ? 0.0 : std::atof(response.c_str() + at + line.size());
+    };
+    out.overruns = value("celestial_tick_overruns_total");
+    out.droppedTicks = value("celestial_ticks_dropped_total");
+    out.frameSeconds = value("celestial_frame_seconds");
+    out.tickP99Seconds = value("celestial_tick_seconds{quantile=\"0.99\"}");
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options = parseOptions(argc, argv);
+    bool ramping = options.ramp > 0;
+
+    std::vector<std::unique_ptr<websocket::Client>> clients;
+    std::vector<ClientStats> stats;
+    std::vector<pollfd> fds;
+    int failed = 0;
+    auto connectClients = [&](int count) {
+        for (int i = 0; i < count; ++i) {
+            int index = static_cast<int>(clients.size()) + failed;
+            auto client = std::make_unique<websocket::Client>();
+            try {
+                std::string path = options.matches > 0
+                    ? "/match/" + std::to_string(index % options.matches) : "/";
+                client->connect(options.host, options.port, path, options.deflate);
+                if (options.binary) {
+                    client->send("{\"action\":\"negotiate\",\"protocol\":\"binary\",\"version\":3,\"quantize\":true}");
+                }
+                if (options.objectsRate >= 0 || options.statsRate >= 0 || options.budget >= 0) {
+                    client->send(subscribeMessage(options));
+                }
+                if (!options.viewport.empty()) {
+                    client->send(viewportMessage(options.viewport));
+                }
+                fds.push_back({client->fd(), POLLIN, 0});
+                clients.push_back(std::move(client));
+                stats.emplace_back();
+            } catch (const std::exception& e) {
+                if (failed++ == 0) {
+                    std::cerr << "Connection failed: " << e.what() << std::endl;
+                }
+            }
+        }
+    };
+
+    connectClients(ramping ? std::min(options.ramp, options.clients) : options.clients);
+    std::cout << "Connected " << clients.size() << "/" << options.clients << " clients" << std::endl;
+
+    auto started = Clock::now();
+    auto deadline = started + std::chrono::duration<double>(options.seconds);
+    auto stepEnd = started + std::chrono::duration<double>(options.step);
+    auto nextPing = started;
+    auto lastLoop = started;
+    std::vector<uint64_t> pongsSeen;
+    int64_t rttTotal = 0;
+    uint64_t rttCount = 0;
+    int64_t rttMax = 0;
+    std::string message;
+    websocket::Opcode opcode;
+    std::mt19937 rng(1);
+    Window total;
+    Window window;
+    ServerMetrics before;
+    bool haveMetrics = ramping && scrapeMetrics(options, before);
+    if (ramping && !haveMetrics) {
+        std::cerr << "No /metrics from the server; judging steps by snapshot lag alone" << std::endl;
+    }
+    if (ramping) {
+        std::printf("%8s %12s %10s %16s %10s %16s %10s %12s %9s\n", "clients", "snapshots/s", "KiB/s",
+                    "lag p50/p99 ms", "commands", "ack p50/p99 ms", "frame ms", "tick p99 ms", "overruns");
+    }
+
+    while (true) {
+        auto now = Clock::now();
+        if (!ramping && now >= deadline) {
+            break;
+        }
+        if (ramping && now >= stepEnd) {
+            // Report the step, then stop or add the next batch
+            double seconds = std::chrono::duration<double>(now - (stepEnd - std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(options.step)))).count();
+            ServerMetrics after;
+            bool scraped = haveMetrics && scrapeMetrics(options, after);
+            double overruns = scraped ? after.overruns - before.overruns : 0;
+            double dropped = scraped ? after.droppedTicks - before.droppedTicks : 0;
+            char lag[32];
+            char ack[32];
+            std::snprintf(lag, sizeof(lag), "%.1f/%.1f", window.lag.percentile(0.5) / 1000.0,
+                          window.lag.percentile(0.99) / 1000.0);
+            std::snprintf(ack, sizeof(ack), "%.1f/%.1f", window.ackRtt.percentile(0.5) / 1000.0,
+                          window.ackRtt.percentile(0.99) / 1000.0);
+            std::printf("%8zu %12.0f %10.0f %16s %10llu %16s %10.2f %12.2f %9.0f\n", clients.size(),
+                        window.snapshots / seconds, window.bytes / 1024.0 / seconds, lag,
+                        static_cast<unsigned long long>(window.commands), ack,
+                        scraped ? after.frameSeconds * 1000 : 0.0, scraped ? after.tickP99Seconds * 1000 : 0.0,
+                        overruns);
+            std::fflush(stdout);
+
+            // The first step includes joining, when lag has no baseline yet
+            double frames = seconds * 60;
+            bool missed = scraped ? (overruns > frames * OVERRUN_SHARE || dropped > 0)
+                                  : window.lag.percentile(0.99) > LAG_LIMIT_US && window.lag.count() > 0;
+            if (missed) {
+                std::cout << "Server missed its tick deadline with " << clients.size() << " clients" << std::endl;
+                break;
+            }
+            if (static_cast<int>(clients.size()) + failed >= options.clients) {
+                std::cout << "Server kept up with all " << clients.size() << " clients" << std::endl;
+                break;
+            }
+            if (scraped) {
+                before = after;
+            }
+            window = Window();
+            connectClients(std::min(options.ramp, options.clients - static_cast<int>(clients.size()) - failed));
+            stepEnd = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(options.step));
+            now = Clock::now();
+        }
+        pongsSeen.resize(clients.size(), 0);
+
+        if (now >= nextPing) {
+            // The payload carries the send time so the pong gives the RTT
+            std::string stamp = std::to_string(nowMicros());
+            for (auto& client : clients) {
+                if (client->is_open()) {
+                    client->send(stamp, websocket::Opcode::Ping);
+                }
+            }
+            nextPing += std::chrono::seconds(1);
+        }
+
+        if (options.commandRate > 0) {
+            double elapsed = std::chrono::duration<double>(now - lastLoop).count();
+            for (size_t i = 0; i < clients.size(); ++i) {
+                if (!clients[i]->is_open()) {
+                    continue;
+                }
+                stats[i].commandsOwed += options.commandRate * elapsed;
+                for (; stats[i].commandsOwed >= 1; stats[i].commandsOwed -= 1) {
+                    std::string command = nextCommand(stats[i], rng);
+                    stats[i].pending[stats[i].nextSeq - 1] = nowMicros();
+                    clients[i]->send(command);
+                    ++window.commands;
+                    ++total.commands;
+                }
+            }
+        }
+        lastLoop = now;
+
+        ::poll(fds.data(), fds.size(), 10);
+        for (size_t i = 0; i < clients.size(); ++i) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            websocket::Client& client = *clients[i];
+            ClientStats& stat = stats[i];
+            while (client.read_message(message, opcode)) {
+                int64_t received = nowMicros();
+                stat.bytes += message.size();
+                window.bytes += message.size();
+                total.bytes += message.size();
+                if (opcode == websocket::Opcode::Binary) {
+                    ++stat.binaryMessages;
+                } else {
+                    ++stat.textMessages;
+                    if (message.find("\"type\":\"welcome\"") != std::string::npos) {
+                        stat.welcomed = true;
+                    } else if (message.find("\"type\":\"ack\"") != std::string::npos) {
+                        auto sent = stat.pending.find(static_cast<uint32_t>(jsonInteger(message, "seq")));
+                        if (sent != stat.pending.end()) {
+                            uint32_t rtt = static_cast<uint32_t>(std::min<int64_t>(received - sent->second, UINT32_MAX));
+                            window.ackRtt.record(rtt);
+                            total.ackRtt.record(rtt);
+                            stat.pending.erase(sent);
+                        }
+                        Window* windows[] = {&window, &total};
+                        for (Window* counts : windows) {
+                            if (message.find("\"result\":\"applied\"") != std::string::npos) {
+                                ++counts->applied;
+                            } else if (message.find("\"result\":\"dropped\"") != std::string::npos) {
+                                ++counts->dropped;
+                            } else {
+                                ++counts->rejected;
+                            }
+                        }
+                        int64_t id = jsonInteger(message, "id");
+                        if (id > 0 && message.find("\"result\":\"applied\"") != std::string::npos &&
+                            std::find(stat.towers.begin(), stat.towers.end(), id) == stat.towers.end()) {
+                            stat.towers.push_back(static_cast<int>(id));
+                        }
+                    }
+                }
+
+                int64_t time = snapshotTime(message, opcode);
+                if (time >= 0) {
+                    // A restarted match starts its clock again
+                    if (time < stat.lastTimeMs) {
+                        stat.minDelayUs = INT64_MAX;
+                    }
+                    stat.lastTimeMs = time;
+                    int64_t delay = received - time * 1000;
+                    stat.minDelayUs = std::min(stat.minDelayUs, delay);
+                    uint32_t lag = static_cast<uint32_t>(std::min<int64_t>(delay - stat.minDelayUs, UINT32_MAX));
+                    window.lag.record(lag);
+                    total.lag.record(lag);
+                    ++window.snapshots;
+                    ++total.snapshots;
+                }
+            }
+            if (client.pong_count() != pongsSeen[i]) {
+                pongsSeen[i] = client.pong_count();
+                int64_t rtt = nowMicros() - std::atoll(client.last_pong().c_str());
+                rttTotal += rtt;
+                rttMax = std::max(rttMax, rtt);
+                ++rttCount;
+            }
+            if (!client.is_open()) {
+                fds[i].fd = -1;
+            }
+        }
+    }
+
+    ClientStats sum;
+    int welcomed = 0;
+    int open = 0;
+    int compressed = 0;
+    uint64_t wireBytes = 0;
+    for (size_t i = 0; i < clients.size(); ++i) {
+        sum.textMessages += stats[i].textMessages;
+        sum.binaryMessages += stats[i].binaryMessages;
+        sum.bytes += stats[i].bytes;
+        welcomed += stats[i].welcomed ? 1 : 0;
+        open += clients[i]->is_open() ? 1 : 0;
+        compressed += clients[i]->deflate() ? 1 : 0;
+        wireBytes += clients[i]->bytes_received();
+        clients[i]->close();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+
+    std::cout << "Clients welcomed: " << welcomed << ", still open: " << open
+              << ", failed to connect: " << failed << std::endl;
+    std::cout << "Messages: " << sum.textMessages << " text, " << sum.binaryMessages
+              << " binary, " << sum.bytes / 1024 << " KiB payload, " << wireBytes / 1024
+              << " KiB on the wire (" << compressed << " clients compressed)" << std::endl;
+    if (total.snapshots > 0) {
+        std::cout << "Snapshots: " << total.snapshots << " (" << total.snapshots / elapsed << "/s), lag p50/p99 "
+                  << total.lag.percentile(0.5) / 1000.0 << "/" << total.lag.percentile(0.99) / 1000.0
+                  << " ms over each client's lowest delay" << std::endl;
+    }
+    if (total.commands > 0) {
+        std::cout << "Commands: " << total.commands << " sent, " << total.applied << " applied, "
+                  << total.rejected << " rejected, " << total.dropped << " dropped; ack RTT p50/p99 "
+                  << total.ackRtt.percentile(0.5) / 1000.0 << "/" << total.ackRtt.percentile(0.99) / 1000.0
+                  << " ms" << std::endl;
+    }
+    if (rttCount > 0) {
+        std::cout << "Ping RTT: avg " << rttTotal / static_cast<int64_t>(rttCount)
+                  << " us, max " << rttMax << " us over " << rttCount << " pongs" << std::endl;
+    }
+    return (failed == 0 && welcomed == static_cast<int>(clients.size())) ? 0 : 1;
+}
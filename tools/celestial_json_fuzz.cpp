@@ -0,0 +1,564 @@
+// Corpus and differential fuzz checks for JsonDocument (include/JsonReader.h).
+// Every file in the corpus's valid/ directory must parse and every file in
+// invalid/ must be rejected. Then inputs mutated from the corpus are parsed
+// by JsonDocument and by a small recursive reference parser written straight
+// from RFC 8259, and the two must agree: both reject, or both accept with the
+// same values, raw text and string contents.
+//
+// Usage: celestial_json_fuzz [--corpus DIR] [--iterations N] [--seed S]
+//
+// The corpus defaults to tools/json_corpus in the source tree. Exits 1 on
+// the first disagreement, printing the input.
+
+#include "JsonReader.h"
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef JSON_CORPUS_DIR
+#define JSON_CORPUS_DIR "tools/json_corpus"
+#endif
+
+namespace {
+
+struct Options {
+    std::string corpus = JSON_CORPUS_DIR;
+    uint64_t iterations = 200000;
+    uint32_t seed = 1;
+};
+
+// What the reference parser makes of a value
+struct RefValue {
+    JsonType type = JsonType::Null;
+    bool boolean = false;
+    double number = 0;
+    std::string text;       // Decoded string contents
+    size_t rawOffset = 0;
+    size_t rawLength = 0;
+    std::vector<std::string> keys;
+    std::vector<std::unique_ptr<RefValue>> children;
+};
+
+struct RefError {};
+
+// Deliberately the obvious way: recursive, byte at a time, strtod for
+// numbers. Matches JsonDocument's documented choices: depth is limited to
+// MAX_DEPTH containers, and an unpaired surrogate escape decodes to U+FFFD.
+class ReferenceParser {
+public:
+    explicit ReferenceParser(const std::string& input) : m_in(input) {}
+
+    std::unique_ptr<RefValue> parse() {
+        skipSpace();
+        auto value = parseValue(0);
+        skipSpace();
+        if (m_pos != m_in.size()) {
+            throw RefError();
+        }
+        return value;
+    }
+
+private:
+    const std::string& m_in;
+    size_t m_pos = 0;
+
+    int peek() const { return m_pos < m_in.size() ? static_cast<unsigned char>(m_in[m_pos]) : -1; }
+
+    void expect(char c) {
+        if (peek() != static_cast<unsigned char>(c)) {
+            throw RefError();
+        }
+        ++m_pos;
+    }
+
+    void skipSpace() {
+        while (peek() == ' ' || peek() == '\t' || peek() == '\n' || peek() == '\r') {
+            ++m_pos;
+        }
+    }
+
+    std::unique_ptr<RefValue> parseValue(int depth) {
+        auto value = std::make_unique<RefValue>();
+        value->rawOffset = m_pos;
+        int c = peek();
+        if (c == '{' || c == '[') {
+            if (depth == JsonDocument::MAX_DEPTH) {
+                throw RefError();
+            }
+            bool object = c == '{';
+            value->type = object ? JsonType::Object : JsonType::Array;
+            ++m_pos;
+            skipSpace();
+            if (peek() == (object ? '}' : ']')) {
+                ++m_pos;
+            } else {
+                for (;;) {
+                    skipSpace();
+                    if (object) {
+                        if (peek() != '"') {
+                            throw RefError();
+                        }
+                        value->keys.push_back(parseString());
+                        skipSpace();
+                        expect(':');
+                        skipSpace();
+                    }
+                    value->children.push_back(parseValue(depth + 1));
+                    skipSpace();
+                    if (peek() == ',') {
+                        ++m_pos;
+                        continue;
+                    }
+                    expect(object ? '}' : ']');
+                    break;
+                }
+            }
+        } else if (c == '"') {
+            value->type = JsonType::String;
+            value->text = parseString();
+        } else if (c == '-' || (c >= '0' && c <= '9')) {
+            value->type = JsonType::Number;
+            value->number = parseNumber();
+        } else if (m_in.compare(m_pos, 4, "true") == 0) {
+            value->type = JsonType::Bool;
+            value->boolean = true;
+            m_pos += 4;
+        } else if (m_in.compare(m_pos, 5, "false") == 0) {
+            value->type = JsonType::Bool;
+            m_pos += 5;
+        } else if (m_in.compare(m_pos, 4, "null") == 0) {
+            m_pos += 4;
+        } else {
+            throw RefError();
+        }
+        value->rawLength = m_pos - value->rawOffset;
+        return value;
+    }
+
+    uint32_t hex4() {
+        if (m_pos + 4 > m_in.size()) {
+            throw RefError();
+        }
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = m_in[m_pos++];
+            v <<= 4;
+            if (c >= '0' && c <= '9') v |= c - '0';
+            else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+            else throw RefError();
+        }
+        return v;
+    }
+
+    static void appendUtf8(std::string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    // One UTF-8 encoded code point, checked against the Unicode table of
+    // well-formed byte sequences
+    void copyUtf8(std::string& out) {
+        int lead = peek();
+        int length;
+        int low = 0x80;
+        int high = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF) {
+            length = 2;
+        } else if (lead >= 0xE0 && lead <= 0xEF) {
+            length = 3;
+            if (lead == 0xE0) low = 0xA0;
+            if (lead == 0xED) high = 0x9F;
+        } else if (lead >= 0xF0 && lead <= 0xF4) {
+            length = 4;
+            if (lead == 0xF0) low = 0x90;
+            if (lead == 0xF4) high = 0x8F;
+        } else {
+            throw RefError();
+        }
+        for (int i = 1; i < length; ++i) {
+            if (m_pos + i >= m_in.size()) {
+                throw RefError();
+            }
+            int byte = static_cast<unsigned char>(m_in[m_pos + i]);
+            if (byte < (i == 1 ? low : 0x80) || byte > (i == 1 ? high : 0xBF)) {
+                throw RefError();
+            }
+        }
+        out.append(m_in, m_pos, length);
+        m_pos += length;
+    }
+
+    std::string parseString() {
+        expect('"');
+        std::string out;
+        for (;;) {
+            int c = peek();
+            if (c < 0) {
+                throw RefError();
+            }
+            if (c == '"') {
+                ++m_pos;
+                return out;
+            }
+            if (c < 0x20) {
+                throw RefError();
+            }
+            if (c >= 0x80) {
+                copyUtf8(out);
+                continue;
+            }
+            ++m_pos;
+            if (c != '\\') {
+                out += static_cast<char>(c);
+                continue;
+            }
+            int e = peek();
+            ++m_pos;
+            switch (e) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                uint32_t cp = hex4();
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    // Pair with a following low surrogate escape if there is one
+                    size_t save = m_pos;
+                    bool paired = false;
+                    if (m_in.compare(m_pos, 2, "\\u") == 0) {
+                        m_pos += 2;
+                        uint32_t low = hex4();
+                        if (low >= 0xDC00 && low <= 0xDFFF) {
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                            paired = true;
+                        }
+                    }
+                    if (!paired) {
+                        m_pos = save;
+                        cp = 0xFFFD;
+                    }
+                } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                    cp = 0xFFFD;
+                }
+                appendUtf8(out, cp);
+                break;
+            }
+            default:
+                throw RefError();
+            }
+        }
+    }
+
+    double parseNumber() {
+        size_t start = m_pos;
+        auto digits = [this] {
+            size_t from = m_pos;
+            while (peek() >= '0' && peek() <= '9') {
+                ++m_pos;
+            }
+            if (m_pos == from) {
+                throw RefError();
+            }
+        };
+        if (peek() == '-') {
+            ++m_pos;
+        }
+        if (peek() == '0') {
+            ++m_pos;
+        } else {
+            digits();
+        }
+        if (peek() == '.') {
+            ++m_pos;
+            digits();
+        }
+        if (peek() == 'e' || peek() == 'E') {
+            ++m_pos;
+            if (peek() == '+' || peek() == '-') {
+                ++m_pos;
+            }
+            digits();
+        }
+        std::string text = m_in.substr(start, m_pos - start);
+        return std::strtod(text.c_str(), nullptr);
+    }
+};
+
+// Empty if value matches reference, else what differs
+std::string compare(const JsonValue& value, const RefValue& ref) {
+    if (value.type() != ref.type) {
+        return "type";
+    }
+    std::string_view raw = value.raw();
+    if (raw.data() == nullptr || raw.size() != ref.rawLength) {
+        return "raw length";
+    }
+    switch (ref.type) {
+    case JsonType::Bool:
+        return value.getBool() == ref.boolean ? "" : "bool";
+    case JsonType::Number: {
+        double number = value.getDouble();
+        // Same double, bit for bit (strtod and from_chars both round correctly)
+        return std::memcmp(&number, &ref.number, sizeof(double)) == 0 ? "" : "number";
+    }
+    case JsonType::String:
+        return value.getString() == ref.text ? "" : "string contents";
+    case JsonType::Array:
+        if (value.size() != ref.children.size()) {
+            return "array size";
+        }
+        for (size_t i = 0; i < ref.children.size(); ++i) {
+            std::string diff = compare(value.at(i), *ref.children[i]);
+            if (!diff.empty()) {
+                return "[" + std::to_string(i) + "] " + diff;
+            }
+        }
+        return "";
+    case JsonType::Object:
+        if (value.size() != ref.children.size()) {
+            return "object size";
+        }
+        // Lookups find a key's first occurrence
+        for (size_t i = 0; i < ref.children.size(); ++i) {
+            size_t first = std::find(ref.keys.begin(), ref.keys.end(), ref.keys[i]) - ref.keys.begin();
+            if (first != i) {
+                continue;
+            }
+            std::string diff = compare(value[ref.keys[i]], *ref.children[i]);
+            if (!diff.empty()) {
+                return "." + ref.keys[i] + " " + diff;
+            }
+        }
+        return "";
+    default:
+        return "";
+    }
+}
+
+// Empty if JsonDocument and the reference agree on input, else how they
+// differ. accepted is whether JsonDocument parsed it.
+std::string check(JsonDocument& document, const std::string& input, bool& accepted) {
+    std::unique_ptr<RefValue> ref;
+    try {
+        ref = ReferenceParser(input).parse();
+    } catch (const RefError&) {
+    }
+    JsonValue root;
+    accepted = true;
+    try {
+        root = document.parse(input);
+    } catch (const std::runtime_error&) {
+        accepted = false;
+    }
+    if (accepted != (ref != nullptr)) {
+        return accepted ? "accepted, the reference rejected" : "rejected, the reference accepted";
+    }
+    if (!accepted) {
+        return "";
+    }
+    std::string diff = compare(root, *ref);
+    return diff.empty() ? "" : "values differ: " + diff;
+}
+
+std::string printable(const std::string& input) {
+    std::ostringstream out;
+    for (unsigned char c : input) {
+        if (c >= 0x20 && c < 0x7F && c != '\\') {
+            out << c;
+        } else {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\x%02x", c);
+            out << escaped;
+        }
+    }
+    return out.str();
+}
+
+std::vector<std::pair<std::string, std::string>> readDirectory(const std::string& path) {
+    std::vector<std::pair<std::string, std::string>> files;
+    DIR* dir = ::opendir(path.c_str());
+    if (!dir) {
+        throw std::runtime_error("cannot open corpus directory " + path);
+    }
+    while (dirent* entry = ::readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() < 5 || name.compare(name.size() - 5, 5, ".json") != 0) {
+            continue;
+        }
+        std::ifstream file(path + "/" + name, std::ios::binary);
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        files.emplace_back(name, contents.str());
+    }
+    ::closedir(dir);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// Bytes that tend to change how JSON parses
+const char INTERESTING[] = "{}[]\",:\\ \t\n0123456789-+.eEtrufalsn/ubfu";
+const unsigned char INTERESTING_HIGH[] = {0x00, 0x1F, 0x7F, 0x80, 0xBF, 0xC0, 0xC2, 0xDF, 0xE0,
+                                          0xED, 0xEF, 0xF0, 0xF4, 0xF5, 0xFF};
+
+std::string mutate(const std::vector<std::string>& seeds, std::mt19937& rng) {
+    auto pick = [&rng](size_t n) { return std::uniform_int_distribution<size_t>(0, n - 1)(rng); };
+    auto interesting = [&]() -> char {
+        if (pick(4) == 0) {
+            return static_cast<char>(INTERESTING_HIGH[pick(sizeof(INTERESTING_HIGH))]);
+        }
+        return INTERESTING[pick(sizeof(INTERESTING) - 1)];
+    };
+
+    std::string input = seeds[pick(seeds.size())];
+    size_t mutations = 1 + pick(4);
+    for (size_t m = 0; m < mutations; ++m) {
+        size_t at = input.empty() ? 0 : pick(input.size() + 1);
+        switch (pick(7)) {
+        case 0:     // Flip a bit
+            if (at < input.size()) {
+                input[at] = static_cast<char>(input[at] ^ (1 << pick(8)));
+            }
+            break;
+        case 1:     // Replace a byte
+            if (at < input.size()) {
+                input[at] = interesting();
+            }
+            break;
+        case 2:     // Insert a byte
+            input.insert(input.begin() + static_cast<std::ptrdiff_t>(at), interesting());
+            break;
+        case 3:     // Delete a span
+            if (at < input.size()) {
+                input.erase(at, 1 + pick(std::min<size_t>(8, input.size() - at)));
+            }
+            break;
+        case 4:     // Duplicate a span
+            if (at < input.size()) {
+                size_t length = 1 + pick(std::min<size_t>(16, input.size() - at));
+                input.insert(at, input.substr(at, length));
+            }
+            break;
+        case 5:     // Truncate
+            input.resize(at);
+            break;
+        default: {  // Splice in part of another seed
+            const std::string& other = seeds[pick(seeds.size())];
+            if (!other.empty()) {
+                size_t from = pick(other.size());
+                input.insert(at, other.substr(from, 1 + pick(other.size() - from)));
+            }
+            break;
+        }
+        }
+    }
+    return input;
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--corpus" && hasValue) {
+            options.corpus = argv[++i];
+        } else if (arg == "--iterations" && hasValue) {
+            options.iterations = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--corpus DIR] [--iterations N] [--seed S]" << std::endl;
+            std::exit(2);
+        }
+    }
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options = parseOptions(argc, argv);
+
+    std::vector<std::pair<std::string, std::string>> valid;
+    std::vector<std::pair<std::string, std::string>> invalid;
+    try {
+        valid = readDirectory(options.corpus + "/valid");
+        invalid = readDirectory(options.corpus + "/invalid");
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    // One document throughout, reused like the server's
+    JsonDocument document;
+    int failures = 0;
+    std::vector<std::string> seeds;
+    bool accepted = false;
+    for (const auto& [name, input] : valid) {
+        std::string diff = check(document, input, accepted);
+        if (!accepted || !diff.empty()) {
+            std::cerr << "valid/" << name << ": " << (accepted ? diff : "rejected") << std::endl;
+            ++failures;
+        }
+        seeds.push_back(input);
+    }
+    for (const auto& [name, input] : invalid) {
+        std::string diff = check(document, input, accepted);
+        if (accepted || !diff.empty()) {
+            std::cerr << "invalid/" << name << ": " << (diff.empty() ? "accepted" : diff) << std::endl;
+            ++failures;
+        }
+        seeds.push_back(input);
+    }
+    std::cout << "Corpus: " << valid.size() << " valid, " << invalid.size() << " invalid, "
+              << failures << " failures" << std::endl;
+    if (failures > 0) {
+        return 1;
+    }
+
+    std::mt19937 rng(options.seed);
+    uint64_t acceptedCount = 0;
+    for (uint64_t i = 0; i < options.iterations; ++i) {
+        std::string input = mutate(seeds, rng);
+        std::string diff = check(document, input, accepted);
+        if (!diff.empty()) {
+            std::cerr << "Mutation " << i << " (seed " << options.seed << "): " << diff << "\n  input: "
+                      << printable(input) << std::endl;
+            return 1;
+        }
+        acceptedCount += accepted ? 1 : 0;
+    }
+    std::cout << "Mutations: " << options.iterations << " inputs, " << acceptedCount
+              << " accepted, no disagreements" << std::endl;
+    return 0;
+}
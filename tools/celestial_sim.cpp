@@ -0,0 +1,567 @@
+// Batch simulator: plays complete matches without the network, one per seed,
+// with a scripted player placing towers, and writes one result row per
+// match. Matches run on a JobSystem over every core.
+//
+// Usage: celestial_sim [--scenario none|ring|random] [--seeds LIST] [--threads N]
+//                      [--max-ticks T] [--format csv|json] [--out FILE] [--record DIR] [--trace FILE]
+//                      [--zero-alloc WARMUP] [--verbose]
+//        celestial_sim --replay LOG [--repeat N] [--threads N] [--trace FILE] [--verbose]
+//
+// LIST is a comma separated list of seeds and inclusive ranges, e.g. "1-100,250".
+// --replay plays a recorded input log (see InputLog.h) again as fast as
+// possible, checks it against the recorded state hashes, and reports tick
+// times, to compare builds on a real match.
+// --trace times every tick phase, prints the times per phase, and saves the
+// run as a Chrome trace (see Profiler.h), with the heap allocations made in
+// each phase.
+// --zero-alloc checks that, once a match has played WARMUP ticks, its ticks
+// stop allocating: it plays on one thread, counts every tick that still
+// allocates and what each phase allocated in them, and exits non-zero if
+// any did. Phases that create game objects (enemy waves spawned, towers
+// placed by commands, projectiles fired while targeting) are reported but
+// not checked, since every object is its own allocation.
+
+#include "Allocations.h"
+#include "GameWorld.h"
+#include "InputLog.h"
+#include "JobSystem.h"
+#include "JsonWriter.h"
+#include "LatencyHistogram.h"
+#include "Log.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Phases --zero-alloc doesn't fail on: they create game objects
+bool createsObjects(Phase phase) {
+    return phase == Phase::Spawn || phase == Phase::Commands || phase == Phase::Targeting;
+}
+
+enum class Scenario {
+    None,     // No towers: how long the base lasts on its own
+    Ring,     // Rings of towers around the base, types in rotation
+    Random    // Towers at random spots near the base, drawn from the seed
+};
+
+struct Options {
+    Scenario scenario = Scenario::Ring;
+    std::string scenarioName = "ring";
+    std::vector<uint32_t> seeds;
+    int threads = 0;
+    uint32_t maxTicks = 20 * 60 * GameWorld::SIM_RATE;  // 20 simulated minutes
+    bool json = false;
+    std::string out;        // Empty for stdout
+    std::string recordDir;  // Write an input log per match here, if not empty
+    std::string replay;     // Input log to replay instead of simulating seeds
+    int repeat = 1;         // Replays of the log
+    std::string trace;      // Chrome trace of the run, if not empty
+    int64_t zeroAlloc = -1; // Warm-up ticks before ticks must not allocate, -1 not to check
+    bool verbose = false;   // Keep the game's info log
+};
+
+struct MatchResult {
+    uint32_t seed = 0;
+    GameState outcome = GameState::Playing;   // Playing: hit the tick limit
+    int waves = 0;
+    int health = 0;
+    int resources = 0;
+    int towers = 0;
+    uint32_t ticks = 0;
+    LatencyHistogram tickTimes;   // Microseconds per tick
+    double wallMs = 0;
+    // With --zero-alloc: ticks after the warm-up, those that allocated in a
+    // checked phase, the first of them, and what each phase allocated after
+    // the warm-up
+    uint32_t checkedTicks = 0;
+    uint32_t allocatingTicks = 0;
+    uint32_t firstAllocatingTick = 0;
+    Allocations::ByPhase allocations{};
+};
+
+void usage(const char* program) {
+    std::cerr << "Usage: " << program
+              << " [--scenario none|ring|random] [--seeds LIST] [--threads N]"
+              << " [--max-ticks T] [--format csv|json] [--out FILE] [--record DIR] [--trace FILE]"
+              << " [--zero-alloc WARMUP] [--verbose]\n"
+              << "       " << program << " --replay LOG [--repeat N] [--threads N] [--trace FILE] [--verbose]"
+              << std::endl;
+    std::exit(2);
+}
+
+bool parseSeeds(const std::string& list, std::vector<uint32_t>& out) {
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        std::string item = list.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        char* rest = nullptr;
+        unsigned long first = std::strtoul(item.c_str(), &rest, 10);
+        unsigned long last = first;
+        if (*rest == '-') {
+            last = std::strtoul(rest + 1, &rest, 10);
+        }
+        if (item.empty() || *rest != '\0' || last < first) {
+            return false;
+        }
+        for (unsigned long seed = first; seed <= last; ++seed) {
+            out.push_back(static_cast<uint32_t>(seed));
+        }
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    std::string seeds = "1-100";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--scenario" && hasValue) {
+            options.scenarioName = argv[++i];
+            if (options.scenarioName == "none") {
+                options.scenario = Scenario::None;
+            } else if (options.scenarioName == "ring") {
+                options.scenario = Scenario::Ring;
+            } else if (options.scenarioName == "random") {
+                options.scenario = Scenario::Random;
+            } else {
+                usage(argv[0]);
+            }
+        } else if (arg == "--seeds" && hasValue) {
+            seeds = argv[++i];
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--max-ticks" && hasValue) {
+            options.maxTicks = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--format" && hasValue) {
+            std::string format = argv[++i];
+            if (format != "csv" && format != "json") {
+                usage(argv[0]);
+            }
+            options.json = format == "json";
+        } else if (arg == "--out" && hasValue) {
+            options.out = argv[++i];
+        } else if (arg == "--record" && hasValue) {
+            options.recordDir = argv[++i];
+        } else if (arg == "--replay" && hasValue) {
+            options.replay = argv[++i];
+        } else if (arg == "--repeat" && hasValue) {
+            options.repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--trace" && hasValue) {
+            options.trace = argv[++i];
+        } else if (arg == "--zero-alloc" && hasValue) {
+            options.zeroAlloc = std::max(0LL, std::atoll(argv[++i]));
+        } else if (arg == "--verbose") {
+            options.verbose = true;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (!parseSeeds(seeds, options.seeds)) {
+        std::cerr << "Bad seed list: " << seeds << std::endl;
+        usage(argv[0]);
+    }
+    // Allocations are told apart by tick only when nothing else runs
+    if (options.zeroAlloc >= 0) {
+        options.threads = 1;
+    }
+    if (options.threads == 0) {
+        options.threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    return options;
+}
+
+// Stands in for a player: every half second, if it can afford the next
+// tower, it asks for one the way a client would
+class ScriptedPlayer {
+public:
+    ScriptedPlayer(Scenario scenario, uint32_t seed) : m_scenario(scenario), m_rng(seed) {}
+
+    void play(GameWorld& world) {
+        if (m_scenario == Scenario::None || world.getTick() % (GameWorld::SIM_RATE / 2) != 0) {
+            return;
+        }
+        static const int COSTS[] = {50, 75, 60, 100};   // Basic, Splash, Slow, Gravity
+        static const int ROTATION[] = {0, 1, 0, 2, 0, 1, 0, 3};
+        int towerType = ROTATION[m_placed % 8];
+        if (world.getPlayerResources() < COSTS[towerType]) {
+            return;
+        }
+
+        // Only ask for spots the terrain allows; spacing is left to the game
+        const Vec2d base = world.getObjects()[0]->position;
+        for (int attempt = 0; attempt < 16; ++attempt) {
+            Vec2d spot = nextSpot(base);
+            if (world.getTerrain().isBuildable(spot)) {
+                Command command;
+                command.type = CommandType::BuildTower;
+                command.position = spot;
+                command.towerType = towerType;
+                world.submitCommand(command);
+                ++m_placed;
+                return;
+            }
+        }
+    }
+
+private:
+    Vec2d nextSpot(const Vec2d& base) {
+        double radius;
+        double angle;
+        if (m_scenario == Scenario::Ring) {
+            // 16 spots per ring, rings 40 apart from 80 out, wrapping at 240
+            int slot = m_slot++;
+            radius = 80.0 + 40.0 * ((slot / 16) % 5);
+            angle = (slot % 16) * (2.0 * M_PI / 16) + (slot / 16) * 0.2;
+        } else {
+            radius = std::uniform_real_distribution<double>(60.0, 250.0)(m_rng);
+            angle = std::uniform_real_distribution<double>(0.0, 2.0 * M_PI)(m_rng);
+        }
+        return Vec2d(base.x + radius * std::cos(angle), base.y + radius * std::sin(angle));
+    }
+
+    Scenario m_scenario;
+    std::mt19937 m_rng;
+    int m_slot = 0;
+    int m_placed = 0;
+};
+
+MatchResult playMatch(const Options& options, uint32_t seed, websocket::Server& server, JobSystem& jobs) {
+    MatchResult result;
+    result.seed = seed;
+    auto started = Clock::now();
+
+    // Never listens; the world only needs somewhere to send to
+    GameWorld world(server, jobs, 0);
+    world.seed(seed);
+    if (!options.recordDir.empty()) {
+        std::string path = options.recordDir + "/" + options.scenarioName + "-seed-" +
+                           std::to_string(seed) + ".jsonl";
+        world.record(std::make_unique<InputRecorder>(path, seed, 0));
+    }
+    world.init();
+    ScriptedPlayer player(options.scenario, seed);
+
+    // Stop as soon as the game is decided rather than lingering on the
+    // final state like a hosted match
+    const double deltaTime = 1.0 / GameWorld::SIM_RATE;
+    while (world.getGameState() == GameState::Playing && world.getTick() < options.maxTicks) {
+        player.play(world);
+        bool checked = options.zeroAlloc >= 0 && world.getTick() >= options.zeroAlloc;
+        uint64_t allocationsBefore = checked ? Allocations::count() : 0;
+        Allocations::ByPhase phasesBefore = checked ? Allocations::byPhase() : Allocations::ByPhase{};
+        auto tickStart = Clock::now();
+        world.tick(deltaTime);
+        result.tickTimes.record(static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - tickStart).count()));
+        if (checked) {
+            ++result.checkedTicks;
+            if (Allocations::count() != allocationsBefore) {
+                Allocations::ByPhase phasesAfter = Allocations::byPhase();
+                // Allocations outside every phase fail the tick as well
+                uint64_t unchecked = 0;
+                bool failed = false;
+                for (size_t i = 0; i < PHASE_COUNT; ++i) {
+                    uint64_t count = phasesAfter[i].count - phasesBefore[i].count;
+                    result.allocations[i].count += count;
+                    result.allocations[i].bytes += phasesAfter[i].bytes - phasesBefore[i].bytes;
+                    if (createsObjects(static_cast<Phase>(i))) {
+                        unchecked += count;
+                    } else {
+                        failed = failed || count > 0;
+                    }
+                }
+                failed = failed || Allocations::count() - allocationsBefore > unchecked;
+                if (failed && result.allocatingTicks++ == 0) {
+                    result.firstAllocatingTick = world.getTick();
+                }
+            }
+        }
+    }
+
+    result.outcome = world.getGameState();
+    result.waves = world.getCurrentWave();
+    result.health = world.getPlayerHealth();
+    result.resources = world.getPlayerResources();
+    result.ticks = world.getTick();
+    for (const auto& obj : world.getObjects()) {
+        if (obj->alive && obj->type == GameObjectType::Tower) {
+            ++result.towers;
+        }
+    }
+    result.wallMs = std::chrono::duration<double, std::milli>(Clock::now() - started).count();
+    return result;
+}
+
+const char* outcomeName(GameState state) {
+    switch (state) {
+    case GameState::Victory: return "victory";
+    case GameState::GameOver: return "gameOver";
+    default: return "timeout";
+    }
+}
+
+double meanMicros(const LatencyHistogram& histogram) {
+    return histogram.count() == 0 ? 0.0 : static_cast<double>(histogram.sum()) / histogram.count();
+}
+
+// Plays the log once; false, after saying where, if it diverges
+bool replayOnce(const InputLog& log, websocket::Server& server, JobSystem& jobs, LatencyHistogram& tickTimes) {
+    GameWorld world(server, jobs, log.matchId);
+    world.seed(log.seed);
+    world.init();
+
+    // Commands go in ahead of the tick that applied them. Nobody is
+    // connected, so they are not acknowledged.
+    const double deltaTime = 1.0 / GameWorld::SIM_RATE;
+    size_t nextCommand = 0;
+    size_t nextCheckpoint = 0;
+    uint32_t lastTick = log.lastTick();
+    while (world.getTick() < lastTick) {
+        uint32_t tick = world.getTick() + 1;
+        for (; nextCommand < log.commands.size() && log.commands[nextCommand].tick == tick; ++nextCommand) {
+            Command command = log.commands[nextCommand].command;
+            command.clientId = 0;
+            if (!world.submitCommand(command)) {
+                std::cerr << "Tick " << tick << " has more commands than the queue holds" << std::endl;
+                return false;
+            }
+        }
+
+        auto tickStart = Clock::now();
+        world.tick(deltaTime);
+        tickTimes.record(static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - tickStart).count()));
+
+        if (nextCheckpoint < log.checkpoints.size() && log.checkpoints[nextCheckpoint].tick == tick) {
+            if (world.stateHash() != log.checkpoints[nextCheckpoint].hash) {
+                std::cerr << "Replay diverged from the recording by tick " << tick << std::endl;
+                return false;
+            }
+            ++nextCheckpoint;
+        }
+    }
+    return true;
+}
+
+int replay(const Options& options, websocket::Server& server, JobSystem& jobs) {
+    InputLog log;
+    try {
+        log = InputLog::load(options.replay);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    std::cerr << "Replaying match " << log.matchId << " (seed " << log.seed << "): " << log.lastTick()
+              << " ticks, " << log.commands.size() << " commands, " << log.checkpoints.size()
+              << " checkpoints" << std::endl;
+
+    for (int run = 1; run <= options.repeat; ++run) {
+        LatencyHistogram tickTimes;
+        auto started = Clock::now();
+        bool matched = replayOnce(log, server, jobs, tickTimes);
+        double seconds = std::chrono::duration<double>(Clock::now() - started).count();
+        std::cerr << "Run " << run << ": " << (matched ? "matched" : "DIVERGED") << ", "
+                  << tickTimes.count() / seconds << " ticks/s, tick mean/p50/p99/max "
+                  << meanMicros(tickTimes) << "/" << tickTimes.percentile(0.5) << "/"
+                  << tickTimes.percentile(0.99) << "/" << tickTimes.max() << " us" << std::endl;
+        if (!matched) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void writeCsv(std::ostream& out, const Options& options, const std::vector<MatchResult>& results) {
+    out << "seed,scenario,outcome,waves,health,resources,towers,ticks,"
+           "tickMeanUs,tickP50Us,tickP99Us,tickMaxUs,wallMs\n";
+    for (const MatchResult& r : results) {
+        out << r.seed << ',' << options.scenarioName << ',' << outcomeName(r.outcome) << ','
+            << r.waves << ',' << r.health << ',' << r.resources << ',' << r.towers << ','
+            << r.ticks << ',' << meanMicros(r.tickTimes) << ',' << r.tickTimes.percentile(0.5) << ','
+            << r.tickTimes.percentile(0.99) << ',' << r.tickTimes.max() << ',' << r.wallMs << '\n';
+    }
+}
+
+void writeJson(std::ostream& out, const Options& options, const std::vector<MatchResult>& results) {
+    std::string json;
+    JsonWriter writer(json);
+    writer.beginArray();
+    for (const MatchResult& r : results) {
+        writer.beginObject();
+        writer.field(JSON_KEY("health"), r.health);
+        switch (r.outcome) {
+        case GameState::Victory: writer.field(JSON_KEY("outcome"), "victory"); break;
+        case GameState::GameOver: writer.field(JSON_KEY("outcome"), "gameOver"); break;
+        default: writer.field(JSON_KEY("outcome"), "timeout"); break;
+        }
+        writer.field(JSON_KEY("resources"), r.resources);
+        writer.key(JSON_KEY("scenario"));
+        writer.rawValue("\"" + options.scenarioName + "\"");
+        writer.field(JSON_KEY("seed"), r.seed);
+        writer.field(JSON_KEY("tickMaxUs"), r.tickTimes.max());
+        writer.field(JSON_KEY("tickMeanUs"), meanMicros(r.tickTimes));
+        writer.field(JSON_KEY("tickP50Us"), r.tickTimes.percentile(0.5));
+        writer.field(JSON_KEY("tickP99Us"), r.tickTimes.percentile(0.99));
+        writer.field(JSON_KEY("ticks"), r.ticks);
+        writer.field(JSON_KEY("towers"), r.towers);
+        writer.field(JSON_KEY("wallMs"), r.wallMs);
+        writer.field(JSON_KEY("waves"), r.waves);
+        writer.endObject();
+    }
+    writer.endArray();
+    out << json << '\n';
+}
+
+// Phase times and allocations of the whole run on stderr, and the trace
+int writeProfile(const Options& options, double seconds) {
+    Profiler::PhaseStats stats = Profiler::takeStats();
+    Allocations::ByPhase allocations = Allocations::byPhase();
+    std::cerr << "Phase times in us (count, mean, p50, p99, max) and allocations per run (count, bytes):"
+              << std::endl;
+    for (size_t i = 0; i < PHASE_COUNT; ++i) {
+        const LatencyHistogram& times = stats[i];
+        if (times.count() > 0) {
+            std::cerr << "  " << Profiler::phaseName(static_cast<Phase>(i)) << ": " << times.count() << ", "
+                      << meanMicros(times) << ", " << times.percentile(0.5) << ", "
+                      << times.percentile(0.99) << ", " << times.max() << "; "
+                      << static_cast<double>(allocations[i].count) / times.count() << ", "
+                      << static_cast<double>(allocations[i].bytes) / times.count() << std::endl;
+        }
+    }
+    try {
+        size_t phases = Profiler::writeTrace(options.trace, seconds + 1);
+        std::cerr << "Wrote " << phases << " phases to " << options.trace << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// The --zero-alloc verdict on stderr; 1 if any tick after the warm-up
+// allocated outside the phases that create objects
+int checkAllocations(const std::vector<MatchResult>& results) {
+    uint64_t checked = 0;
+    uint64_t allocating = 0;
+    const MatchResult* first = nullptr;
+    Allocations::ByPhase total{};
+    for (const MatchResult& r : results) {
+        checked += r.checkedTicks;
+        allocating += r.allocatingTicks;
+        if (r.allocatingTicks > 0 && !first) {
+            first = &r;
+        }
+        for (size_t i = 0; i < PHASE_COUNT; ++i) {
+            total[i].count += r.allocations[i].count;
+            total[i].bytes += r.allocations[i].bytes;
+        }
+    }
+    if (allocating == 0) {
+        std::cerr << "No allocations in " << checked
+                  << " ticks after the warm-up outside the phases that create objects" << std::endl;
+    } else {
+        std::cerr << allocating << " of " << checked
+                  << " ticks after the warm-up allocated outside the phases that create objects, first seed "
+                  << first->seed << " tick " << first->firstAllocatingTick << std::endl;
+    }
+    std::cerr << "Allocations after the warm-up (count, bytes):" << std::endl;
+    for (size_t i = 0; i < PHASE_COUNT; ++i) {
+        if (total[i].count > 0) {
+            Phase phase = static_cast<Phase>(i);
+            std::cerr << "  " << Profiler::phaseName(phase) << ": " << total[i].count << ", " << total[i].bytes
+                      << (createsObjects(phase) ? " (creates objects, not checked)" : "") << std::endl;
+        }
+    }
+    return allocating == 0 ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options = parseOptions(argc, argv);
+
+    // The game logs every wave and tower; only problems are worth seeing
+    // across thousands of matches
+    if (!options.verbose) {
+        Log::setLevel(LogLevel::Warn);
+    }
+
+    // Allocations are only told apart by phase while profiling
+    Profiler::enable(!options.trace.empty() || options.zeroAlloc >= 0);
+
+    websocket::Server server;
+    JobSystem jobs(static_cast<size_t>(options.threads - 1));
+    if (!options.replay.empty()) {
+        auto started = Clock::now();
+        int status = replay(options, server, jobs);
+        Log::flush();
+        if (!options.trace.empty()) {
+            double seconds = std::chrono::duration<double>(Clock::now() - started).count();
+            status = std::max(status, writeProfile(options, seconds));
+        }
+        return status;
+    }
+    std::vector<MatchResult> results(options.seeds.size());
+
+    // One job per match; a match's own parallel phases share the threads
+    auto started = Clock::now();
+    jobs.parallelFor(0, options.seeds.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            results[i] = playMatch(options, options.seeds[i], server, jobs);
+        }
+    });
+    double seconds = std::chrono::duration<double>(Clock::now() - started).count();
+    Log::flush();
+
+    std::ofstream file;
+    if (!options.out.empty()) {
+        file.open(options.out);
+        if (!file) {
+            std::cerr << "Cannot write " << options.out << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = options.out.empty() ? std::cout : file;
+    if (options.json) {
+        writeJson(out, options, results);
+    } else {
+        writeCsv(out, options, results);
+    }
+
+    uint64_t ticks = 0;
+    int outcomes[3] = {0, 0, 0};
+    for (const MatchResult& r : results) {
+        ticks += r.ticks;
+        ++outcomes[static_cast<int>(r.outcome)];
+    }
+    std::cerr << results.size() << " matches (" << options.scenarioName << ") on " << jobs.concurrency()
+              << " threads in " << seconds << " s: " << results.size() / seconds << " matches/s, "
+              << ticks / seconds << " ticks/s. Victories " << outcomes[static_cast<int>(GameState::Victory)]
+              << ", game overs " << outcomes[static_cast<int>(GameState::GameOver)]
+              << ", timeouts " << outcomes[static_cast<int>(GameState::Playing)] << std::endl;
+    int status = 0;
+    if (options.zeroAlloc >= 0) {
+        status = checkAllocations(results);
+    }
+    if (!options.trace.empty()) {
+        status = std::max(status, writeProfile(options, seconds));
+    }
+    return status;
+}